@@ -46,6 +46,9 @@ extern "C" {
 #define SPA_TYPE_PROPS__volume		SPA_TYPE_PROPS_BASE "volume"
 #define SPA_TYPE_PROPS__mute		SPA_TYPE_PROPS_BASE "mute"
 #define SPA_TYPE_PROPS__patternType	SPA_TYPE_PROPS_BASE "patternType"
+#define SPA_TYPE_PROPS__dropPolicy	SPA_TYPE_PROPS_BASE "dropPolicy"
+#define SPA_TYPE_PROPS__queueDepth	SPA_TYPE_PROPS_BASE "queueDepth"
+#define SPA_TYPE_PROPS__droppedFrames	SPA_TYPE_PROPS_BASE "droppedFrames"
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -29,6 +29,7 @@ struct spa_ringbuffer;
 #define SPA_TYPE_RINGBUFFER_BASE	SPA_TYPE__RingBuffer ":"
 
 #include <string.h>
+#include <sys/uio.h>
 
 #include <spa/utils/defs.h>
 
@@ -163,6 +164,254 @@ static inline void spa_ringbuffer_write_update(struct spa_ringbuffer *rbuf, int3
 	__atomic_store_n(&rbuf->writeindex, index, __ATOMIC_RELEASE);
 }
 
+/**
+ * Write the \a n_iov blocks in \a iov to \a buffer, one after the other,
+ * starting at \a index. \a size must be a power of 2 and there must be
+ * enough space for all blocks.
+ *
+ * The blocks are not visible to the reader until the returned index is
+ * committed with spa_ringbuffer_write_update(), so a batch of messages
+ * only costs one release store.
+ *
+ * \param rbuf a spa_ringbuffer
+ * \param buffer memory to write to
+ * \param size the size of \a memory
+ * \param index the write index to start from
+ * \param iov the blocks to write
+ * \param n_iov the number of blocks in \a iov
+ * \return the write index after the last block
+ */
+static inline uint32_t
+spa_ringbuffer_write_batch(struct spa_ringbuffer *rbuf,
+			   void *buffer, uint32_t size, uint32_t index,
+			   const struct iovec *iov, uint32_t n_iov)
+{
+	uint32_t i;
+	for (i = 0; i < n_iov; i++) {
+		spa_ringbuffer_write_data(rbuf, buffer, size, index & (size - 1),
+					  iov[i].iov_base, iov[i].iov_len);
+		index += iov[i].iov_len;
+	}
+	return index;
+}
+
+/**
+ * Read \a n_iov blocks from \a buffer into \a iov, one after the other,
+ * starting at \a index. \a size must be a power of 2 and there must be
+ * enough data for all blocks.
+ *
+ * Release all blocks at once with spa_ringbuffer_read_update() using the
+ * returned index.
+ *
+ * \param rbuf a spa_ringbuffer
+ * \param buffer memory to read from
+ * \param size the size of \a memory
+ * \param index the read index to start from
+ * \param iov the destination blocks
+ * \param n_iov the number of blocks in \a iov
+ * \return the read index after the last block
+ */
+static inline uint32_t
+spa_ringbuffer_read_batch(struct spa_ringbuffer *rbuf,
+			  const void *buffer, uint32_t size, uint32_t index,
+			  const struct iovec *iov, uint32_t n_iov)
+{
+	uint32_t i;
+	for (i = 0; i < n_iov; i++) {
+		spa_ringbuffer_read_data(rbuf, buffer, size, index & (size - 1),
+					 iov[i].iov_base, iov[i].iov_len);
+		index += iov[i].iov_len;
+	}
+	return index;
+}
+
+#define SPA_RINGBUFFER_CACHE_LINE	64
+
+/**
+ * A ringbuffer with the read and write index on separate cache lines.
+ *
+ * This avoids false sharing between a reader and a writer that run on
+ * different cores. Each side also keeps a copy of the index of the other
+ * side on its own cache line, so that the line of the other side is only
+ * loaded when the copy does not show enough data or space.
+ *
+ * The indexes are a full cache line apart so they never share a line,
+ * whatever the alignment of the memory the structure lives in.
+ *
+ * This is only for memory that is private to the process, struct
+ * spa_ringbuffer is used in shared structures such as struct spa_chunk.
+ */
+struct spa_ringbuffer_padded {
+	uint32_t readindex;		/*< the current read index */
+	uint32_t cached_writeindex;	/*< last writeindex seen by the reader */
+	uint8_t _pad0[SPA_RINGBUFFER_CACHE_LINE - 2 * sizeof(uint32_t)];
+	uint32_t writeindex;		/*< the current write index */
+	uint32_t cached_readindex;	/*< last readindex seen by the writer */
+	uint8_t _pad1[SPA_RINGBUFFER_CACHE_LINE - 2 * sizeof(uint32_t)];
+};
+
+/**
+ * Initialize a spa_ringbuffer_padded.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ */
+static inline void spa_ringbuffer_padded_init(struct spa_ringbuffer_padded *rbuf)
+{
+	rbuf->readindex = rbuf->cached_writeindex = 0;
+	rbuf->writeindex = rbuf->cached_readindex = 0;
+}
+
+/**
+ * Get the read index and available bytes for reading.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index the value of readindex
+ * \return number of available bytes to read, see
+ *         spa_ringbuffer_get_read_index()
+ */
+static inline int32_t
+spa_ringbuffer_padded_get_read_index(struct spa_ringbuffer_padded *rbuf, uint32_t *index)
+{
+	*index = rbuf->readindex;
+	rbuf->cached_writeindex = __atomic_load_n(&rbuf->writeindex, __ATOMIC_ACQUIRE);
+	return (int32_t) (rbuf->cached_writeindex - *index);
+}
+
+/**
+ * Get the read index and available bytes for reading, without touching
+ * the cache line of the writer when at least \a min bytes were already
+ * known to be available.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index the value of readindex
+ * \param min the number of bytes the caller needs
+ * \return number of available bytes to read. This can be less than what
+ *         is really available but is never less than \a min when
+ *         \a min bytes are available.
+ */
+static inline int32_t
+spa_ringbuffer_padded_read_avail(struct spa_ringbuffer_padded *rbuf, uint32_t *index,
+				 uint32_t min)
+{
+	int32_t avail;
+
+	*index = rbuf->readindex;
+	avail = (int32_t) (rbuf->cached_writeindex - *index);
+	if (avail < (int32_t) min)
+		avail = spa_ringbuffer_padded_get_read_index(rbuf, index);
+	return avail;
+}
+
+/**
+ * Read \a len bytes from \a buffer starting at \a offset,
+ * see spa_ringbuffer_read_data().
+ */
+static inline void
+spa_ringbuffer_padded_read_data(struct spa_ringbuffer_padded *rbuf,
+				const void *buffer, uint32_t size,
+				uint32_t offset, void *data, uint32_t len)
+{
+	spa_ringbuffer_read_data(NULL, buffer, size, offset, data, len);
+}
+
+/**
+ * Read a batch of blocks, see spa_ringbuffer_read_batch().
+ */
+static inline uint32_t
+spa_ringbuffer_padded_read_batch(struct spa_ringbuffer_padded *rbuf,
+				 const void *buffer, uint32_t size, uint32_t index,
+				 const struct iovec *iov, uint32_t n_iov)
+{
+	return spa_ringbuffer_read_batch(NULL, buffer, size, index, iov, n_iov);
+}
+
+/**
+ * Update the read pointer to \a index.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index new index
+ */
+static inline void
+spa_ringbuffer_padded_read_update(struct spa_ringbuffer_padded *rbuf, uint32_t index)
+{
+	__atomic_store_n(&rbuf->readindex, index, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the write index and the number of bytes inside the ringbuffer.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index the value of writeindex
+ * \return the fill level of \a rbuf, see spa_ringbuffer_get_write_index()
+ */
+static inline int32_t
+spa_ringbuffer_padded_get_write_index(struct spa_ringbuffer_padded *rbuf, uint32_t *index)
+{
+	*index = rbuf->writeindex;
+	rbuf->cached_readindex = __atomic_load_n(&rbuf->readindex, __ATOMIC_ACQUIRE);
+	return (int32_t) (*index - rbuf->cached_readindex);
+}
+
+/**
+ * Get the write index and the free space in the ringbuffer, without
+ * touching the cache line of the reader when at least \a min bytes
+ * were already known to be free.
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index the value of writeindex
+ * \param size the size of the ringbuffer memory
+ * \param min the number of bytes the caller wants to write
+ * \return the number of bytes that can be written. values < 0 mean
+ *         there was an overrun.
+ */
+static inline int32_t
+spa_ringbuffer_padded_write_avail(struct spa_ringbuffer_padded *rbuf, uint32_t *index,
+				  uint32_t size, uint32_t min)
+{
+	int32_t avail;
+
+	*index = rbuf->writeindex;
+	avail = (int32_t) size - (int32_t) (*index - rbuf->cached_readindex);
+	if (avail < (int32_t) min)
+		avail = (int32_t) size - spa_ringbuffer_padded_get_write_index(rbuf, index);
+	return avail;
+}
+
+/**
+ * Write \a len bytes to \a buffer starting at \a offset,
+ * see spa_ringbuffer_write_data().
+ */
+static inline void
+spa_ringbuffer_padded_write_data(struct spa_ringbuffer_padded *rbuf,
+				 void *buffer, uint32_t size,
+				 uint32_t offset, const void *data, uint32_t len)
+{
+	spa_ringbuffer_write_data(NULL, buffer, size, offset, data, len);
+}
+
+/**
+ * Write a batch of blocks, see spa_ringbuffer_write_batch().
+ */
+static inline uint32_t
+spa_ringbuffer_padded_write_batch(struct spa_ringbuffer_padded *rbuf,
+				  void *buffer, uint32_t size, uint32_t index,
+				  const struct iovec *iov, uint32_t n_iov)
+{
+	return spa_ringbuffer_write_batch(NULL, buffer, size, index, iov, n_iov);
+}
+
+/**
+ * Update the write pointer to \a index
+ *
+ * \param rbuf a spa_ringbuffer_padded
+ * \param index new index
+ */
+static inline void
+spa_ringbuffer_padded_write_update(struct spa_ringbuffer_padded *rbuf, uint32_t index)
+{
+	__atomic_store_n(&rbuf->writeindex, index, __ATOMIC_RELEASE);
+}
+
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -375,6 +375,7 @@ static int clear_buffers(struct state *this)
 		spa_list_init(&this->ready);
 		this->n_buffers = 0;
 	}
+	this->direct = false;
 	return 0;
 }
 
@@ -415,7 +416,9 @@ static int port_set_format(struct spa_node *node,
 	}
 
 	if (this->have_format) {
-		this->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS | SPA_PORT_INFO_FLAG_LIVE;
+		this->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+				   SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS |
+				   SPA_PORT_INFO_FLAG_LIVE;
 		this->info.rate = this->rate;
 	}
 
@@ -469,6 +472,7 @@ impl_node_port_use_buffers(struct spa_node *node,
 		clear_buffers(this);
 		return 0;
 	}
+	this->direct = false;
 
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b = &this->buffers[i];
@@ -502,6 +506,11 @@ impl_node_port_alloc_buffers(struct spa_node *node,
 			     uint32_t *n_buffers)
 {
 	struct state *this;
+	struct buffer *b;
+	struct spa_data *d;
+	void *data;
+	size_t size;
+	int res;
 
 	spa_return_val_if_fail(node != NULL, -EINVAL);
 	spa_return_val_if_fail(buffers != NULL, -EINVAL);
@@ -513,7 +522,41 @@ impl_node_port_alloc_buffers(struct spa_node *node,
 	if (!this->have_format)
 		return -EIO;
 
-	return -ENOTSUP;
+	if (*n_buffers == 0 || buffers[0]->n_datas < 1)
+		return -EINVAL;
+
+	/* give the mmap area of the device as the buffer so that the producer
+	 * renders into it directly, there is only one area so there is only
+	 * one buffer */
+	if ((res = spa_alsa_get_mmap_area(this, &data, &size)) < 0) {
+		spa_log_info(this->log, NAME " %p: can't use mmap area: %s", this,
+			     snd_strerror(res));
+		return -ENOTSUP;
+	}
+
+	clear_buffers(this);
+
+	b = &this->buffers[0];
+	b->outbuf = buffers[0];
+	b->outstanding = true;
+	b->h = spa_buffer_find_meta(b->outbuf, this->type.meta.Header);
+
+	d = buffers[0]->datas;
+	d[0].type = this->type.data.MemPtr;
+	d[0].flags = 0;
+	d[0].fd = -1;
+	d[0].mapoffset = 0;
+	d[0].maxsize = size;
+	d[0].data = data;
+	spa_ringbuffer_init(&d[0].chunk->area);
+	d[0].chunk->stride = this->frame_size;
+
+	this->n_buffers = *n_buffers = 1;
+	this->direct = true;
+
+	spa_log_info(this->log, NAME " %p: direct render into %p, %zd bytes", this, data, size);
+
+	return 0;
 }
 
 static int
@@ -288,6 +288,39 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 	return 0;
 }
 
+/** Get the interleaved mmap area of the device
+ * \param state the state
+ * \param[out] data the start of the area
+ * \param[out] size the size of the area in bytes
+ * \return 0 on success, -ENOTSUP when the area can't be used as one
+ *	interleaved buffer
+ */
+int spa_alsa_get_mmap_area(struct state *state, void **data, size_t *size)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, frames = state->buffer_frames;
+	unsigned int i, width;
+	int err;
+
+	if ((err = snd_pcm_avail_update(state->hndl)) < 0)
+		return err;
+	if ((err = snd_pcm_mmap_begin(state->hndl, &areas, &offset, &frames)) < 0)
+		return err;
+	snd_pcm_mmap_commit(state->hndl, offset, 0);
+
+	width = snd_pcm_format_physical_width(state->format);
+	for (i = 0; i < state->channels; i++) {
+		if (areas[i].addr != areas[0].addr ||
+		    areas[i].first != i * width ||
+		    areas[i].step != state->frame_size * 8)
+			return -ENOTSUP;
+	}
+	*data = areas[0].addr;
+	*size = state->buffer_frames * state->frame_size;
+
+	return 0;
+}
+
 static int set_swparams(struct state *state)
 {
 	snd_pcm_t *hndl = state->hndl;
@@ -321,15 +354,81 @@ static inline void try_pull(struct state *state, snd_pcm_uframes_t frames, bool
 	struct spa_port_io *io = state->io;
 
 	if (spa_list_is_empty(&state->ready) && do_pull) {
+		uint32_t max_size = frames * state->frame_size;
+
+		/* the producer writes after the data we did not commit yet, it
+		 * must not go past the free space of the device */
+		if (state->direct) {
+			uint32_t index;
+			int32_t avail;
+
+			avail = spa_ringbuffer_get_read_index(
+					&state->buffers[0].outbuf->datas[0].chunk->area, &index);
+			if (avail >= (int32_t) max_size)
+				return;
+			if (avail > 0)
+				max_size -= avail;
+		}
+
 		spa_log_trace(state->log, "alsa-util %p: %d", state, io->status);
 		io->status = SPA_STATUS_NEED_BUFFER;
 		io->range.offset = state->sample_count * state->frame_size;
 		io->range.min_size = state->threshold * state->frame_size;
-		io->range.max_size = frames * state->frame_size;
+		io->range.max_size = max_size;
 		state->callbacks->need_input(state->callbacks_data);
 	}
 }
 
+/* In direct mode index % maxsize is the device position. maxsize is often
+ * not a power of 2, so keep the indexes below a multiple of maxsize instead
+ * of letting them wrap at 2^32. The producer runs in the same thread. */
+static inline void direct_rebase(struct state *state)
+{
+	struct spa_data *d = state->buffers[0].outbuf->datas;
+	struct spa_ringbuffer *ringbuffer = &d[0].chunk->area;
+	uint32_t rindex, windex, base;
+
+	spa_ringbuffer_get_read_index(ringbuffer, &rindex);
+	spa_ringbuffer_get_write_index(ringbuffer, &windex);
+
+	base = rindex - rindex % d[0].maxsize;
+	if (base == 0)
+		return;
+
+	spa_ringbuffer_read_update(ringbuffer, rindex - base);
+	spa_ringbuffer_write_update(ringbuffer, windex - base);
+}
+
+/* in direct mode the frames that the producer rendered stay in the device
+ * memory after the buffer was reused, commit them without a ready buffer */
+static inline snd_pcm_uframes_t
+pull_direct_frames(struct state *state,
+		   const snd_pcm_channel_area_t *my_areas,
+		   snd_pcm_uframes_t offset,
+		   snd_pcm_uframes_t frames)
+{
+	struct spa_data *d = state->buffers[0].outbuf->datas;
+	struct spa_ringbuffer *ringbuffer = &d[0].chunk->area;
+	snd_pcm_uframes_t n_frames;
+	uint32_t index;
+	int32_t avail;
+
+	if (d[0].data != my_areas[0].addr)
+		return 0;
+
+	avail = spa_ringbuffer_get_read_index(ringbuffer, &index);
+	if (avail < (int32_t) state->frame_size ||
+	    index % d[0].maxsize != offset * state->frame_size)
+		return 0;
+
+	n_frames = SPA_MIN(avail / state->frame_size, frames);
+	spa_ringbuffer_read_update(ringbuffer, index + n_frames * state->frame_size);
+
+	spa_log_trace(state->log, "alsa-util %p: %u committed %lu pending frames", state,
+		      index, n_frames);
+	return n_frames;
+}
+
 static inline snd_pcm_uframes_t
 pull_frames(struct state *state,
 	    const snd_pcm_channel_area_t *my_areas,
@@ -361,11 +460,29 @@ pull_frames(struct state *state,
 		avail = spa_ringbuffer_get_read_index(ringbuffer, &index);
 		avail /= state->frame_size;
 
+		if (state->direct && d[0].data == my_areas[0].addr &&
+		    index % d[0].maxsize != offset * state->frame_size) {
+			uint32_t pos = offset * state->frame_size, skip;
+
+			/* the device position moved without the producer, after
+			 * silence or a restart. Drop the data and continue at the
+			 * device position */
+			spa_ringbuffer_get_write_index(ringbuffer, &index);
+			skip = (pos + d[0].maxsize - index % d[0].maxsize) % d[0].maxsize;
+			spa_log_trace(state->log, "alsa-util %p: resync %u -> %u", state,
+				      index, index + skip);
+			spa_ringbuffer_write_update(ringbuffer, index + skip);
+			spa_ringbuffer_read_update(ringbuffer, index + skip);
+			avail = 0;
+		}
+
 		n_frames = SPA_MIN(avail, to_write);
 		n_bytes = n_frames * state->frame_size;
 
-		spa_ringbuffer_read_data(ringbuffer, d[0].data, d[0].maxsize,
-					 index % d[0].maxsize, dst, n_bytes);
+		/* the producer rendered into the mmap area, nothing to copy */
+		if (!state->direct || d[0].data != my_areas[0].addr)
+			spa_ringbuffer_read_data(ringbuffer, d[0].data, d[0].maxsize,
+						 index % d[0].maxsize, dst, n_bytes);
 		spa_ringbuffer_read_update(ringbuffer, index + n_bytes);
 
 		if (avail == n_frames || state->n_buffers == 1) {
@@ -380,6 +497,17 @@ pull_frames(struct state *state,
 		spa_log_trace(state->log, "alsa-util %p: %u written %lu frames, left %ld", state, index, total_frames, to_write);
 	}
 
+	if (state->direct && to_write > 0 && spa_list_is_empty(&state->ready)) {
+		snd_pcm_uframes_t n_frames;
+
+		n_frames = pull_direct_frames(state, my_areas, offset + total_frames, to_write);
+		total_frames += n_frames;
+		to_write -= n_frames;
+	}
+
+	if (state->direct)
+		direct_rebase(state);
+
 	try_pull(state, frames, do_pull);
 
 	if (total_frames == 0 && do_pull) {
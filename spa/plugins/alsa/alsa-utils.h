@@ -146,6 +146,8 @@ struct state {
 
 	struct buffer buffers[MAX_BUFFERS];
 	unsigned int n_buffers;
+	bool direct;		/**< the buffer is the mmap area, producers render
+				  *  directly into the device memory */
 
 	struct spa_list free;
 	struct spa_list ready;
@@ -172,6 +174,8 @@ spa_alsa_enum_format(struct state *state,
 
 int spa_alsa_set_format(struct state *state, struct spa_audio_info *info, uint32_t flags);
 
+int spa_alsa_get_mmap_area(struct state *state, void **data, size_t *size);
+
 int spa_alsa_start(struct state *state, bool xrun_recover);
 int spa_alsa_pause(struct state *state, bool xrun_recover);
 int spa_alsa_close(struct state *state);
@@ -121,6 +121,9 @@ struct impl {
 	mix_func_t add;
 
 	bool started;
+
+	uint64_t n_single;		/**< cycles with one input, copied */
+	uint64_t n_mixed;		/**< cycles with more than one input, mixed */
 };
 
 #define CHECK_FREE_IN_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT && (p) < MAX_PORTS && !this->in_ports[(p)].valid)
@@ -159,6 +162,8 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 		this->started = true;
 	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
 		this->started = false;
+		spa_log_debug(this->log, NAME " %p: %" PRIu64 " single %" PRIu64 " mixed cycles",
+			      this, this->n_single, this->n_mixed);
 	} else
 		return -ENOTSUP;
 
@@ -766,6 +771,10 @@ static int mix_output(struct impl *this, size_t n_bytes)
 	offset = index % maxsize;
 
 	n_bytes = SPA_MIN(n_bytes, avail);
+	/* the consumer can hand out memory that is partly still in use, like
+	 * the mmap area of a sink, never write more than it asked for */
+	if (outio->range.max_size > 0)
+		n_bytes = SPA_MIN(n_bytes, outio->range.max_size);
 
 	if (offset + n_bytes > maxsize) {
 		len1 = maxsize - offset;
@@ -795,6 +804,10 @@ static int mix_output(struct impl *this, size_t n_bytes)
 			add_port_data(this, od[0].data, len2, 0, in_port, layer);
 		layer++;
 	}
+	if (layer == 1)
+		this->n_single++;
+	else if (layer > 1)
+		this->n_mixed++;
 
 	spa_ringbuffer_write_update(rb, index + n_bytes);
 
@@ -320,11 +320,10 @@ static int make_buffer(struct impl *this)
 	data = d[0].data;
 
 	n_bytes = maxsize;
-	if (io->range.min_size != 0) {
+	if (io->range.min_size != 0)
 		n_bytes = SPA_MIN(n_bytes, io->range.min_size);
-		if (io->range.max_size < n_bytes)
-			n_bytes = io->range.max_size;
-	}
+	if (io->range.max_size != 0)
+		n_bytes = SPA_MIN(n_bytes, io->range.max_size);
 
 	spa_log_trace(this->log, NAME " %p: dequeue buffer %d %d %d", this, b->outbuf->id,
 		      maxsize, n_bytes);
@@ -22,7 +22,11 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include <spa/support/type-map.h>
 #include <spa/support/log.h>
@@ -36,6 +40,39 @@
 
 #define TRACE_BUFFER (16*1024)
 
+/* binary trace mode: each thread that logs at trace level claims one of
+ * the rings below and appends fixed-layout records to it without locks
+ * or formatting. A flusher on the main loop (or a helper thread when
+ * there is no main loop) formats and prints them. */
+#define TRACE_RINGS		16
+#define TRACE_RING_SIZE		(16*1024)
+#define TRACE_MAX_ARGS		16
+#define TRACE_MAX_STRING	64
+#define TRACE_MAX_RECORD	(sizeof(struct trace_record) + \
+				 TRACE_MAX_ARGS * (sizeof(uint64_t) + TRACE_MAX_STRING))
+#define TRACE_FLUSH_MSEC	10
+
+struct trace_record {
+	uint32_t size;			/**< size of record, args and strings, 8 aligned */
+	uint32_t n_args;		/**< number of 64 bit argument slots */
+	uint64_t time;			/**< CLOCK_MONOTONIC nsec */
+	const char *file;
+	const char *func;
+	const char *fmt;
+	int32_t line;
+	uint32_t truncated;		/**< more args than TRACE_MAX_ARGS */
+	/* followed by n_args 64 bit slots and the inline string data.
+	 * For %s the slot holds the offset of the string in that data */
+};
+
+struct trace_ring {
+	struct impl *impl;
+	int used;
+	uint32_t dropped;
+	struct spa_ringbuffer_padded rb;
+	uint8_t data[TRACE_RING_SIZE];
+};
+
 struct type {
 	uint32_t log;
 };
@@ -57,8 +94,459 @@ struct impl {
 
 	bool have_source;
 	struct spa_source source;
+
+	bool binary_trace;
+	struct trace_ring rings[TRACE_RINGS];
+	uint32_t dropped_no_ring;
+	pthread_key_t ring_key;
+	bool have_flush_source;
+	struct spa_source flush_source;
+	bool have_flush_thread;
+	bool flush_running;
+	pthread_t flush_thread;
+};
+
+static __thread struct trace_ring *thread_ring;
+
+static void release_ring(void *data)
+{
+	struct trace_ring *ring = data;
+	__atomic_store_n(&ring->used, 0, __ATOMIC_RELEASE);
+}
+
+static struct trace_ring *claim_ring(struct impl *impl)
+{
+	struct trace_ring *ring = thread_ring;
+	int i;
+
+	if (SPA_LIKELY(ring != NULL && ring->impl == impl))
+		return ring;
+
+	for (i = 0; i < TRACE_RINGS; i++) {
+		int expected = 0;
+
+		ring = &impl->rings[i];
+		if (__atomic_compare_exchange_n(&ring->used, &expected, 1, false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			thread_ring = ring;
+			pthread_setspecific(impl->ring_key, ring);
+			return ring;
+		}
+	}
+	return NULL;
+}
+
+enum trace_arg_type {
+	ARG_NONE,
+	ARG_INT,
+	ARG_UINT,
+	ARG_DOUBLE,
+	ARG_POINTER,
+	ARG_STRING,
+	ARG_ERRNO,
+};
+
+struct trace_spec {
+	const char *start;		/**< start of the conversion, at '%' */
+	const char *end;		/**< one past the conversion character */
+	int n_star;			/**< number of '*' width/precision args */
+	int length;			/**< 0, 'h', 'H' (hh), 'l', 'q' (ll), 'z', 'j', 't', 'L' */
+	char conv;
+	enum trace_arg_type type;
 };
 
+/* parse the conversion at p, which points at a '%' */
+static const char *parse_spec(const char *p, struct trace_spec *spec)
+{
+	spec->start = p++;
+	spec->n_star = 0;
+	spec->length = 0;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		spec->n_star++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->n_star++;
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+	}
+	switch (*p) {
+	case 'h':
+		spec->length = 'h';
+		if (*++p == 'h') {
+			spec->length = 'H';
+			p++;
+		}
+		break;
+	case 'l':
+		spec->length = 'l';
+		if (*++p == 'l') {
+			spec->length = 'q';
+			p++;
+		}
+		break;
+	case 'q': case 'z': case 'j': case 't': case 'L':
+		spec->length = *p++;
+		break;
+	}
+	spec->conv = *p;
+
+	switch (spec->conv) {
+	case 'd': case 'i': case 'c':
+		spec->type = ARG_INT;
+		break;
+	case 'u': case 'o': case 'x': case 'X':
+		spec->type = ARG_UINT;
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		spec->type = ARG_DOUBLE;
+		break;
+	case 'p': case 'n':
+		spec->type = ARG_POINTER;
+		break;
+	case 's':
+		spec->type = ARG_STRING;
+		break;
+	case 'm':
+		spec->type = ARG_ERRNO;
+		break;
+	case '%':
+		spec->type = ARG_NONE;
+		break;
+	default:
+		/* unknown or truncated conversion, print the rest verbatim */
+		spec->type = ARG_NONE;
+		spec->conv = 0;
+		return p;
+	}
+	spec->end = p + 1;
+	return spec->end;
+}
+
+static inline uint64_t fetch_int(int length, va_list *args)
+{
+	switch (length) {
+	case 'l':
+		return va_arg(*args, long);
+	case 'q':
+		return va_arg(*args, long long);
+	case 'z': case 't':
+		return va_arg(*args, ssize_t);
+	case 'j':
+		return va_arg(*args, intmax_t);
+	default:
+		return va_arg(*args, int);
+	}
+}
+
+static inline uint64_t fetch_uint(int length, va_list *args)
+{
+	switch (length) {
+	case 'l':
+		return va_arg(*args, unsigned long);
+	case 'q':
+		return va_arg(*args, unsigned long long);
+	case 'z': case 't':
+		return va_arg(*args, size_t);
+	case 'j':
+		return va_arg(*args, uintmax_t);
+	default:
+		return va_arg(*args, unsigned int);
+	}
+}
+
+/* Capture the record in the calling thread's ring. This does no
+ * allocation, no locking and no formatting; when the ring is full the
+ * record is dropped and counted. */
+static void
+trace_binary(struct impl *impl,
+	     const char *file,
+	     int line,
+	     const char *func,
+	     const char *fmt,
+	     va_list args)
+{
+	struct trace_ring *ring;
+	uint8_t buffer[TRACE_MAX_RECORD];
+	struct trace_record *rec = (struct trace_record *) buffer;
+	uint64_t *slots = SPA_MEMBER(rec, sizeof(struct trace_record), uint64_t);
+	char *strings = (char *) &slots[TRACE_MAX_ARGS];
+	uint32_t n_args = 0, str_size = 0, size, index;
+	struct timespec now;
+	struct trace_spec spec;
+	const char *p;
+	va_list copy;
+	int err = errno;
+
+	if ((ring = claim_ring(impl)) == NULL) {
+		__atomic_add_fetch(&impl->dropped_no_ring, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	rec->time = SPA_TIMESPEC_TO_TIME(&now);
+	rec->file = file;
+	rec->func = func;
+	rec->fmt = fmt;
+	rec->line = line;
+	rec->truncated = 0;
+
+	va_copy(copy, args);
+	for (p = fmt; *p; ) {
+		int i;
+
+		if (*p++ != '%')
+			continue;
+
+		p = parse_spec(p - 1, &spec);
+		if (spec.conv == 0)
+			break;
+		if (spec.type == ARG_NONE)
+			continue;
+
+		if (n_args + spec.n_star + 1 > TRACE_MAX_ARGS) {
+			rec->truncated = 1;
+			break;
+		}
+		for (i = 0; i < spec.n_star; i++)
+			slots[n_args++] = va_arg(copy, int);
+
+		switch (spec.type) {
+		case ARG_INT:
+			slots[n_args++] = fetch_int(spec.length, &copy);
+			break;
+		case ARG_UINT:
+			slots[n_args++] = fetch_uint(spec.length, &copy);
+			break;
+		case ARG_DOUBLE:
+		{
+			double d = spec.length == 'L' ?
+				(double) va_arg(copy, long double) : va_arg(copy, double);
+			memcpy(&slots[n_args++], &d, sizeof(double));
+			break;
+		}
+		case ARG_POINTER:
+			slots[n_args++] = (uintptr_t) va_arg(copy, void *);
+			break;
+		case ARG_STRING:
+		{
+			const char *str = va_arg(copy, const char *);
+			size_t len;
+
+			if (str == NULL)
+				str = "(null)";
+			len = strnlen(str, TRACE_MAX_STRING - 1);
+			memcpy(strings + str_size, str, len);
+			strings[str_size + len] = '\0';
+			slots[n_args++] = str_size;
+			str_size += len + 1;
+			break;
+		}
+		case ARG_ERRNO:
+			slots[n_args++] = err;
+			break;
+		default:
+			break;
+		}
+	}
+	va_end(copy);
+
+	/* move the strings right after the used slots */
+	if (n_args < TRACE_MAX_ARGS && str_size > 0)
+		memmove(&slots[n_args], strings, str_size);
+
+	rec->n_args = n_args;
+	size = sizeof(struct trace_record) + n_args * sizeof(uint64_t) + str_size;
+	rec->size = size = SPA_ROUND_UP_N(size, 8);
+
+	if (SPA_UNLIKELY(spa_ringbuffer_padded_write_avail(&ring->rb, &index,
+							   TRACE_RING_SIZE, size) < (int32_t) size)) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	spa_ringbuffer_padded_write_data(&ring->rb, ring->data, TRACE_RING_SIZE,
+					 index & (TRACE_RING_SIZE - 1), rec, size);
+	spa_ringbuffer_padded_write_update(&ring->rb, index + size);
+}
+
+/* format the single conversion in spec with the captured slots */
+static int
+format_spec(char *dest, size_t size, const struct trace_spec *spec,
+	    const uint64_t *slots, const char *strings)
+{
+	char f[64];
+	int len = SPA_MIN(spec->end - spec->start, (int) sizeof(f) - 1);
+	int w[2] = { 0, 0 }, i;
+	uint64_t v;
+
+	memcpy(f, spec->start, len);
+	f[len] = '\0';
+
+	for (i = 0; i < spec->n_star; i++)
+		w[i] = (int) *slots++;
+	v = *slots;
+
+	if (spec->type == ARG_ERRNO)
+		return snprintf(dest, size, "%s", strerror((int) v));
+
+	if (spec->type == ARG_DOUBLE) {
+		double d;
+		memcpy(&d, &v, sizeof(double));
+		if (spec->length == 'L') {
+			/* captured as double, drop the modifier */
+			char *l = strchr(f, 'L');
+			memmove(l, l + 1, strlen(l));
+		}
+#define FMT(val) (spec->n_star == 0 ? snprintf(dest, size, f, val) :	\
+		  spec->n_star == 1 ? snprintf(dest, size, f, w[0], val) :	\
+		  snprintf(dest, size, f, w[0], w[1], val))
+		return FMT(d);
+	}
+	if (spec->type == ARG_STRING)
+		return FMT(strings + v);
+	if (spec->type == ARG_POINTER) {
+		if (spec->conv == 'n')
+			return 0;
+		return FMT((void *) (uintptr_t) v);
+	}
+
+	switch (spec->length) {
+	case 'q':
+		return FMT((long long) v);
+	case 'l':
+		return FMT((long) v);
+	case 'z': case 't':
+		return FMT((ssize_t) v);
+	case 'j':
+		return FMT((intmax_t) v);
+	default:
+		return FMT((int) v);
+	}
+#undef FMT
+}
+
+static void format_record(struct impl *impl, const struct trace_record *rec)
+{
+	const uint64_t *slots = SPA_MEMBER(rec, sizeof(struct trace_record), const uint64_t);
+	const char *strings = (const char *) &slots[rec->n_args];
+	char text[512], location[1024];
+	size_t pos = 0;
+	uint32_t n_args = 0;
+	const char *p, *lit;
+	struct trace_spec spec;
+
+	for (p = lit = rec->fmt; *p && pos < sizeof(text) - 1; ) {
+		int res;
+		size_t n;
+
+		if (*p != '%') {
+			p++;
+			continue;
+		}
+		n = SPA_MIN((size_t)(p - lit), sizeof(text) - 1 - pos);
+		memcpy(text + pos, lit, n);
+		pos += n;
+
+		p = parse_spec(p, &spec);
+		lit = p;
+		if (spec.conv == 0)
+			break;
+		if (spec.type == ARG_NONE) {
+			text[pos++] = '%';
+			continue;
+		}
+		if (n_args + spec.n_star + 1 > rec->n_args) {
+			lit = "";
+			break;
+		}
+		res = format_spec(text + pos, sizeof(text) - pos, &spec, &slots[n_args], strings);
+		if (res > 0)
+			pos = SPA_MIN(pos + res, sizeof(text) - 1);
+		n_args += spec.n_star + 1;
+	}
+	if (pos < sizeof(text) - 1) {
+		size_t n = SPA_MIN(strlen(lit), sizeof(text) - 1 - pos);
+		memcpy(text + pos, lit, n);
+		pos += n;
+	}
+	text[pos] = '\0';
+
+	snprintf(location, sizeof(location), "[T][%" PRIu64 ".%09" PRIu64 "][%s:%i %s()] %s%s\n",
+		 (uint64_t) (rec->time / SPA_NSEC_PER_SEC),
+		 (uint64_t) (rec->time % SPA_NSEC_PER_SEC),
+		 strrchr(rec->file, '/') ? strrchr(rec->file, '/') + 1 : rec->file,
+		 rec->line, rec->func, text, rec->truncated ? "..." : "");
+	fputs(location, stderr);
+}
+
+/* Drain all rings. There is only ever one flusher, either the main loop
+ * source or the flush thread, so the rings stay single consumer. */
+static void flush_trace(struct impl *impl)
+{
+	uint8_t buffer[TRACE_MAX_RECORD];
+	struct trace_record *rec = (struct trace_record *) buffer;
+	uint32_t dropped;
+	int i;
+
+	for (i = 0; i < TRACE_RINGS; i++) {
+		struct trace_ring *ring = &impl->rings[i];
+		int32_t avail;
+		uint32_t index;
+
+		while ((avail = spa_ringbuffer_padded_read_avail(&ring->rb, &index,
+					sizeof(struct trace_record))) >= (int32_t) sizeof(struct trace_record)) {
+			spa_ringbuffer_padded_read_data(&ring->rb, ring->data, TRACE_RING_SIZE,
+							index & (TRACE_RING_SIZE - 1),
+							rec, sizeof(struct trace_record));
+			if (rec->size > TRACE_MAX_RECORD || rec->size > avail)
+				break;
+			spa_ringbuffer_padded_read_data(&ring->rb, ring->data, TRACE_RING_SIZE,
+							index & (TRACE_RING_SIZE - 1), rec, rec->size);
+			format_record(impl, rec);
+			spa_ringbuffer_padded_read_update(&ring->rb, index + rec->size);
+		}
+		if ((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) > 0)
+			fprintf(stderr, "[W][" NAME "] trace ring %d: dropped %u records\n",
+				i, dropped);
+	}
+	if ((dropped = __atomic_exchange_n(&impl->dropped_no_ring, 0, __ATOMIC_RELAXED)) > 0)
+		fprintf(stderr, "[W][" NAME "] no free trace ring: dropped %u records\n", dropped);
+}
+
+static void on_flush_timeout(struct spa_source *source)
+{
+	struct impl *impl = source->data;
+	uint64_t expirations;
+
+	if (read(source->fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t))
+		fprintf(stderr, "failed to read timer fd: %s", strerror(errno));
+
+	flush_trace(impl);
+}
+
+static void *flush_thread(void *data)
+{
+	struct impl *impl = data;
+	struct timespec ts = { 0, TRACE_FLUSH_MSEC * SPA_NSEC_PER_MSEC };
+
+	while (__atomic_load_n(&impl->flush_running, __ATOMIC_ACQUIRE)) {
+		nanosleep(&ts, NULL);
+		flush_trace(impl);
+	}
+	return NULL;
+}
+
 static void
 impl_log_logv(struct spa_log *log,
 	      enum spa_log_level level,
@@ -74,6 +562,11 @@ impl_log_logv(struct spa_log *log,
 	int size;
 	bool do_trace;
 
+	if (level == SPA_LOG_LEVEL_TRACE && impl->binary_trace) {
+		trace_binary(impl, file, line, func, fmt, args);
+		return;
+	}
+
 	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
 		level++;
 
@@ -177,9 +670,71 @@ static int impl_clear(struct spa_handle *handle)
 		close(this->source.fd);
 		this->have_source = false;
 	}
+	if (this->have_flush_source) {
+		spa_loop_remove_source(this->flush_source.loop, &this->flush_source);
+		close(this->flush_source.fd);
+		this->have_flush_source = false;
+	}
+	if (this->have_flush_thread) {
+		__atomic_store_n(&this->flush_running, false, __ATOMIC_RELEASE);
+		pthread_join(this->flush_thread, NULL);
+		this->have_flush_thread = false;
+	}
+	if (this->binary_trace) {
+		flush_trace(this);
+		thread_ring = NULL;
+		pthread_key_delete(this->ring_key);
+		this->binary_trace = false;
+	}
 	return 0;
 }
 
+static int init_binary_trace(struct impl *this, struct spa_loop *loop)
+{
+	int i, res;
+
+	for (i = 0; i < TRACE_RINGS; i++) {
+		this->rings[i].impl = this;
+		spa_ringbuffer_padded_init(&this->rings[i].rb);
+	}
+	if ((res = pthread_key_create(&this->ring_key, release_ring)) != 0)
+		return -res;
+
+	if (loop) {
+		struct itimerspec its;
+
+		this->flush_source.func = on_flush_timeout;
+		this->flush_source.data = this;
+		this->flush_source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		this->flush_source.mask = SPA_IO_IN;
+		this->flush_source.rmask = 0;
+		if (this->flush_source.fd < 0)
+			goto error;
+
+		its.it_value.tv_sec = 0;
+		its.it_value.tv_nsec = TRACE_FLUSH_MSEC * SPA_NSEC_PER_MSEC;
+		its.it_interval = its.it_value;
+		timerfd_settime(this->flush_source.fd, 0, &its, NULL);
+
+		spa_loop_add_source(loop, &this->flush_source);
+		this->have_flush_source = true;
+	} else {
+		this->flush_running = true;
+		if ((res = pthread_create(&this->flush_thread, NULL, flush_thread, this)) != 0) {
+			errno = res;
+			goto error;
+		}
+		this->have_flush_thread = true;
+	}
+	this->binary_trace = true;
+	return 0;
+
+      error:
+	res = -errno;
+	pthread_key_delete(this->ring_key);
+	return res;
+}
+
 static int
 impl_init(const struct spa_handle_factory *factory,
 	  struct spa_handle *handle,
@@ -190,6 +745,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	uint32_t i;
 	struct spa_loop *loop = NULL;
+	const char *str;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -225,6 +781,13 @@ impl_init(const struct spa_handle_factory *factory,
 
 	spa_ringbuffer_init(&this->trace_rb);
 
+	if (info && (str = spa_dict_lookup(info, "log.binary-trace")) && atoi(str) != 0) {
+		int res;
+		if ((res = init_binary_trace(this, loop)) < 0)
+			spa_log_warn(&this->log, NAME " %p: can't enable binary trace: %s",
+				     this, strerror(-res));
+	}
+
 	spa_log_debug(&this->log, NAME " %p: initialized", this);
 
 	return 0;
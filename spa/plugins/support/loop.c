@@ -88,7 +88,7 @@ struct impl {
 	struct spa_source *wakeup;
 	int ack_fd;
 
-	struct spa_ringbuffer buffer;
+	struct spa_ringbuffer_padded buffer;
 	uint8_t buffer_data[DATAS_SIZE];
 };
 
@@ -211,12 +211,13 @@ loop_invoke(struct spa_loop *loop,
 		int32_t filled, avail;
 		uint32_t idx, offset, l0;
 
-		filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-		if (filled < 0 || filled > DATAS_SIZE) {
+		avail = spa_ringbuffer_padded_write_avail(&impl->buffer, &idx, DATAS_SIZE,
+							  sizeof(struct invoke_item) + size);
+		if (avail < 0 || avail > DATAS_SIZE) {
+			filled = DATAS_SIZE - avail;
 			spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
 			return -EPIPE;
 		}
-		avail = DATAS_SIZE - filled;
 		if (avail < sizeof(struct invoke_item)) {
 			spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
 			return -EPIPE;
@@ -243,7 +244,7 @@ loop_invoke(struct spa_loop *loop,
 		}
 		memcpy(item->data, data, size);
 
-		spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+		spa_ringbuffer_padded_write_update(&impl->buffer, idx + item->item_size);
 
 		spa_loop_utils_signal_event(&impl->utils, impl->wakeup);
 
@@ -270,12 +271,12 @@ static void wakeup_func(void *data, uint64_t count)
 	struct impl *impl = data;
 	uint32_t index;
 
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
+	while (spa_ringbuffer_padded_read_avail(&impl->buffer, &index, 1) > 0) {
 		struct invoke_item *item =
 		    SPA_MEMBER(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
 		item->res = item->func(&impl->loop, true, item->seq, item->size, item->data,
 			   item->user_data);
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
+		spa_ringbuffer_padded_read_update(&impl->buffer, index + item->item_size);
 
 		if (item->block) {
 			uint64_t count = 1;
@@ -737,7 +738,7 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&impl->destroy_list);
 	spa_hook_list_init(&impl->hooks_list);
 
-	spa_ringbuffer_init(&impl->buffer);
+	spa_ringbuffer_padded_init(&impl->buffer);
 
 	impl->wakeup = spa_loop_utils_add_event(&impl->utils, wakeup_func, impl);
 	impl->ack_fd = eventfd(0, EFD_CLOEXEC);
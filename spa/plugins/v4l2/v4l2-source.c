@@ -41,25 +41,27 @@
 
 static const char default_device[] = "/dev/video0";
 
+#define MAX_BUFFERS     64
+
+#define DEFAULT_DROP_POLICY	drop_keep_latest
+#define DEFAULT_QUEUE_DEPTH	2
+
 struct props {
 	char device[64];
 	char device_name[128];
 	int device_fd;
+	uint32_t drop_policy;
+	uint32_t queue_depth;
 };
 
-static void reset_props(struct props *props)
-{
-	strncpy(props->device, default_device, 64);
-}
-
-#define MAX_BUFFERS     64
-
 struct buffer {
+	struct spa_list link;
 	struct spa_buffer *outbuf;
 	struct spa_meta_header *h;
 	bool outstanding;
 	bool allocated;
 	struct v4l2_buffer v4l2_buffer;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 };
 
 struct type {
@@ -70,6 +72,12 @@ struct type {
 	uint32_t prop_device;
 	uint32_t prop_device_name;
 	uint32_t prop_device_fd;
+	uint32_t prop_drop_policy;
+	uint32_t prop_queue_depth;
+	uint32_t prop_dropped_frames;
+	uint32_t drop_keep_latest;
+	uint32_t drop_bounded;
+	uint32_t drop_block;
 	struct spa_type_param param;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
@@ -93,6 +101,12 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->prop_device = spa_type_map_get_id(map, SPA_TYPE_PROPS__device);
 	type->prop_device_name = spa_type_map_get_id(map, SPA_TYPE_PROPS__deviceName);
 	type->prop_device_fd = spa_type_map_get_id(map, SPA_TYPE_PROPS__deviceFd);
+	type->prop_drop_policy = spa_type_map_get_id(map, SPA_TYPE_PROPS__dropPolicy);
+	type->prop_queue_depth = spa_type_map_get_id(map, SPA_TYPE_PROPS__queueDepth);
+	type->prop_dropped_frames = spa_type_map_get_id(map, SPA_TYPE_PROPS__droppedFrames);
+	type->drop_keep_latest = spa_type_map_get_id(map, SPA_TYPE_PROPS__dropPolicy ":keep-latest");
+	type->drop_bounded = spa_type_map_get_id(map, SPA_TYPE_PROPS__dropPolicy ":bounded");
+	type->drop_block = spa_type_map_get_id(map, SPA_TYPE_PROPS__dropPolicy ":block");
 	spa_type_param_map(map, &type->param);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
@@ -130,10 +144,16 @@ struct port {
 	struct v4l2_format fmt;
 	enum v4l2_buf_type type;
 	enum v4l2_memory memtype;
+	uint32_t n_planes;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
 
+	/* frames dequeued from the driver, waiting behind the one in io */
+	struct spa_list ready;
+	uint32_t n_ready;
+	uint64_t dropped;
+
 	bool source_enabled;
 	struct spa_source source;
 
@@ -142,6 +162,7 @@ struct port {
 
 	int64_t last_ticks;
 	int64_t last_monotonic;
+	int64_t last_sequence;
 };
 
 struct impl {
@@ -165,6 +186,13 @@ struct impl {
 
 #define CHECK_PORT(this,direction,port_id)  ((direction) == SPA_DIRECTION_OUTPUT && (port_id) == 0)
 
+static void reset_props(struct impl *this, struct props *props)
+{
+	strncpy(props->device, default_device, 64);
+	props->drop_policy = this->type.DEFAULT_DROP_POLICY;
+	props->queue_depth = DEFAULT_QUEUE_DEPTH;
+}
+
 
 #include "v4l2-utils.c"
 
@@ -207,7 +235,14 @@ static int impl_node_enum_params(struct spa_node *node,
 		param = spa_pod_builder_object(&b, t->param.idProps, t->props,
 			":", t->prop_device,      "S", p->device, sizeof(p->device),
 			":", t->prop_device_name, "S-r", p->device_name, sizeof(p->device_name),
-			":", t->prop_device_fd,   "i-r", p->device_fd);
+			":", t->prop_device_fd,   "i-r", p->device_fd,
+			":", t->prop_drop_policy, "Ie", p->drop_policy,
+							3, t->drop_keep_latest,
+							   t->drop_bounded,
+							   t->drop_block,
+			":", t->prop_queue_depth, "iru", p->queue_depth,
+							2, 1, MAX_BUFFERS,
+			":", t->prop_dropped_frames, "l-r", this->out_ports[0].dropped);
 	}
 	else
 		return -ENOENT;
@@ -236,11 +271,15 @@ static int impl_node_set_param(struct spa_node *node,
 		struct props *p = &this->props;
 
 		if (param == NULL) {
-			reset_props(p);
+			reset_props(this, p);
 			return 0;
 		}
 		spa_pod_object_parse(param,
-			":", t->prop_device, "?S", p->device, sizeof(p->device), NULL);
+			":", t->prop_device,      "?S", p->device, sizeof(p->device),
+			":", t->prop_drop_policy, "?I", &p->drop_policy,
+			":", t->prop_queue_depth, "?i", &p->queue_depth, NULL);
+
+		p->queue_depth = SPA_CLAMP(p->queue_depth, 1, MAX_BUFFERS);
 	}
 	else
 		return -ENOENT;
@@ -565,13 +604,28 @@ static int impl_node_port_enum_params(struct spa_node *node,
 		if (*index > 0)
 			return 0;
 
-		param = spa_pod_builder_object(&b,
-			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", port->fmt.fmt.pix.sizeimage,
-			":", t->param_buffers.stride,  "i", port->fmt.fmt.pix.bytesperline,
-			":", t->param_buffers.buffers, "iru", MAX_BUFFERS,
-									2, 2, MAX_BUFFERS,
-			":", t->param_buffers.align,   "i", 16);
+		if (port->export_buf)
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,     "i", spa_v4l2_max_plane_size(port),
+				":", t->param_buffers.stride,   "i", spa_v4l2_plane_stride(port, 0),
+				":", t->param_buffers.buffers,  "iru", MAX_BUFFERS,
+										2, 2, MAX_BUFFERS,
+				":", t->param_buffers.align,    "i", 16,
+				":", t->param_buffers.blocks,   "i", port->n_planes,
+				":", t->param_buffers.dataType, "Ieu", t->data.DmaBuf,
+										2, t->data.DmaBuf,
+										   t->data.MemPtr);
+		else
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,     "i", spa_v4l2_max_plane_size(port),
+				":", t->param_buffers.stride,   "i", spa_v4l2_plane_stride(port, 0),
+				":", t->param_buffers.buffers,  "iru", MAX_BUFFERS,
+										2, 2, MAX_BUFFERS,
+				":", t->param_buffers.align,    "i", 16,
+				":", t->param_buffers.blocks,   "i", port->n_planes,
+				":", t->param_buffers.dataType, "I", t->data.MemPtr);
 	}
 	else if (id == t->param.idMeta) {
 		switch (*index) {
@@ -846,6 +900,9 @@ static int impl_node_process_output(struct spa_node *node)
 		res = spa_v4l2_buffer_recycle(this, io->buffer_id);
 		io->buffer_id = SPA_ID_INVALID;
 	}
+	if (spa_v4l2_pop_ready(this))
+		res = SPA_STATUS_HAVE_BUFFER;
+
 	return res;
 }
 
@@ -995,9 +1052,10 @@ impl_init(const struct spa_handle_factory *factory,
 	this->node = impl_node;
 	this->clock = impl_clock;
 
-	reset_props(&this->props);
+	reset_props(this, &this->props);
 
 	this->out_ports[0].log = this->log;
+	spa_list_init(&this->out_ports[0].ready);
 	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_LIVE;
 
 	this->out_ports[0].export_buf = true;
@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <sched.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <poll.h>
@@ -43,6 +44,7 @@ static int spa_v4l2_open(struct impl *this)
 	struct port *port = &this->out_ports[0];
 	struct stat st;
 	struct props *props = &this->props;
+	uint32_t caps;
 
 	if (port->opened)
 		return 0;
@@ -78,7 +80,15 @@ static int spa_v4l2_open(struct impl *this)
 		return -1;
 	}
 
-	if ((port->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0) {
+	caps = port->cap.capabilities;
+	if (caps & V4L2_CAP_DEVICE_CAPS)
+		caps = port->cap.device_caps;
+
+	if (caps & V4L2_CAP_VIDEO_CAPTURE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	else {
 		spa_log_error(port->log, "v4l2: %s is no video capture device", props->device);
 		return -1;
 	}
@@ -130,16 +140,25 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 			spa_v4l2_buffer_recycle(this, i);
 		}
 		if (b->allocated) {
-			if (b->outbuf->datas[0].data)
-				munmap(b->outbuf->datas[0].data, b->outbuf->datas[0].maxsize);
-			if (b->outbuf->datas[0].fd != -1)
-				close(b->outbuf->datas[0].fd);
-			b->outbuf->datas[0].type = SPA_ID_INVALID;
+			uint32_t j;
+
+			for (j = 0; j < port->n_planes; j++) {
+				struct spa_data *d = &b->outbuf->datas[j];
+
+				if (d->data)
+					munmap(d->data, d->maxsize);
+				if (d->fd != -1)
+					close(d->fd);
+				d->type = SPA_ID_INVALID;
+			}
 		}
 	}
 
+	spa_list_init(&port->ready);
+	port->n_ready = 0;
+
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = 0;
 
@@ -188,6 +207,50 @@ static int spa_v4l2_close(struct impl *this)
 	return 0;
 }
 
+static inline bool spa_v4l2_is_mplane(struct port *port)
+{
+	return port->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
+static inline uint32_t spa_v4l2_plane_size(struct port *port, uint32_t plane)
+{
+	if (spa_v4l2_is_mplane(port))
+		return port->fmt.fmt.pix_mp.plane_fmt[plane].sizeimage;
+	return port->fmt.fmt.pix.sizeimage;
+}
+
+static inline uint32_t spa_v4l2_plane_stride(struct port *port, uint32_t plane)
+{
+	if (spa_v4l2_is_mplane(port))
+		return port->fmt.fmt.pix_mp.plane_fmt[plane].bytesperline;
+	return port->fmt.fmt.pix.bytesperline;
+}
+
+static uint32_t spa_v4l2_max_plane_size(struct port *port)
+{
+	uint32_t i, size = 0;
+
+	for (i = 0; i < port->n_planes; i++)
+		size = SPA_MAX(size, spa_v4l2_plane_size(port, i));
+	return size;
+}
+
+/* point the planes of a v4l2_buffer at @planes for multi-planar devices */
+static void spa_v4l2_buffer_init(struct port *port, struct v4l2_buffer *buf,
+				 struct v4l2_plane *planes, uint32_t index)
+{
+	spa_zero(*buf);
+	buf->type = port->type;
+	buf->memory = port->memtype;
+	buf->index = index;
+
+	if (spa_v4l2_is_mplane(port)) {
+		memset(planes, 0, sizeof(struct v4l2_plane) * port->n_planes);
+		buf->m.planes = planes;
+		buf->length = port->n_planes;
+	}
+}
+
 struct format_info {
 	uint32_t fourcc;
 	off_t format_offset;
@@ -543,7 +606,7 @@ spa_v4l2_enum_format(struct impl *this,
 	if (*index == 0) {
 		spa_zero(port->fmtdesc);
 		port->fmtdesc.index = 0;
-		port->fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		port->fmtdesc.type = port->type;
 		port->next_fmtdesc = true;
 		spa_zero(port->frmsize);
 		port->next_frmsize = true;
@@ -798,22 +861,54 @@ spa_v4l2_enum_format(struct impl *this,
 	return 1;
 }
 
+static void fmt_set_pix(struct v4l2_format *fmt, uint32_t fourcc, uint32_t width, uint32_t height)
+{
+	if (fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		fmt->fmt.pix_mp.pixelformat = fourcc;
+		fmt->fmt.pix_mp.field = V4L2_FIELD_ANY;
+		fmt->fmt.pix_mp.width = width;
+		fmt->fmt.pix_mp.height = height;
+	} else {
+		fmt->fmt.pix.pixelformat = fourcc;
+		fmt->fmt.pix.field = V4L2_FIELD_ANY;
+		fmt->fmt.pix.width = width;
+		fmt->fmt.pix.height = height;
+	}
+}
+
+static void fmt_get_pix(const struct v4l2_format *fmt, uint32_t *fourcc, uint32_t *width, uint32_t *height)
+{
+	if (fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		*fourcc = fmt->fmt.pix_mp.pixelformat;
+		*width = fmt->fmt.pix_mp.width;
+		*height = fmt->fmt.pix_mp.height;
+	} else {
+		*fourcc = fmt->fmt.pix.pixelformat;
+		*width = fmt->fmt.pix.width;
+		*height = fmt->fmt.pix.height;
+	}
+}
+
 static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format, bool try_only)
 {
 	struct port *port = &this->out_ports[0];
 	int cmd;
-	struct v4l2_format reqfmt, fmt;
+	struct v4l2_format fmt;
 	struct v4l2_streamparm streamparm;
 	const struct format_info *info = NULL;
 	uint32_t video_format;
 	struct spa_rectangle *size = NULL;
 	struct spa_fraction *framerate = NULL;
 	struct type *t = &this->type;
+	uint32_t fourcc, width, height;
+
+	if (spa_v4l2_open(this) < 0)
+		return -1;
 
 	spa_zero(fmt);
 	spa_zero(streamparm);
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.type = port->type;
+	streamparm.type = port->type;
 
 	if (format->media_subtype == this->type.media_subtype.raw) {
 		video_format = format->info.raw.format;
@@ -841,24 +936,35 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 		return -1;
 	}
 
+	/* a format can map to both a contiguous and a multi-planar fourcc (NV12
+	 * and NV12M), pick the first one the multi-planar device accepts */
+	if (spa_v4l2_is_mplane(port)) {
+		const struct format_info *fi = info;
 
-	fmt.fmt.pix.pixelformat = info->fourcc;
-	fmt.fmt.pix.field = V4L2_FIELD_ANY;
-	fmt.fmt.pix.width = size->width;
-	fmt.fmt.pix.height = size->height;
+		while (fi) {
+			fmt_set_pix(&fmt, fi->fourcc, size->width, size->height);
+			if (xioctl(port->fd, VIDIOC_TRY_FMT, &fmt) == 0 &&
+			    fmt.fmt.pix_mp.pixelformat == fi->fourcc) {
+				info = fi;
+				break;
+			}
+			fi = find_format_info_by_media_type(t,
+							    format->media_type,
+							    format->media_subtype, video_format,
+							    (fi - format_info) + 1);
+		}
+		spa_zero(fmt.fmt);
+	}
+
+	fmt_set_pix(&fmt, info->fourcc, size->width, size->height);
 	streamparm.parm.capture.timeperframe.numerator = framerate->denom;
 	streamparm.parm.capture.timeperframe.denominator = framerate->num;
 
-	spa_log_info(port->log, "v4l2: set %08x %dx%d %d/%d", fmt.fmt.pix.pixelformat,
-		     fmt.fmt.pix.width, fmt.fmt.pix.height,
+	spa_log_info(port->log, "v4l2: set %08x %dx%d %d/%d", info->fourcc,
+		     size->width, size->height,
 		     streamparm.parm.capture.timeperframe.denominator,
 		     streamparm.parm.capture.timeperframe.numerator);
 
-	reqfmt = fmt;
-
-	if (spa_v4l2_open(this) < 0)
-		return -1;
-
 	cmd = try_only ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
 	if (xioctl(port->fd, cmd, &fmt) < 0) {
 		perror("VIDIOC_S_FMT");
@@ -869,25 +975,26 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	if (xioctl(port->fd, VIDIOC_S_PARM, &streamparm) < 0)
 		perror("VIDIOC_S_PARM");
 
-	spa_log_info(port->log, "v4l2: got %08x %dx%d %d/%d", fmt.fmt.pix.pixelformat,
-		     fmt.fmt.pix.width, fmt.fmt.pix.height,
+	fmt_get_pix(&fmt, &fourcc, &width, &height);
+
+	spa_log_info(port->log, "v4l2: got %08x %dx%d %d/%d", fourcc, width, height,
 		     streamparm.parm.capture.timeperframe.denominator,
 		     streamparm.parm.capture.timeperframe.numerator);
 
-	if (reqfmt.fmt.pix.pixelformat != fmt.fmt.pix.pixelformat ||
-	    reqfmt.fmt.pix.width != fmt.fmt.pix.width ||
-	    reqfmt.fmt.pix.height != fmt.fmt.pix.height)
+	if (info->fourcc != fourcc || size->width != width || size->height != height)
 		return -1;
 
 	if (try_only)
 		return 0;
 
-	size->width = fmt.fmt.pix.width;
-	size->height = fmt.fmt.pix.height;
+	size->width = width;
+	size->height = height;
 	framerate->num = streamparm.parm.capture.timeperframe.denominator;
 	framerate->denom = streamparm.parm.capture.timeperframe.numerator;
 
 	port->fmt = fmt;
+	port->n_planes = spa_v4l2_is_mplane(port) ?
+		SPA_CLAMP(fmt.fmt.pix_mp.num_planes, 1, VIDEO_MAX_PLANES) : 1;
 	port->info.flags = (port->export_buf ? SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS : 0) |
 	    SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS | SPA_PORT_INFO_FLAG_LIVE;
 	port->info.rate = streamparm.parm.capture.timeperframe.denominator;
@@ -895,18 +1002,107 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	return 0;
 }
 
+static void spa_v4l2_set_polling(struct impl *this, bool enabled)
+{
+	struct port *port = &this->out_ports[0];
+	uint32_t mask = enabled ? SPA_IO_IN | SPA_IO_ERR : SPA_IO_ERR;
+
+	if (port->source.mask == mask)
+		return;
+
+	port->source.mask = mask;
+	if (port->source_enabled)
+		spa_loop_update_source(port->data_loop, &port->source);
+}
+
+/* hand a new frame to io, applying the drop policy when the previous
+ * frame was not consumed yet */
+static void spa_v4l2_push_ready(struct impl *this, struct buffer *b)
+{
+	struct port *port = &this->out_ports[0];
+	struct props *props = &this->props;
+	struct spa_port_io *io = port->io;
+	uint32_t max_ready;
+
+	if (io->status != SPA_STATUS_HAVE_BUFFER) {
+		/* the consumer may have left a buffer in io to recycle */
+		if (io->buffer_id < port->n_buffers)
+			spa_v4l2_buffer_recycle(this, io->buffer_id);
+
+		io->buffer_id = b->outbuf->id;
+		io->status = SPA_STATUS_HAVE_BUFFER;
+
+		spa_log_trace(port->log, "v4l2 %p: have output %d", this, io->buffer_id);
+		this->callbacks->have_output(this->callbacks_data);
+		return;
+	}
+
+	spa_list_append(&port->ready, &b->link);
+	port->n_ready++;
+
+	if (props->drop_policy == this->type.drop_block) {
+		/* stop dequeueing until the consumer catches up, the driver
+		 * keeps the frames */
+		spa_v4l2_set_polling(this, false);
+		return;
+	}
+
+	max_ready = props->drop_policy == this->type.drop_bounded ? props->queue_depth - 1 : 0;
+
+	while (port->n_ready > max_ready) {
+		struct buffer *next;
+
+		/* drop the oldest frame, the one waiting in io */
+		spa_v4l2_buffer_recycle(this, io->buffer_id);
+
+		next = spa_list_first(&port->ready, struct buffer, link);
+		spa_list_remove(&next->link);
+		port->n_ready--;
+
+		io->buffer_id = next->outbuf->id;
+		port->dropped++;
+
+		spa_log_trace(port->log, "v4l2 %p: dropped frame, %" PRIu64 " total",
+			      this, port->dropped);
+	}
+}
+
+/* move the oldest waiting frame into io after the consumer took the last one */
+static bool spa_v4l2_pop_ready(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+	struct spa_port_io *io = port->io;
+	struct buffer *b;
+
+	if (port->n_ready == 0) {
+		spa_v4l2_set_polling(this, true);
+		return false;
+	}
+
+	b = spa_list_first(&port->ready, struct buffer, link);
+	spa_list_remove(&b->link);
+	port->n_ready--;
+
+	io->buffer_id = b->outbuf->id;
+	io->status = SPA_STATUS_HAVE_BUFFER;
+
+	if (port->n_ready == 0)
+		spa_v4l2_set_polling(this, true);
+
+	return true;
+}
+
 static int mmap_read(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_buffer buf;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 	struct buffer *b;
 	struct spa_data *d;
 	int64_t pts;
-	struct spa_port_io *io = port->io;
+	uint32_t i;
 
-	spa_zero(buf);
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	buf.memory = port->memtype;
+	spa_v4l2_buffer_init(port, &buf, planes, 0);
 
 	if (xioctl(port->fd, VIDIOC_DQBUF, &buf) < 0)
 		return errno;
@@ -925,20 +1121,29 @@ static int mmap_read(struct impl *this)
 		b->h->flags = 0;
 		if (buf.flags & V4L2_BUF_FLAG_ERROR)
 			b->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
+		/* the driver skipped frames since the last one we saw */
+		if (port->last_sequence != -1 &&
+		    buf.sequence != (uint32_t) (port->last_sequence + 1))
+			b->h->flags |= SPA_META_HEADER_FLAG_DISCONT;
 		b->h->seq = buf.sequence;
 		b->h->pts = pts;
 	}
+	port->last_sequence = buf.sequence;
 
 	d = b->outbuf->datas;
-	spa_ringbuffer_set_avail(&d[0].chunk->area, buf.bytesused);
-	d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+	if (spa_v4l2_is_mplane(port)) {
+		for (i = 0; i < port->n_planes; i++) {
+			d[i].chunk->area.readindex = planes[i].data_offset;
+			d[i].chunk->area.writeindex = planes[i].bytesused;
+			d[i].chunk->stride = spa_v4l2_plane_stride(port, i);
+		}
+	} else {
+		spa_ringbuffer_set_avail(&d[0].chunk->area, buf.bytesused);
+		d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+	}
 
 	b->outstanding = true;
-	io->buffer_id = b->outbuf->id;
-	io->status = SPA_STATUS_HAVE_BUFFER;
-
-	spa_log_trace(port->log, "v4l2 %p: have output %d", this, io->buffer_id);
-	this->callbacks->have_output(this->callbacks_data);
+	spa_v4l2_push_ready(this, b);
 
 	return 0;
 }
@@ -961,7 +1166,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 {
 	struct port *state = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	int i, j;
 	struct spa_data *d;
 
 	if (n_buffers > 0) {
@@ -980,7 +1185,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = state->type;
 	reqbuf.memory = state->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1005,18 +1210,24 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 
 		spa_log_info(state->log, "v4l2: import buffer %p", buffers[i]);
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < state->n_planes) {
 			spa_log_error(state->log, "v4l2: invalid memory on buffer %p", buffers[i]);
 			return -EINVAL;
 		}
 		d = buffers[i]->datas;
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = state->memtype;
-		b->v4l2_buffer.index = i;
+		spa_v4l2_buffer_init(state, &b->v4l2_buffer, b->planes, i);
 
-		if (d[0].type == this->type.data.MemPtr || d[0].type == this->type.data.MemFd) {
+		if (spa_v4l2_is_mplane(state)) {
+			for (j = 0; j < state->n_planes; j++) {
+				if (state->memtype == V4L2_MEMORY_USERPTR) {
+					b->planes[j].m.userptr = (unsigned long) d[j].data;
+					b->planes[j].length = d[j].maxsize;
+				} else {
+					b->planes[j].m.fd = d[j].fd;
+				}
+			}
+		} else if (d[0].type == this->type.data.MemPtr || d[0].type == this->type.data.MemFd) {
 			b->v4l2_buffer.m.userptr = (unsigned long) d[0].data;
 			b->v4l2_buffer.length = d[0].maxsize;
 		} else if (d[0].type == this->type.data.DmaBuf) {
@@ -1038,12 +1249,27 @@ mmap_init(struct impl *this,
 {
 	struct port *state = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
+	bool export_buf = state->export_buf;
 	int i;
 
 	state->memtype = V4L2_MEMORY_MMAP;
 
+	/* only export dmabufs when the peer accepts them */
+	for (i = 0; i < n_params; i++) {
+		uint32_t data_type = SPA_ID_INVALID;
+
+		if (!spa_pod_is_object_type(params[i], this->type.param_buffers.Buffers))
+			continue;
+
+		spa_pod_object_parse(params[i],
+			":", this->type.param_buffers.dataType, "?I", &data_type, NULL);
+
+		if (data_type != SPA_ID_INVALID)
+			export_buf &= data_type == this->type.data.DmaBuf;
+	}
+
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = state->type;
 	reqbuf.memory = state->memtype;
 	reqbuf.count = *n_buffers;
 
@@ -1059,14 +1285,15 @@ mmap_init(struct impl *this,
 		spa_log_error(state->log, "v4l2: can't allocate enough buffers");
 		return -ENOMEM;
 	}
-	if (state->export_buf)
+	if (export_buf)
 		spa_log_info(state->log, "v4l2: using EXPBUF");
 
 	for (i = 0; i < reqbuf.count; i++) {
 		struct buffer *b;
 		struct spa_data *d;
+		uint32_t j;
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < state->n_planes) {
 			spa_log_error(state->log, "v4l2: invalid buffer data");
 			return -EINVAL;
 		}
@@ -1077,10 +1304,7 @@ mmap_init(struct impl *this,
 		b->allocated = true;
 		b->h = spa_buffer_find_meta(b->outbuf, this->type.meta.Header);
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = state->memtype;
-		b->v4l2_buffer.index = i;
+		spa_v4l2_buffer_init(state, &b->v4l2_buffer, b->planes, i);
 
 		if (xioctl(state->fd, VIDIOC_QUERYBUF, &b->v4l2_buffer) < 0) {
 			perror("VIDIOC_QUERYBUF");
@@ -1088,36 +1312,50 @@ mmap_init(struct impl *this,
 		}
 
 		d = buffers[i]->datas;
-		d[0].mapoffset = 0;
-		d[0].maxsize = b->v4l2_buffer.length;
-		spa_ringbuffer_set_avail(&d[0].chunk->area, 0);
-		d[0].chunk->stride = state->fmt.fmt.pix.bytesperline;
-
-		if (state->export_buf) {
-			struct v4l2_exportbuffer expbuf;
-
-			spa_zero(expbuf);
-			expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			expbuf.index = i;
-			expbuf.flags = O_CLOEXEC | O_RDONLY;
-			if (xioctl(state->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
-				perror("VIDIOC_EXPBUF");
-				continue;
+		for (j = 0; j < state->n_planes; j++) {
+			uint32_t length, offset;
+
+			if (spa_v4l2_is_mplane(state)) {
+				length = b->planes[j].length;
+				offset = b->planes[j].m.mem_offset;
+			} else {
+				length = b->v4l2_buffer.length;
+				offset = b->v4l2_buffer.m.offset;
 			}
-			d[0].type = this->type.data.DmaBuf;
-			d[0].fd = expbuf.fd;
-			d[0].data = NULL;
-		} else {
-			d[0].type = this->type.data.MemPtr;
-			d[0].fd = -1;
-			d[0].data = mmap(NULL,
-					 b->v4l2_buffer.length,
-					 PROT_READ, MAP_SHARED,
-					 state->fd,
-					 b->v4l2_buffer.m.offset);
-			if (d[0].data == MAP_FAILED) {
-				perror("mmap");
-				continue;
+
+			d[j].mapoffset = 0;
+			d[j].maxsize = length;
+			spa_ringbuffer_set_avail(&d[j].chunk->area, 0);
+			d[j].chunk->stride = spa_v4l2_plane_stride(state, j);
+
+			if (export_buf) {
+				struct v4l2_exportbuffer expbuf;
+
+				spa_zero(expbuf);
+				expbuf.type = state->type;
+				expbuf.index = i;
+				expbuf.plane = j;
+				expbuf.flags = O_CLOEXEC | O_RDONLY;
+				if (xioctl(state->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
+					perror("VIDIOC_EXPBUF");
+					continue;
+				}
+				d[j].type = this->type.data.DmaBuf;
+				d[j].fd = expbuf.fd;
+				d[j].data = NULL;
+			} else {
+				d[j].type = this->type.data.MemPtr;
+				d[j].fd = -1;
+				d[j].data = mmap(NULL,
+						 length,
+						 PROT_READ, MAP_SHARED,
+						 state->fd,
+						 offset);
+				if (d[j].data == MAP_FAILED) {
+					perror("mmap");
+					d[j].data = NULL;
+					continue;
+				}
 			}
 		}
 		spa_v4l2_buffer_recycle(this, i);
@@ -1171,7 +1409,9 @@ static int spa_v4l2_stream_on(struct impl *this)
 	if (state->started)
 		return 0;
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	state->last_sequence = -1;
+
+	type = state->type;
 	if (xioctl(state->fd, VIDIOC_STREAMON, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMON: %s", strerror(errno));
 		return errno;
@@ -1191,12 +1431,24 @@ static int spa_v4l2_stream_off(struct impl *this)
 		return 0;
 
 	spa_v4l2_port_set_enabled(this, false);
+	spa_v4l2_set_polling(this, true);
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = state->type;
 	if (xioctl(state->fd, VIDIOC_STREAMOFF, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMOFF: %s", strerror(errno));
 		return errno;
 	}
+	/* frames waiting for the consumer go back to the driver */
+	while (!spa_list_is_empty(&state->ready)) {
+		struct buffer *b = spa_list_first(&state->ready, struct buffer, link);
+		spa_list_remove(&b->link);
+		b->outstanding = false;
+	}
+	state->n_ready = 0;
+
+	if (state->dropped > 0)
+		spa_log_info(this->log, "v4l2: dropped %" PRIu64 " frames", state->dropped);
+
 	for (i = 0; i < state->n_buffers; i++) {
 		struct buffer *b;
 
@@ -18,6 +18,7 @@
  */
 
 #include <errno.h>
+#include <string.h>
 
 typedef enum {
 	GRAY = 0,
@@ -65,16 +66,28 @@ static Pixel colors[N_COLORS] = {
 
 /* YUV values are computed in init_colors() */
 
+/* gray, the base of the snow areas. Snow is gray so only the luma changes
+ * per pixel, the chroma stays at 128 */
+static Pixel snow_base = {0, 0, 0, 0, 128, 128};
+
+#define MAX_PLANES	3
+
 typedef struct _DrawingData DrawingData;
 
-typedef void (*DrawPixelFunc) (DrawingData * dd, int x, Pixel * pixel);
+typedef void (*DrawFillFunc) (DrawingData * dd, int x, int length, Pixel * color);
+typedef void (*DrawSnowFunc) (DrawingData * dd, uint8_t * line, int x, int length);
 
 struct _DrawingData {
-	char *line;
+	uint8_t *planes[MAX_PLANES];
+	int strides[MAX_PLANES];
+	int n_planes;
+	bool subsampled;	/* planes after the first have half the lines */
+	uint8_t *lines[MAX_PLANES];	/* first line of the current band */
 	int width;
 	int height;
-	int stride;
-	DrawPixelFunc draw_pixel;
+	DrawFillFunc fill;
+	DrawSnowFunc snow;
+	uint64_t *rand_state;
 };
 
 static inline void update_yuv(Pixel * pixel)
@@ -110,155 +123,329 @@ static void init_colors(void)
 	}
 }
 
-static void draw_pixel_rgb(DrawingData * dd, int x, Pixel * color)
+/* xorshift64*, gives 8 random luma values per call */
+static inline uint64_t draw_random(DrawingData * dd)
+{
+	uint64_t x = *dd->rand_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*dd->rand_state = x;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void fill_rgb(DrawingData * dd, int x, int length, Pixel * color)
+{
+	uint8_t *p = dd->lines[0] + 3 * x;
+	int i;
+
+	for (i = 0; i < length; i++, p += 3) {
+		p[0] = color->R;
+		p[1] = color->G;
+		p[2] = color->B;
+	}
+}
+
+static void snow_rgb(DrawingData * dd, uint8_t * line, int x, int length)
+{
+	uint8_t *p = line + 3 * x;
+	int i, j;
+
+	for (i = 0; i < length; i += 8) {
+		uint64_t r = draw_random(dd);
+		int n = SPA_MIN(8, length - i);
+
+		for (j = 0; j < n; j++, p += 3, r >>= 8)
+			p[0] = p[1] = p[2] = r;
+	}
+}
+
+static void fill_bgrx(DrawingData * dd, int x, int length, Pixel * color)
 {
-	dd->line[3 * x + 0] = color->R;
-	dd->line[3 * x + 1] = color->G;
-	dd->line[3 * x + 2] = color->B;
+	uint32_t *p = (uint32_t *) dd->lines[0] + x, v;
+	uint8_t *b = (uint8_t *) &v;
+	int i;
+
+	b[0] = color->B;
+	b[1] = color->G;
+	b[2] = color->R;
+	b[3] = 0xff;
+
+	for (i = 0; i < length; i++)
+		p[i] = v;
+}
+
+static void snow_bgrx(DrawingData * dd, uint8_t * line, int x, int length)
+{
+	uint8_t *p = line + 4 * x;
+	int i, j;
+
+	for (i = 0; i < length; i += 8) {
+		uint64_t r = draw_random(dd);
+		int n = SPA_MIN(8, length - i);
+
+		for (j = 0; j < n; j++, p += 4, r >>= 8)
+			p[0] = p[1] = p[2] = r;
+	}
 }
 
-static void draw_pixel_uyvy(DrawingData * dd, int x, Pixel * color)
+/* the chroma of a pixel pair is drawn with the even pixel */
+static void fill_uyvy(DrawingData * dd, int x, int length, Pixel * color)
 {
+	uint8_t *line = dd->lines[0];
+	uint32_t *p, v;
+	uint8_t *b = (uint8_t *) &v;
+	int end = x + length;
+
+	if (length <= 0)
+		return;
+
 	if (x & 1) {
 		/* odd pixel */
-		dd->line[2 * (x - 1) + 3] = color->Y;
-	} else {
-		/* even pixel */
-		dd->line[2 * x + 0] = color->U;
-		dd->line[2 * x + 1] = color->Y;
-		dd->line[2 * x + 2] = color->V;
+		line[2 * (x - 1) + 3] = color->Y;
+		x++;
+	}
+
+	b[0] = color->U;
+	b[1] = color->Y;
+	b[2] = color->V;
+	b[3] = color->Y;
+
+	for (p = (uint32_t *) (line + 2 * x); x + 1 < end; x += 2)
+		*p++ = v;
+
+	if (x < end) {
+		/* even pixel, its odd neighbour belongs to the next run */
+		line[2 * x + 0] = color->U;
+		line[2 * x + 1] = color->Y;
+		line[2 * x + 2] = color->V;
+	}
+}
+
+static void snow_uyvy(DrawingData * dd, uint8_t * line, int x, int length)
+{
+	uint8_t *p = line + 2 * x + 1;
+	int i, j;
+
+	for (i = 0; i < length; i += 8) {
+		uint64_t r = draw_random(dd);
+		int n = SPA_MIN(8, length - i);
+
+		for (j = 0; j < n; j++, p += 2, r >>= 8)
+			*p = r;
+	}
+}
+
+/* planar formats, chroma pixel c belongs to luma pixel 2c */
+static void fill_i420(DrawingData * dd, int x, int length, Pixel * color)
+{
+	int cx = (x + 1) / 2, cend = (x + length + 1) / 2;
+
+	memset(dd->lines[0] + x, color->Y, length);
+	memset(dd->lines[1] + cx, color->U, cend - cx);
+	memset(dd->lines[2] + cx, color->V, cend - cx);
+}
+
+static void fill_nv12(DrawingData * dd, int x, int length, Pixel * color)
+{
+	int cx = (x + 1) / 2, cend = (x + length + 1) / 2;
+	uint16_t *p = (uint16_t *) dd->lines[1] + cx, v;
+	uint8_t *b = (uint8_t *) &v;
+
+	memset(dd->lines[0] + x, color->Y, length);
+
+	b[0] = color->U;
+	b[1] = color->V;
+	for (; cx < cend; cx++)
+		*p++ = v;
+}
+
+static void snow_planar(DrawingData * dd, uint8_t * line, int x, int length)
+{
+	uint8_t *p = line + x;
+	uint64_t r;
+
+	for (; length >= 8; length -= 8, p += 8) {
+		r = draw_random(dd);
+		memcpy(p, &r, 8);
+	}
+	if (length > 0) {
+		r = draw_random(dd);
+		memcpy(p, &r, length);
 	}
 }
 
-static int drawing_data_init(DrawingData * dd, struct impl *this, char *data)
+static int drawing_data_init(DrawingData * dd, struct impl *this, uint8_t *data)
 {
 	struct spa_video_info *format = &this->current_format;
 	struct spa_rectangle *size = &format->info.raw.size;
+	uint32_t video_format = format->info.raw.format;
+	int chroma_lines = (size->height + 1) / 2;
 
 	if ((format->media_type != this->type.media_type.video) ||
 	    (format->media_subtype != this->type.media_subtype.raw))
 		return -ENOTSUP;
 
-	if (format->info.raw.format == this->type.video_format.RGB) {
-		dd->draw_pixel = draw_pixel_rgb;
-	} else if (format->info.raw.format == this->type.video_format.UYVY) {
-		dd->draw_pixel = draw_pixel_uyvy;
+	dd->planes[0] = data;
+	dd->strides[0] = this->stride;
+	dd->n_planes = 1;
+	dd->subsampled = false;
+
+	if (video_format == this->type.video_format.RGB) {
+		dd->fill = fill_rgb;
+		dd->snow = snow_rgb;
+	} else if (video_format == this->type.video_format.BGRx) {
+		dd->fill = fill_bgrx;
+		dd->snow = snow_bgrx;
+	} else if (video_format == this->type.video_format.UYVY) {
+		dd->fill = fill_uyvy;
+		dd->snow = snow_uyvy;
+	} else if (video_format == this->type.video_format.I420) {
+		dd->fill = fill_i420;
+		dd->snow = snow_planar;
+		dd->n_planes = 3;
+		dd->subsampled = true;
+		dd->strides[1] = dd->strides[2] = this->stride / 2;
+		dd->planes[1] = dd->planes[0] + dd->strides[0] * size->height;
+		dd->planes[2] = dd->planes[1] + dd->strides[1] * chroma_lines;
+	} else if (video_format == this->type.video_format.NV12) {
+		dd->fill = fill_nv12;
+		dd->snow = snow_planar;
+		dd->n_planes = 2;
+		dd->subsampled = true;
+		dd->strides[1] = this->stride;
+		dd->planes[1] = dd->planes[0] + dd->strides[0] * size->height;
 	} else
 		return -ENOTSUP;
 
-	dd->line = data;
 	dd->width = size->width;
 	dd->height = size->height;
-	dd->stride = this->stride;
+	dd->rand_state = &this->rand_state;
 
 	return 0;
 }
 
-static inline void draw_pixels(DrawingData * dd, int offset, Color color, int length)
+static inline int plane_line(DrawingData * dd, int plane, int y)
+{
+	return (plane > 0 && dd->subsampled) ? y / 2 : y;
+}
+
+/* Every line of a band has the same content, apart from the snow. The
+ * first line of the band is drawn with the fill and snow kernels and then
+ * copied to the other lines. For subsampled formats bands start on even
+ * lines so that each chroma line belongs to one band. */
+static bool band_begin(DrawingData * dd, int y1, int y2)
 {
-	int x;
+	int i;
 
-	for (x = offset; x < offset + length; x++) {
-		dd->draw_pixel(dd, x, &colors[color]);
-	}
+	if (y1 >= y2)
+		return false;
+
+	for (i = 0; i < dd->n_planes; i++)
+		dd->lines[i] = dd->planes[i] + plane_line(dd, i, y1) * dd->strides[i];
+
+	return true;
 }
 
-static inline void next_line(DrawingData * dd)
+static void band_end(DrawingData * dd, int y1, int y2, int snow_x)
 {
-	dd->line += dd->stride;
+	int i, y;
+
+	if (snow_x < dd->width)
+		dd->snow(dd, dd->lines[0], snow_x, dd->width - snow_x);
+
+	for (y = y1 + 1; y < y2; y++) {
+		uint8_t *line = dd->planes[0] + y * dd->strides[0];
+
+		memcpy(line, dd->lines[0], dd->strides[0]);
+		if (snow_x < dd->width)
+			dd->snow(dd, line, snow_x, dd->width - snow_x);
+	}
+
+	for (i = 1; i < dd->n_planes; i++) {
+		int end = dd->subsampled ? (y2 + 1) / 2 : y2;
+
+		for (y = plane_line(dd, i, y1) + 1; y < end; y++)
+			memcpy(dd->planes[i] + y * dd->strides[i], dd->lines[i], dd->strides[i]);
+	}
 }
 
 static void draw_smpte_snow(DrawingData * dd)
 {
 	int h, w;
 	int y1, y2;
-	int i, j;
+	int j;
 
 	w = dd->width;
 	h = dd->height;
 	y1 = 2 * h / 3;
 	y2 = 3 * h / 4;
 
-	for (i = 0; i < y1; i++) {
+	if (dd->subsampled) {
+		y1 &= ~1;
+		y2 &= ~1;
+	}
+
+	if (band_begin(dd, 0, y1)) {
 		for (j = 0; j < 7; j++) {
 			int x1 = j * w / 7;
 			int x2 = (j + 1) * w / 7;
-			draw_pixels(dd, x1, j, x2 - x1);
+			dd->fill(dd, x1, x2 - x1, &colors[j]);
 		}
-		next_line(dd);
+		band_end(dd, 0, y1, w);
 	}
 
-	for (i = y1; i < y2; i++) {
+	if (band_begin(dd, y1, y2)) {
 		for (j = 0; j < 7; j++) {
 			int x1 = j * w / 7;
 			int x2 = (j + 1) * w / 7;
 			Color c = (j & 1) ? BLACK : BLUE - j;
 
-			draw_pixels(dd, x1, c, x2 - x1);
+			dd->fill(dd, x1, x2 - x1, &colors[c]);
 		}
-		next_line(dd);
+		band_end(dd, y1, y2, w);
 	}
 
-	for (i = y2; i < h; i++) {
+	if (band_begin(dd, y2, h)) {
 		int x = 0;
 
 		/* negative I */
-		draw_pixels(dd, x, NEG_I, w / 6);
+		dd->fill(dd, x, w / 6, &colors[NEG_I]);
 		x += w / 6;
 
 		/* white */
-		draw_pixels(dd, x, WHITE, w / 6);
+		dd->fill(dd, x, w / 6, &colors[WHITE]);
 		x += w / 6;
 
 		/* positive Q */
-		draw_pixels(dd, x, POS_Q, w / 6);
+		dd->fill(dd, x, w / 6, &colors[POS_Q]);
 		x += w / 6;
 
 		/* pluge */
-		draw_pixels(dd, x, DARK_BLACK, w / 12);
+		dd->fill(dd, x, w / 12, &colors[DARK_BLACK]);
 		x += w / 12;
-		draw_pixels(dd, x, BLACK, w / 12);
+		dd->fill(dd, x, w / 12, &colors[BLACK]);
 		x += w / 12;
-		draw_pixels(dd, x, LIGHT_BLACK, w / 12);
+		dd->fill(dd, x, w / 12, &colors[LIGHT_BLACK]);
 		x += w / 12;
 
 		/* war of the ants (a.k.a. snow) */
-		for (j = x; j < w; j++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, j, &p);
-		}
-
-		next_line(dd);
+		dd->fill(dd, x, w - x, &snow_base);
+		band_end(dd, y2, h, x);
 	}
 }
 
 static void draw_snow(DrawingData * dd)
 {
-	int x, y;
-
-	for (y = 0; y < dd->height; y++) {
-		for (x = 0; x < dd->width; x++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, x, &p);
-		}
-
-		next_line(dd);
+	if (band_begin(dd, 0, dd->height)) {
+		dd->fill(dd, 0, dd->width, &snow_base);
+		band_end(dd, 0, dd->height, 0);
 	}
 }
 
-static int draw(struct impl *this, char *data)
+static int draw(struct impl *this, uint8_t *data)
 {
 	DrawingData dd;
 	int res;
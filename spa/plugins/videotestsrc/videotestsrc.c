@@ -128,6 +128,8 @@ struct impl {
 	struct spa_video_info current_format;
 	size_t bpp;
 	int stride;
+	uint32_t size;
+	uint64_t rand_state;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -472,8 +474,11 @@ static int port_enum_formats(struct spa_node *node,
 			"I", t->media_type.video,
 			"I", t->media_subtype.raw,
 			":", t->format_video.format,    "Ieu", t->video_format.RGB,
-								2, t->video_format.RGB,
+								5, t->video_format.RGB,
+								   t->video_format.BGRx,
 								   t->video_format.UYVY,
+								   t->video_format.I420,
+								   t->video_format.NV12,
 			":", t->format_video.size,      "Rru", &SPA_RECTANGLE(320, 240),
 								2, &SPA_RECTANGLE(1, 1),
 								   &SPA_RECTANGLE(INT32_MAX, INT32_MAX),
@@ -561,8 +566,6 @@ impl_node_port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idBuffers) {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-
 		if (!this->have_format)
 			return -EIO;
 		if (*index > 0)
@@ -570,7 +573,7 @@ impl_node_port_enum_params(struct spa_node *node,
 
 		param = spa_pod_builder_object(&b,
 			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", this->stride * raw_info->size.height,
+			":", t->param_buffers.size,    "i", this->size,
 			":", t->param_buffers.stride,  "i", this->stride,
 			":", t->param_buffers.buffers, "ir", 2,
 								2, 1, 32,
@@ -641,8 +644,13 @@ static int port_set_format(struct spa_node *node,
 
 		if (info.info.raw.format == this->type.video_format.RGB)
 			this->bpp = 3;
+		else if (info.info.raw.format == this->type.video_format.BGRx)
+			this->bpp = 4;
 		else if (info.info.raw.format == this->type.video_format.UYVY)
 			this->bpp = 2;
+		else if (info.info.raw.format == this->type.video_format.I420 ||
+			 info.info.raw.format == this->type.video_format.NV12)
+			this->bpp = 1;
 		else
 			return -EINVAL;
 
@@ -652,7 +660,20 @@ static int port_set_format(struct spa_node *node,
 
 	if (this->have_format) {
 		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-		this->stride = SPA_ROUND_UP_N(this->bpp * raw_info->size.width, 4);
+		uint32_t height = raw_info->size.height;
+		uint32_t chroma_lines = (height + 1) / 2;
+
+		if (raw_info->format == this->type.video_format.I420) {
+			/* chroma planes use half the luma stride */
+			this->stride = SPA_ROUND_UP_N(raw_info->size.width, 8);
+			this->size = this->stride * height + this->stride * chroma_lines;
+		} else if (raw_info->format == this->type.video_format.NV12) {
+			this->stride = SPA_ROUND_UP_N(raw_info->size.width, 4);
+			this->size = this->stride * height + this->stride * chroma_lines;
+		} else {
+			this->stride = SPA_ROUND_UP_N(this->bpp * raw_info->size.width, 4);
+			this->size = this->stride * height;
+		}
 	}
 
 	return 0;
@@ -718,6 +739,11 @@ impl_node_port_use_buffers(struct spa_node *node,
 				      buffers[i]);
 			return -EINVAL;
 		}
+		if (d[0].maxsize < this->size) {
+			spa_log_error(this->log, NAME " %p: buffer %p too small (%u < %u)", this,
+				      buffers[i], d[0].maxsize, this->size);
+			return -EINVAL;
+		}
 		spa_list_append(&this->empty, &b->link);
 	}
 	this->n_buffers = n_buffers;
@@ -987,6 +1013,8 @@ impl_init(const struct spa_handle_factory *factory,
 
 	spa_list_init(&this->empty);
 
+	this->rand_state = 0x853c49e6748fea9bULL;
+
 	this->timer_source.func = on_output;
 	this->timer_source.data = this;
 	this->timer_source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
@@ -684,7 +684,8 @@ static struct spa_buffer *find_free_buffer(struct impl *this, struct port *port)
 	return b->outbuf;
 }
 
-static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buffer *sbuf)
+static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buffer *sbuf,
+		      uint32_t max_size)
 {
 	uint32_t i, n_samples, n_bytes;
 	struct spa_data *sd, *dd;
@@ -703,6 +704,9 @@ static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buf
 	davail = dd[0].maxsize - davail;
 
 	towrite = SPA_MIN(savail, davail);
+	/* don't write past what the consumer asked for */
+	if (max_size > 0)
+		towrite = SPA_MIN(towrite, max_size);
 
 	while (towrite > 0) {
 		uint32_t soffset = sindex % sd[0].maxsize;
@@ -767,7 +771,7 @@ static int impl_node_process_input(struct spa_node *node)
 	input->status = SPA_STATUS_OK;
 
 	spa_log_trace(this->log, NAME " %p: do volume %d -> %d", this, sbuf->id, dbuf->id);
-	do_volume(this, dbuf, sbuf);
+	do_volume(this, dbuf, sbuf, output->range.max_size);
 
 	output->buffer_id = dbuf->id;
 	output->status = SPA_STATUS_HAVE_BUFFER;
@@ -0,0 +1,290 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <errno.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/support/type-map-impl.h>
+#include <spa/node/node.h>
+#include <spa/param/param.h>
+#include <spa/param/props.h>
+#include <spa/param/video/format-utils.h>
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+#define DEFAULT_PLUGIN	"build/spa/plugins/videotestsrc/libspa-videotestsrc.so"
+#define MIN_TIME	(SPA_NSEC_PER_SEC / 2)
+
+struct type {
+	uint32_t node;
+	uint32_t props;
+	uint32_t format;
+	uint32_t prop_pattern;
+	uint32_t pattern_smpte_snow;
+	uint32_t pattern_snow;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->prop_pattern = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType);
+	type->pattern_smpte_snow = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":smpte-snow");
+	type->pattern_snow = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":snow");
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+}
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+};
+
+struct data {
+	struct spa_type_map *map;
+	struct spa_log *log;
+	struct type type;
+
+	struct spa_support support[2];
+	uint32_t n_support;
+
+	const struct spa_handle_factory *factory;
+
+	struct spa_port_io io;
+	struct buffer buffer;
+	struct spa_buffer *buffers[1];
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int find_factory(struct data *data, const char *lib)
+{
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return -errno;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return -errno;
+	}
+
+	for (i = 0;;) {
+		const struct spa_handle_factory *factory;
+
+		if ((res = enum_func(&factory, &i)) <= 0) {
+			if (res != 0)
+				printf("can't enumerate factories: %s\n", spa_strerror(res));
+			break;
+		}
+		if (strcmp(factory->name, "videotestsrc") == 0) {
+			data->factory = factory;
+			return 0;
+		}
+	}
+	return -EBADF;
+}
+
+static double run(struct data *data, uint32_t format, uint32_t width, uint32_t height,
+		  uint32_t pattern)
+{
+	struct type *t = &data->type;
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct spa_pod_builder b = { 0 };
+	struct spa_pod *param;
+	uint8_t buffer[1024];
+	void *iface, *mem;
+	size_t size;
+	uint64_t start, elapsed;
+	uint32_t frames = 0;
+	int res;
+
+	handle = calloc(1, data->factory->size);
+	if ((res = spa_handle_factory_init(data->factory, handle, NULL,
+					   data->support, data->n_support)) < 0) {
+		printf("can't make factory instance: %d\n", res);
+		goto error;
+	}
+	if ((res = spa_handle_get_interface(handle, t->node, &iface)) < 0) {
+		printf("can't get interface %d\n", res);
+		goto error_clear;
+	}
+	node = iface;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_pod_builder_object(&b,
+		t->param.idProps, t->props,
+		":", t->prop_pattern, "I", pattern);
+	if ((res = spa_node_set_param(node, t->param.idProps, 0, param)) < 0)
+		goto error_clear;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_pod_builder_object(&b,
+		t->param.idFormat, t->format,
+		"I", t->media_type.video,
+		"I", t->media_subtype.raw,
+		":", t->format_video.format,    "I", format,
+		":", t->format_video.size,      "R", &SPA_RECTANGLE(width, height),
+		":", t->format_video.framerate, "F", &SPA_FRACTION(60, 1));
+	if ((res = spa_node_port_set_param(node, SPA_DIRECTION_OUTPUT, 0,
+					   t->param.idFormat, 0, param)) < 0)
+		goto error_clear;
+
+	/* large enough for all formats */
+	size = (size_t) SPA_ROUND_UP_N(width, 8) * height * 4;
+	mem = malloc(size);
+
+	data->buffers[0] = &data->buffer.buffer;
+	data->buffer.buffer.id = 0;
+	data->buffer.buffer.n_metas = 0;
+	data->buffer.buffer.n_datas = 1;
+	data->buffer.buffer.datas = data->buffer.datas;
+	data->buffer.datas[0].type = t->data.MemPtr;
+	data->buffer.datas[0].flags = 0;
+	data->buffer.datas[0].fd = -1;
+	data->buffer.datas[0].mapoffset = 0;
+	data->buffer.datas[0].maxsize = size;
+	data->buffer.datas[0].data = mem;
+	data->buffer.datas[0].chunk = &data->buffer.chunks[0];
+
+	if ((res = spa_node_port_use_buffers(node, SPA_DIRECTION_OUTPUT, 0,
+					     data->buffers, 1)) < 0)
+		goto error_free;
+
+	data->io = SPA_PORT_IO_INIT;
+	spa_node_port_set_io(node, SPA_DIRECTION_OUTPUT, 0, &data->io);
+
+	start = get_time();
+	do {
+		data->io.status = SPA_STATUS_NEED_BUFFER;
+		if ((res = spa_node_process_output(node)) != SPA_STATUS_HAVE_BUFFER) {
+			printf("process_output failed: %d\n", res);
+			goto error_free;
+		}
+		frames++;
+		elapsed = get_time() - start;
+	} while (elapsed < MIN_TIME);
+
+	spa_node_port_use_buffers(node, SPA_DIRECTION_OUTPUT, 0, NULL, 0);
+	free(mem);
+	spa_handle_clear(handle);
+	free(handle);
+
+	return (double) frames * SPA_NSEC_PER_SEC / elapsed;
+
+      error_free:
+	free(mem);
+      error_clear:
+	spa_handle_clear(handle);
+      error:
+	free(handle);
+	return -1.0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	struct type *t = &data.type;
+	const char *lib = argc > 1 ? argv[1] : DEFAULT_PLUGIN;
+	int res;
+	uint32_t i, j, k;
+	static const struct spa_rectangle sizes[] = {
+		{ 640, 480 },
+		{ 1920, 1080 },
+		{ 3840, 2160 },
+	};
+	struct {
+		const char *name;
+		uint32_t id;
+	} formats[] = {
+		{ "RGB", 0 }, { "BGRx", 0 }, { "UYVY", 0 }, { "I420", 0 }, { "NV12", 0 },
+	}, patterns[] = {
+		{ "smpte-snow", 0 }, { "snow", 0 },
+	};
+
+	data.map = &default_map.map;
+	data.log = &default_log.log;
+
+	data.support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, data.map);
+	data.support[1] = SPA_SUPPORT_INIT(SPA_TYPE__Log, data.log);
+	data.n_support = 2;
+
+	init_type(&data.type, data.map);
+
+	formats[0].id = t->video_format.RGB;
+	formats[1].id = t->video_format.BGRx;
+	formats[2].id = t->video_format.UYVY;
+	formats[3].id = t->video_format.I420;
+	formats[4].id = t->video_format.NV12;
+	patterns[0].id = t->pattern_smpte_snow;
+	patterns[1].id = t->pattern_snow;
+
+	if ((res = find_factory(&data, lib)) < 0) {
+		printf("can't find videotestsrc: %d\n", res);
+		return -1;
+	}
+
+	printf("%-12s %-6s %-11s %10s\n", "pattern", "format", "size", "frames/s");
+	for (i = 0; i < SPA_N_ELEMENTS(patterns); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(formats); j++) {
+			for (k = 0; k < SPA_N_ELEMENTS(sizes); k++) {
+				char size[32];
+				double fps;
+
+				fps = run(&data, formats[j].id, sizes[k].width, sizes[k].height,
+					  patterns[i].id);
+
+				snprintf(size, sizeof(size), "%ux%u", sizes[k].width, sizes[k].height);
+				printf("%-12s %-6s %-11s %10.1f\n",
+				       patterns[i].name, formats[j].name, size, fps);
+			}
+		}
+	}
+	return 0;
+}
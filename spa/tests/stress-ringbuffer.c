@@ -2,7 +2,10 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sched.h>
+#include <time.h>
 
 #include <spa/utils/ringbuffer.h>
 
@@ -90,12 +93,206 @@ static void *writer_start(void *arg)
 	return NULL;
 }
 
+/* cross-core benchmark: a writer and a reader on different cpus pass
+ * n_messages messages of msg_size bytes, committing batch messages per
+ * update. Each message starts with the time it was written so that the
+ * reader can measure the latency. */
+#define BENCH_BATCH_MAX	16
+
+struct bench {
+	bool padded;
+	uint32_t msg_size;
+	uint32_t batch;
+	uint64_t n_messages;
+
+	struct spa_ringbuffer rb;
+	struct spa_ringbuffer_padded prb;
+
+	uint64_t start, end;
+	uint64_t lat_total, lat_max;
+};
+
+static inline uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static void pin_thread(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu >= sysconf(_SC_NPROCESSORS_ONLN))
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *bench_writer(void *arg)
+{
+	struct bench *b = arg;
+	uint8_t msg[BENCH_BATCH_MAX][4096];
+	struct iovec iov[BENCH_BATCH_MAX];
+	uint32_t need = b->msg_size * b->batch, i;
+	uint64_t sent = 0;
+
+	pin_thread(0);
+
+	for (i = 0; i < b->batch; i++) {
+		memset(msg[i], i, b->msg_size);
+		iov[i].iov_base = msg[i];
+		iov[i].iov_len = b->msg_size;
+	}
+
+	b->start = get_time();
+	while (sent < b->n_messages) {
+		uint32_t index;
+		int32_t avail;
+		uint64_t now;
+
+		if (b->padded)
+			avail = spa_ringbuffer_padded_write_avail(&b->prb, &index, size, need);
+		else
+			avail = size - spa_ringbuffer_get_write_index(&b->rb, &index);
+
+		if (avail < need) {
+			sched_yield();
+			continue;
+		}
+
+		now = get_time();
+		for (i = 0; i < b->batch; i++)
+			memcpy(msg[i], &now, sizeof(uint64_t));
+
+		if (b->padded) {
+			index = spa_ringbuffer_padded_write_batch(&b->prb, data, size, index,
+								  iov, b->batch);
+			spa_ringbuffer_padded_write_update(&b->prb, index);
+		} else {
+			index = spa_ringbuffer_write_batch(&b->rb, data, size, index,
+							   iov, b->batch);
+			spa_ringbuffer_write_update(&b->rb, index);
+		}
+		sent += b->batch;
+	}
+	return NULL;
+}
+
+static void *bench_reader(void *arg)
+{
+	struct bench *b = arg;
+	uint8_t msg[4096];
+	uint64_t received = 0;
+
+	pin_thread(1);
+
+	while (received < b->n_messages) {
+		uint32_t index;
+		int32_t avail;
+		uint64_t sent, lat;
+
+		if (b->padded)
+			avail = spa_ringbuffer_padded_read_avail(&b->prb, &index, b->msg_size);
+		else
+			avail = spa_ringbuffer_get_read_index(&b->rb, &index);
+
+		if (avail < (int32_t) b->msg_size) {
+			sched_yield();
+			continue;
+		}
+
+		if (b->padded)
+			spa_ringbuffer_padded_read_data(&b->prb, data, size, index & (size - 1),
+							msg, b->msg_size);
+		else
+			spa_ringbuffer_read_data(&b->rb, data, size, index & (size - 1),
+						 msg, b->msg_size);
+
+		memcpy(&sent, msg, sizeof(uint64_t));
+		lat = get_time() - sent;
+		b->lat_total += lat;
+		b->lat_max = SPA_MAX(b->lat_max, lat);
+
+		if (b->padded)
+			spa_ringbuffer_padded_read_update(&b->prb, index + b->msg_size);
+		else
+			spa_ringbuffer_read_update(&b->rb, index + b->msg_size);
+		received++;
+	}
+	b->end = get_time();
+	return NULL;
+}
+
+static void run_bench(bool padded, uint32_t msg_size, uint32_t batch, uint64_t n_messages)
+{
+	struct bench b = { padded, msg_size, batch, n_messages, };
+	pthread_t reader_thread, writer_thread;
+	double elapsed;
+
+	spa_ringbuffer_init(&b.rb);
+	spa_ringbuffer_padded_init(&b.prb);
+
+	pthread_create(&reader_thread, NULL, bench_reader, &b);
+	pthread_create(&writer_thread, NULL, bench_writer, &b);
+	pthread_join(writer_thread, NULL);
+	pthread_join(reader_thread, NULL);
+
+	elapsed = (b.end - b.start) / (double) SPA_NSEC_PER_SEC;
+
+	printf("%-7s %6u %5u %12.2f %10.1f %10.1f %10.1f\n",
+	       padded ? "padded" : "plain", msg_size, batch,
+	       n_messages / elapsed / 1000000.0,
+	       n_messages * msg_size / elapsed / (1024.0 * 1024.0),
+	       (double) b.lat_total / n_messages / 1000.0,
+	       b.lat_max / 1000.0);
+}
+
+static void bench(uint64_t n_messages)
+{
+	static const uint32_t msg_sizes[] = { 16, 64, 256, 1024, 4096 };
+	static const uint32_t batches[] = { 1, 8 };
+	int i, j, k;
+
+	printf("variant msg-sz batch   Mmsgs/sec     MiB/sec  avg-lat-us max-lat-us\n");
+
+	for (i = 0; i < SPA_N_ELEMENTS(msg_sizes); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(batches); j++) {
+			if (msg_sizes[i] * batches[j] > size / 2)
+				continue;
+			for (k = 0; k < 2; k++)
+				run_bench(k == 1, msg_sizes[i], batches[j], n_messages);
+		}
+	}
+}
+
 int main(int argc, char *argv[])
 {
-	printf("starting ringbuffer stress test\n");
+	if (argc < 2) {
+		printf("usage: %s <size> [bench [n-messages]]\n", argv[0]);
+		return -1;
+	}
 
 	sscanf(argv[1], "%d", &size);
 
+	if (argc > 2 && strcmp(argv[2], "bench") == 0) {
+		uint64_t n_messages = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000;
+
+		if (size == 0 || (size & (size - 1)) != 0) {
+			printf("size must be a power of 2\n");
+			return -1;
+		}
+		printf("starting ringbuffer benchmark\n");
+		printf("buffer size (bytes): %d\n", size);
+		data = malloc(size);
+		bench(n_messages);
+		free(data);
+		return 0;
+	}
+
+	printf("starting ringbuffer stress test\n");
+
 	printf("buffer size (bytes): %d\n", size);
 	printf("array size (bytes): %ld\n", sizeof(int) * ARRAY_SIZE);
 
@@ -18,7 +18,6 @@
  */
 
 #include <stdio.h>
-#include <sys/mman.h>
 
 #include <SDL2/SDL.h>
 
@@ -103,7 +102,6 @@ on_stream_new_buffer(void *_data, uint32_t id)
 	struct data *data = _data;
 	struct pw_stream *stream = data->stream;
 	struct spa_buffer *buf;
-	uint8_t *map;
 	void *sdata, *ddata;
 	int sstride, dstride, ostride;
 	int i;
@@ -111,18 +109,12 @@ on_stream_new_buffer(void *_data, uint32_t id)
 
 	buf = pw_stream_peek_buffer(stream, id);
 
-	if (buf->datas[0].type == data->type.data.MemFd) {
-		map = mmap(NULL, buf->datas[0].maxsize + buf->datas[0].mapoffset, PROT_READ,
-			   MAP_PRIVATE, buf->datas[0].fd, 0);
-		sdata = SPA_MEMBER(map, buf->datas[0].mapoffset, uint8_t);
-	} else if (buf->datas[0].type == data->type.data.MemPtr) {
-		map = NULL;
-		sdata = buf->datas[0].data;
-	} else
+	if ((sdata = pw_stream_map_data(stream, id, 0)) == NULL)
 		return;
 
 	if (SDL_LockTexture(data->texture, NULL, &ddata, &dstride) < 0) {
 		fprintf(stderr, "Couldn't lock texture: %s\n", SDL_GetError());
+		pw_stream_unmap_data(stream, id, 0);
 		return;
 	}
 	sstride = buf->datas[0].chunk->stride;
@@ -136,14 +128,12 @@ on_stream_new_buffer(void *_data, uint32_t id)
 		dst += dstride;
 	}
 	SDL_UnlockTexture(data->texture);
+	pw_stream_unmap_data(stream, id, 0);
 
 	SDL_RenderClear(data->renderer);
 	SDL_RenderCopy(data->renderer, data->texture, NULL, NULL);
 	SDL_RenderPresent(data->renderer);
 
-	if (map)
-		munmap(map, buf->datas[0].maxsize + buf->datas[0].mapoffset);
-
 	pw_stream_recycle_buffer(stream, id);
 
 	handle_events(data);
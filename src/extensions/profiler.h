@@ -0,0 +1,102 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef __PIPEWIRE_EXT_PROFILER_H__
+#define __PIPEWIRE_EXT_PROFILER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/utils/defs.h>
+
+#include <pipewire/proxy.h>
+#include <pipewire/node.h>
+
+struct pw_profiler_proxy;
+
+#define PW_TYPE_INTERFACE__Profiler		PW_TYPE_INTERFACE_BASE "Profiler"
+
+#define PW_VERSION_PROFILER			0
+
+/** \class pw_profiler
+ *
+ * \brief Profiler object
+ *
+ * The profiler gives access to the processing statistics of the nodes
+ * in a shared memory area. The statistics are updated from the data
+ * thread after each process cycle without locking, readers use
+ * \ref pw_node_profile_read to get a consistent copy of a node profile.
+ */
+
+/** Shared profiler memory area \memberof pw_profiler */
+struct pw_profiler_area {
+	uint32_t n_nodes;		/**< number of node profiles in the area */
+	uint32_t padding[15];
+	/* followed by n_nodes struct pw_node_profile, unused profiles
+	 * have a node_id of SPA_ID_INVALID */
+};
+
+#define PW_PROFILER_AREA_NODES(a)	SPA_MEMBER((a), sizeof(struct pw_profiler_area), struct pw_node_profile)
+#define PW_PROFILER_AREA_SIZE(n)	(sizeof(struct pw_profiler_area) + (n) * sizeof(struct pw_node_profile))
+
+#define PW_PROFILER_PROXY_METHOD_NUM		0
+
+/** \ref pw_profiler methods */
+struct pw_profiler_proxy_methods {
+#define PW_VERSION_PROFILER_PROXY_METHODS	0
+	uint32_t version;
+};
+
+#define PW_PROFILER_PROXY_EVENT_AREA		0
+#define PW_PROFILER_PROXY_EVENT_NUM		1
+
+/** \ref pw_profiler events */
+struct pw_profiler_proxy_events {
+#define PW_VERSION_PROFILER_PROXY_EVENTS	0
+	uint32_t version;
+	/**
+	 * Notify of the profiler area
+	 *
+	 * This event is emited when binding to the profiler. The
+	 * memory is sealed and can only be mapped read-only.
+	 *
+	 * \param memfd the fd of the memory with the \ref pw_profiler_area
+	 * \param offset offset of the area in \a memfd
+	 * \param size size of the area
+	 */
+	void (*area) (void *object, int memfd, uint32_t offset, uint32_t size);
+};
+
+static inline void
+pw_profiler_proxy_add_listener(struct pw_profiler_proxy *p,
+			       struct spa_hook *listener,
+			       const struct pw_profiler_proxy_events *events,
+			       void *data)
+{
+        pw_proxy_add_proxy_listener((struct pw_proxy*)p, listener, events, data);
+}
+
+#define pw_profiler_resource_area(r,...)	\
+	pw_resource_notify(r,struct pw_profiler_proxy_events,area,__VA_ARGS__)
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __PIPEWIRE_EXT_PROFILER_H__ */
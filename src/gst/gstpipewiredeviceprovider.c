@@ -350,6 +350,10 @@ static void node_event_info(void *data, struct pw_node_info *info)
   GstPipeWireDeviceProvider *self = node_data->self;
   GstDevice *dev;
 
+  /* later updates only carry the changed fields */
+  if (info->change_mask != PW_NODE_CHANGE_MASK_ALL)
+    return;
+
   dev = new_node (self, info, node_data->id);
   if (dev) {
     if(self->list_only)
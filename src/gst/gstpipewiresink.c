@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <gst/allocators/gstfdmemory.h>
@@ -45,6 +46,23 @@
 
 static GQuark process_mem_data_quark;
 
+/* The file and range of one fd backed data plane of our buffers. Upstream
+ * memory that lives in the same range can be sent without a copy. */
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+  goffset offset;
+  gsize size;
+  guint id;
+  guint index;
+} ImportData;
+
+static void
+import_data_free (gpointer data)
+{
+  g_slice_free (ImportData, data);
+}
+
 GST_DEBUG_CATEGORY_STATIC (pipewire_sink_debug);
 #define GST_CAT_DEFAULT pipewire_sink_debug
 
@@ -126,6 +144,7 @@ gst_pipewire_sink_finalize (GObject * object)
   g_free (pwsink->path);
   g_free (pwsink->client_name);
   g_hash_table_unref (pwsink->buf_ids);
+  g_ptr_array_unref (pwsink->imports);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -281,6 +300,7 @@ gst_pipewire_sink_init (GstPipeWireSink * sink)
 
   sink->buf_ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
       (GDestroyNotify) gst_buffer_unref);
+  sink->imports = g_ptr_array_new_with_free_func (import_data_free);
 
   g_queue_init (&sink->queue);
 
@@ -404,6 +424,9 @@ typedef struct {
   struct spa_meta_header *header;
   guint flags;
   goffset offset;
+  gboolean busy;          /* queued or sent, until the buffer is recycled */
+  gboolean removed;       /* taken out of the pool for an import */
+  GstBuffer *imported;    /* upstream buffer that shares our memory */
 } ProcessMemData;
 
 static void
@@ -411,10 +434,19 @@ process_mem_data_destroy (gpointer user_data)
 {
   ProcessMemData *data = user_data;
 
+  if (data->imported)
+    gst_buffer_unref (data->imported);
   gst_object_unref (data->sink);
   g_slice_free (ProcessMemData, data);
 }
 
+static ProcessMemData *
+get_process_mem_data (GstBuffer *buffer)
+{
+  return gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
+                                    process_mem_data_quark);
+}
+
 static void
 on_add_buffer (void     *_data,
                uint32_t  id)
@@ -437,6 +469,9 @@ on_add_buffer (void     *_data,
 
   data.sink = gst_object_ref (pwsink);
   data.id = id;
+  data.busy = FALSE;
+  data.removed = FALSE;
+  data.imported = NULL;
   data.buf = b;
   data.header = spa_buffer_find_meta (b, t->meta.Header);
 
@@ -446,10 +481,24 @@ on_add_buffer (void     *_data,
 
     if (d->type == t->data.MemFd ||
         d->type == t->data.DmaBuf) {
+      struct stat st;
+
       gmem = gst_fd_allocator_alloc (pwsink->allocator, dup (d->fd),
                 d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_NONE);
       gst_memory_resize (gmem, d->chunk->offset + d->mapoffset, d->chunk->size);
       data.offset = d->mapoffset;
+
+      if (fstat (d->fd, &st) == 0) {
+        ImportData *imp = g_slice_new (ImportData);
+
+        imp->dev = st.st_dev;
+        imp->ino = st.st_ino;
+        imp->offset = d->mapoffset;
+        imp->size = d->maxsize;
+        imp->id = id;
+        imp->index = i;
+        g_ptr_array_add (pwsink->imports, imp);
+      }
     }
     else if (d->type == t->data.MemPtr) {
       gmem = gst_memory_new_wrapped (0, d->data, d->maxsize, d->chunk->offset,
@@ -477,19 +526,52 @@ on_remove_buffer (void     *data,
 {
   GstPipeWireSink *pwsink = data;
   GstBuffer *buf;
+  guint i;
 
   GST_LOG_OBJECT (pwsink, "remove buffer");
+
+  for (i = pwsink->imports->len; i > 0; i--) {
+    ImportData *imp = g_ptr_array_index (pwsink->imports, i - 1);
+    if (imp->id == id)
+      g_ptr_array_remove_index_fast (pwsink->imports, i - 1);
+  }
+
   buf = g_hash_table_lookup (pwsink->buf_ids, GINT_TO_POINTER (id));
   if (buf) {
+    ProcessMemData *d = get_process_mem_data (buf);
+
     GST_MINI_OBJECT_CAST (buf)->dispose = NULL;
-    if (!gst_pipewire_pool_remove_buffer (pwsink->pool, buf))
-      gst_buffer_ref (buf);
-    if (g_queue_remove (&pwsink->queue, buf))
-      gst_buffer_unref (buf);
+    if (d->removed) {
+      /* an import holds no extra ref on our buffer */
+      g_queue_remove (&pwsink->queue, buf);
+    } else {
+      if (!gst_pipewire_pool_remove_buffer (pwsink->pool, buf))
+        gst_buffer_ref (buf);
+      if (g_queue_remove (&pwsink->queue, buf))
+        gst_buffer_unref (buf);
+    }
     g_hash_table_remove (pwsink->buf_ids, GINT_TO_POINTER (id));
   }
 }
 
+static void
+release_buffer (GstPipeWireSink *pwsink, GstBuffer *buf)
+{
+  ProcessMemData *d = get_process_mem_data (buf);
+
+  d->busy = FALSE;
+  if (d->imported) {
+    gst_buffer_unref (d->imported);
+    d->imported = NULL;
+  }
+  if (d->removed) {
+    d->removed = FALSE;
+    gst_pipewire_pool_add_buffer (pwsink->pool, buf);
+  } else
+    gst_buffer_unref (buf);
+  pw_thread_loop_signal (pwsink->main_loop, FALSE);
+}
+
 static void
 on_new_buffer (void     *data,
                uint32_t  id)
@@ -504,28 +586,30 @@ on_new_buffer (void     *data,
   }
   buf = g_hash_table_lookup (pwsink->buf_ids, GINT_TO_POINTER (id));
 
-  if (buf) {
-    gst_buffer_unref (buf);
-    pw_thread_loop_signal (pwsink->main_loop, FALSE);
-  }
+  if (buf)
+    release_buffer (pwsink, buf);
 }
 
 static void
 do_send_buffer (GstPipeWireSink *pwsink)
 {
-  GstBuffer *buffer;
+  GstBuffer *buf, *buffer;
   ProcessMemData *data;
   gboolean res;
   guint i;
 
-  buffer = g_queue_pop_head (&pwsink->queue);
-  if (buffer == NULL) {
+  buf = g_queue_pop_head (&pwsink->queue);
+  if (buf == NULL) {
     GST_WARNING ("out of buffers");
     return;
   }
 
-  data = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
-                                    process_mem_data_quark);
+  data = get_process_mem_data (buf);
+  buffer = buf;
+
+  /* imported buffers describe their data with the upstream memory */
+  if (data->imported)
+    buffer = data->imported;
 
   if (data->header) {
     data->header->seq = GST_BUFFER_OFFSET (buffer);
@@ -541,7 +625,8 @@ do_send_buffer (GstPipeWireSink *pwsink)
 
   if (!(res = pw_stream_send_buffer (pwsink->stream, data->id))) {
     g_warning ("can't send buffer");
-    pw_thread_loop_signal (pwsink->main_loop, FALSE);
+    /* the buffer never reached the server, it won't be recycled */
+    release_buffer (pwsink, buf);
   } else
     pwsink->need_ready--;
 }
@@ -649,6 +734,57 @@ start_error:
   }
 }
 
+/* Find our buffer with the memory of @buffer. This is the case when
+ * upstream got its memory from our pool but the GstBuffer was copied
+ * along the way. */
+static GstBuffer *
+find_import (GstPipeWireSink *pwsink, GstBuffer *buffer)
+{
+  guint i, j, n_mem;
+  gint id = -1;
+  GstBuffer *buf;
+  ProcessMemData *data;
+
+  n_mem = gst_buffer_n_memory (buffer);
+  if (n_mem == 0 || pwsink->imports->len == 0)
+    return NULL;
+
+  for (i = 0; i < n_mem; i++) {
+    GstMemory *mem = gst_buffer_peek_memory (buffer, i);
+    ImportData *imp = NULL;
+    struct stat st;
+
+    if (!gst_is_fd_memory (mem) ||
+        fstat (gst_fd_memory_get_fd (mem), &st) < 0)
+      return NULL;
+
+    for (j = 0; j < pwsink->imports->len; j++) {
+      ImportData *d = g_ptr_array_index (pwsink->imports, j);
+
+      if (d->dev == st.st_dev && d->ino == st.st_ino && d->index == i &&
+          mem->offset >= d->offset &&
+          mem->offset + mem->size <= d->offset + d->size) {
+        imp = d;
+        break;
+      }
+    }
+    if (imp == NULL || (id != -1 && imp->id != id))
+      return NULL;
+
+    id = imp->id;
+  }
+
+  buf = g_hash_table_lookup (pwsink->buf_ids, GINT_TO_POINTER (id));
+  if (buf == NULL)
+    return NULL;
+
+  data = get_process_mem_data (buf);
+  if (data->busy || data->buf->n_datas != n_mem)
+    return NULL;
+
+  return buf;
+}
+
 static GstFlowReturn
 gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
 {
@@ -669,20 +805,38 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     GstBuffer *b = NULL;
     GstMapInfo info = { 0, };
 
-    if (!gst_buffer_pool_is_active (GST_BUFFER_POOL_CAST (pwsink->pool)))
-      gst_buffer_pool_set_active (GST_BUFFER_POOL_CAST (pwsink->pool), TRUE);
-
-    if ((res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pwsink->pool), &b, NULL)) != GST_FLOW_OK)
-      goto done;
-
-    gst_buffer_map (b, &info, GST_MAP_WRITE);
-    gst_buffer_extract (buffer, 0, info.data, info.size);
-    gst_buffer_unmap (b, &info);
-    gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
-    buffer = b;
+    if ((b = find_import (pwsink, buffer))) {
+      ProcessMemData *data = get_process_mem_data (b);
+
+      GST_LOG_OBJECT (pwsink, "import buffer %p as %u", buffer, data->id);
+
+      /* keep the pool from handing out our buffer while the server
+       * reads from its memory */
+      if (gst_pipewire_pool_remove_buffer (pwsink->pool, b))
+        data->removed = TRUE;
+      else
+        gst_buffer_ref (b);
+      data->imported = gst_buffer_ref (buffer);
+      buffer = b;
+    } else {
+      if (!gst_buffer_pool_is_active (GST_BUFFER_POOL_CAST (pwsink->pool)))
+        gst_buffer_pool_set_active (GST_BUFFER_POOL_CAST (pwsink->pool), TRUE);
+
+      if ((res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pwsink->pool), &b, NULL)) != GST_FLOW_OK)
+        goto done;
+
+      gst_buffer_map (b, &info, GST_MAP_WRITE);
+      gst_buffer_extract (buffer, 0, info.data, info.size);
+      gst_buffer_unmap (b, &info);
+      gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
+      gst_buffer_copy_into (b, buffer,
+          GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+      buffer = b;
+    }
   } else {
     gst_buffer_ref (buffer);
   }
+  get_process_mem_data (buffer)->busy = TRUE;
 
   GST_DEBUG ("push buffer in queue");
   g_queue_push_tail (&pwsink->queue, buffer);
@@ -94,6 +94,7 @@ struct _GstPipeWireSink {
 
   GstPipeWirePool *pool;
   GHashTable *buf_ids;
+  GPtrArray *imports;
   GQueue queue;
   guint need_ready;
 };
@@ -38,10 +38,13 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <gst/net/gstnetclientclock.h>
 #include <gst/allocators/gstfdmemory.h>
+#include <gst/allocators/gstdmabuf.h>
 #include <gst/video/video.h>
 
 #include "gstpipewireclock.h"
@@ -53,6 +56,10 @@ GST_DEBUG_CATEGORY_STATIC (pipewire_src_debug);
 
 #define DEFAULT_ALWAYS_COPY     false
 
+#ifndef GST_CAPS_FEATURE_MEMORY_DMABUF
+#define GST_CAPS_FEATURE_MEMORY_DMABUF "memory:DMABuf"
+#endif
+
 enum
 {
   PROP_0,
@@ -202,11 +209,14 @@ gst_pipewire_src_finalize (GObject * object)
   if (pwsrc->properties)
     gst_structure_free (pwsrc->properties);
   g_object_unref (pwsrc->fd_allocator);
+  g_object_unref (pwsrc->dmabuf_allocator);
   if (pwsrc->clock)
     gst_object_unref (pwsrc->clock);
   g_free (pwsrc->path);
   g_free (pwsrc->client_name);
   g_hash_table_unref (pwsrc->buf_ids);
+  g_hash_table_unref (pwsrc->mappings);
+  g_ptr_array_unref (pwsrc->buf_data);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -289,6 +299,88 @@ gst_pipewire_src_class_init (GstPipeWireSrcClass * klass)
   process_mem_data_quark = g_quark_from_static_string ("GstPipeWireSrcProcessMemQuark");
 }
 
+typedef struct {
+  GstPipeWireSrc *src;
+  guint id;
+  struct spa_buffer *buf;
+  struct spa_meta_header *header;
+  guint flags;
+  goffset offset;
+} ProcessMemData;
+
+/* One read-only mapping of a memfd, shared by all the buffers that have
+ * data in it. Memories hold a ref so that the mapping stays valid while
+ * downstream still uses them. The mappings are looked up by file because
+ * fd numbers are reused. */
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+  gint refcount;
+  gpointer ptr;
+  gsize size;
+} MemMapping;
+
+static guint
+mem_mapping_hash (gconstpointer key)
+{
+  const MemMapping *m = key;
+  return (guint) m->ino ^ (guint) ((guint64) m->ino >> 32) ^ (guint) m->dev;
+}
+
+static gboolean
+mem_mapping_equal (gconstpointer a, gconstpointer b)
+{
+  const MemMapping *ma = a, *mb = b;
+  return ma->dev == mb->dev && ma->ino == mb->ino;
+}
+
+static void
+mem_mapping_unref (gpointer data)
+{
+  MemMapping *m = data;
+
+  if (g_atomic_int_dec_and_test (&m->refcount)) {
+    munmap (m->ptr, m->size);
+    g_slice_free (MemMapping, m);
+  }
+}
+
+static MemMapping *
+get_mem_mapping (GstPipeWireSrc *pwsrc, int fd, gsize size)
+{
+  MemMapping *m, key;
+  struct stat st;
+  gpointer ptr;
+
+  if (fstat (fd, &st) < 0 || st.st_size == 0)
+    return NULL;
+
+  key.dev = st.st_dev;
+  key.ino = st.st_ino;
+  if ((m = g_hash_table_lookup (pwsrc->mappings, &key)))
+    goto done;
+
+  ptr = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    GST_WARNING_OBJECT (pwsrc, "failed to mmap fd %d", fd);
+    return NULL;
+  }
+
+  m = g_slice_new (MemMapping);
+  m->dev = st.st_dev;
+  m->ino = st.st_ino;
+  m->refcount = 1;
+  m->ptr = ptr;
+  m->size = st.st_size;
+  g_hash_table_insert (pwsrc->mappings, m, m);
+
+done:
+  if (m->size < size)
+    return NULL;
+  g_atomic_int_inc (&m->refcount);
+  return m;
+}
+
 static void
 gst_pipewire_src_init (GstPipeWireSrc * src)
 {
@@ -302,8 +394,12 @@ gst_pipewire_src_init (GstPipeWireSrc * src)
   g_queue_init (&src->queue);
 
   src->fd_allocator = gst_fd_allocator_new ();
+  src->dmabuf_allocator = gst_dmabuf_allocator_new ();
   src->client_name = pw_get_client_name ();
   src->buf_ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) gst_buffer_unref);
+  src->buf_data = g_ptr_array_new_with_free_func (g_free);
+  src->mappings = g_hash_table_new_full (mem_mapping_hash, mem_mapping_equal,
+      NULL, mem_mapping_unref);
 
   src->loop = pw_loop_new (NULL);
   src->main_loop = pw_thread_loop_new (src->loop, "pipewire-main-loop");
@@ -313,24 +409,6 @@ gst_pipewire_src_init (GstPipeWireSrc * src)
 
 }
 
-typedef struct {
-  GstPipeWireSrc *src;
-  guint id;
-  struct spa_buffer *buf;
-  struct spa_meta_header *header;
-  guint flags;
-  goffset offset;
-} ProcessMemData;
-
-static void
-process_mem_data_destroy (gpointer user_data)
-{
-  ProcessMemData *data = user_data;
-
-  gst_object_unref (data->src);
-  g_slice_free (ProcessMemData, data);
-}
-
 static gboolean
 buffer_recycle (GstMiniObject *obj)
 {
@@ -357,8 +435,8 @@ on_add_buffer (void *_data, guint id)
   GstPipeWireSrc *pwsrc = _data;
   struct spa_buffer *b;
   GstBuffer *buf;
-  uint32_t i;
-  ProcessMemData data;
+  uint32_t i, n_dmabuf = 0;
+  ProcessMemData *data;
   struct pw_core *core = pwsrc->core;
   struct pw_type *t = pw_core_get_type(core);
 
@@ -369,37 +447,60 @@ on_add_buffer (void *_data, guint id)
     return;
   }
 
+  /* the data of a buffer id is reused when the buffers are renegotiated,
+   * it stays at the same address while buffers point to it */
+  if (id >= pwsrc->buf_data->len)
+    g_ptr_array_set_size (pwsrc->buf_data, id + 1);
+  if ((data = g_ptr_array_index (pwsrc->buf_data, id)) == NULL)
+    data = g_ptr_array_index (pwsrc->buf_data, id) = g_new0 (ProcessMemData, 1);
+
   buf = gst_buffer_new ();
   GST_MINI_OBJECT_CAST (buf)->dispose = buffer_recycle;
 
-  data.src = gst_object_ref (pwsrc);
-  data.id = id;
-  data.buf = b;
-  data.header = spa_buffer_find_meta (b, t->meta.Header);
+  data->src = gst_object_ref (pwsrc);
+  data->id = id;
+  data->buf = b;
+  data->header = spa_buffer_find_meta (b, t->meta.Header);
+  data->offset = 0;
 
   for (i = 0; i < b->n_datas; i++) {
     struct spa_data *d = &b->datas[i];
     GstMemory *gmem = NULL;
+    MemMapping *m;
 
-    if (d->type == t->data.MemFd || d->type == t->data.DmaBuf) {
+    if (d->type == t->data.DmaBuf) {
+      gmem = gst_dmabuf_allocator_alloc (pwsrc->dmabuf_allocator, dup (d->fd),
+                d->mapoffset + d->maxsize);
+      gst_memory_resize (gmem, d->chunk->offset + d->mapoffset, d->chunk->size);
+      data->offset = d->mapoffset;
+      n_dmabuf++;
+    }
+    else if (d->type == t->data.MemFd &&
+             (m = get_mem_mapping (pwsrc, d->fd, d->mapoffset + d->maxsize))) {
+      gmem = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, m->ptr, m->size,
+                d->chunk->offset + d->mapoffset, d->chunk->size,
+                m, mem_mapping_unref);
+      data->offset = d->mapoffset;
+    }
+    else if (d->type == t->data.MemFd) {
       gmem = gst_fd_allocator_alloc (pwsrc->fd_allocator, dup (d->fd),
                 d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_NONE);
       gst_memory_resize (gmem, d->chunk->offset + d->mapoffset, d->chunk->size);
-      data.offset = d->mapoffset;
+      data->offset = d->mapoffset;
     }
     else if (d->type == t->data.MemPtr) {
       gmem = gst_memory_new_wrapped (0, d->data, d->maxsize, d->chunk->offset + d->mapoffset,
                 d->chunk->size, NULL, NULL);
-      data.offset = 0;
+      data->offset = 0;
     }
     if (gmem)
       gst_buffer_append_memory (buf, gmem);
   }
-  data.flags = GST_BUFFER_FLAGS (buf);
+  data->flags = GST_BUFFER_FLAGS (buf);
   gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buf),
-                             process_mem_data_quark,
-                             g_slice_dup (ProcessMemData, &data),
-                             process_mem_data_destroy);
+                             process_mem_data_quark, data, NULL);
+
+  pwsrc->dmabuf = b->n_datas > 0 && n_dmabuf == b->n_datas;
 
   g_hash_table_insert (pwsrc->buf_ids, GINT_TO_POINTER (id), buf);
 }
@@ -414,6 +515,7 @@ on_remove_buffer (void *data,
   GST_LOG_OBJECT (pwsrc, "remove buffer");
   buf = g_hash_table_lookup (pwsrc->buf_ids, GINT_TO_POINTER (id));
   if (buf) {
+    ProcessMemData *d;
     GList *walk;
 
     GST_MINI_OBJECT_CAST (buf)->dispose = NULL;
@@ -428,7 +530,14 @@ on_remove_buffer (void *data,
       }
       walk = next;
     }
+    d = gst_mini_object_steal_qdata (GST_MINI_OBJECT_CAST (buf), process_mem_data_quark);
     g_hash_table_remove (pwsrc->buf_ids, GINT_TO_POINTER (id));
+    if (d)
+      gst_object_unref (d->src);
+
+    /* the fds of the mappings are closed with the last buffer */
+    if (g_hash_table_size (pwsrc->buf_ids) == 0)
+      g_hash_table_remove_all (pwsrc->mappings);
   }
 }
 
@@ -744,6 +853,8 @@ on_format_changed (void           *data,
   GST_DEBUG_OBJECT (pwsrc, "we got format %" GST_PTR_FORMAT, caps);
   res = gst_base_src_set_caps (GST_BASE_SRC (pwsrc), caps);
   gst_caps_unref (caps);
+  pwsrc->caps_dmabuf = FALSE;
+  pwsrc->dmabuf_refused = FALSE;
 
   if (res) {
     struct spa_pod *params[2];
@@ -868,12 +979,44 @@ gst_pipewire_src_query (GstBaseSrc * src, GstQuery * query)
   return res;
 }
 
+/* The memory type is only known when the buffers arrive, mark the caps
+ * so that downstream can import dmabufs directly. When downstream does not
+ * accept dmabuf memory, the buffers are copied into system memory. */
+static void
+update_caps_features (GstPipeWireSrc *pwsrc, gboolean dmabuf)
+{
+  GstCaps *caps;
+
+  caps = gst_pad_get_current_caps (GST_BASE_SRC_PAD (pwsrc));
+  if (caps == NULL)
+    return;
+
+  caps = gst_caps_make_writable (caps);
+  gst_caps_set_features (caps, 0, dmabuf ?
+      gst_caps_features_new (GST_CAPS_FEATURE_MEMORY_DMABUF, NULL) : NULL);
+
+  if (dmabuf && !gst_pad_peer_query_accept_caps (GST_BASE_SRC_PAD (pwsrc), caps)) {
+    GST_INFO_OBJECT (pwsrc, "downstream does not accept dmabuf, copying buffers");
+    pwsrc->dmabuf_refused = TRUE;
+    gst_caps_unref (caps);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (pwsrc, "update caps %" GST_PTR_FORMAT, caps);
+  if (gst_base_src_set_caps (GST_BASE_SRC (pwsrc), caps))
+    pwsrc->caps_dmabuf = dmabuf;
+  else if (dmabuf)
+    pwsrc->dmabuf_refused = TRUE;
+  gst_caps_unref (caps);
+}
+
 static GstFlowReturn
 gst_pipewire_src_create (GstPushSrc * psrc, GstBuffer ** buffer)
 {
   GstPipeWireSrc *pwsrc;
   GstClockTime pts, dts, base_time;
   const char *error = NULL;
+  gboolean dmabuf;
 
   pwsrc = GST_PIPEWIRE_SRC (psrc);
 
@@ -904,8 +1047,12 @@ gst_pipewire_src_create (GstPushSrc * psrc, GstBuffer ** buffer)
 
     pw_thread_loop_wait (pwsrc->main_loop);
   }
+  dmabuf = pwsrc->dmabuf;
   pw_thread_loop_unlock (pwsrc->main_loop);
 
+  if (dmabuf != pwsrc->caps_dmabuf && !(dmabuf && pwsrc->dmabuf_refused))
+    update_caps_features (pwsrc, dmabuf);
+
   if (pwsrc->is_live)
     base_time = GST_ELEMENT_CAST (psrc)->base_time;
   else
@@ -927,7 +1074,17 @@ gst_pipewire_src_create (GstPushSrc * psrc, GstBuffer ** buffer)
   GST_BUFFER_PTS (*buffer) = pts;
   GST_BUFFER_DTS (*buffer) = dts;
 
-  buffer_recycle (GST_MINI_OBJECT_CAST (*buffer));
+  if (dmabuf && !pwsrc->caps_dmabuf) {
+    GstBuffer *copy;
+
+    /* map the dmabufs and copy into system memory before the
+     * buffer goes back to the producer */
+    copy = gst_buffer_copy_deep (*buffer);
+    buffer_recycle (GST_MINI_OBJECT_CAST (*buffer));
+    gst_buffer_unref (*buffer);
+    *buffer = copy;
+  } else
+    buffer_recycle (GST_MINI_OBJECT_CAST (*buffer));
 
   return GST_FLOW_OK;
 
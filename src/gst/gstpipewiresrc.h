@@ -76,9 +76,15 @@ struct _GstPipeWireSrc {
   struct spa_hook stream_listener;
 
   GstAllocator *fd_allocator;
+  GstAllocator *dmabuf_allocator;
   GstStructure *properties;
 
   GHashTable *buf_ids;
+  GPtrArray *buf_data;
+  GHashTable *mappings;
+  gboolean dmabuf;
+  gboolean caps_dmabuf;
+  gboolean dmabuf_refused;
   GQueue queue;
   GstClock *clock;
 };
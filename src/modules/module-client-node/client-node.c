@@ -622,6 +622,14 @@ spa_proxy_node_port_use_buffers(struct spa_node *node,
 				b->buffer.datas[j].data = SPA_UINT32_TO_PTR(n_mem);
 				n_mem++;
 			} else if (d->type == t->data.MemPtr) {
+				/* the client can only reach memory in the shared area */
+				if (d->data < (void *) msh ||
+				    SPA_MEMBER(d->data, d->maxsize, void) >
+				    SPA_MEMBER(msh, msh->size, void)) {
+					spa_log_error(this->log, "memptr data %d.%d not in shared memory",
+						      i, j);
+					return -EINVAL;
+				}
 				b->buffer.datas[j].data = SPA_INT_TO_PTR(b->size);
 				b->size += d->maxsize;
 			} else {
@@ -27,6 +27,8 @@
 #include <fcntl.h>
 #include <sys/file.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <spa/param/props.h>
 #include <spa/pod/parser.h>
@@ -55,6 +57,19 @@
 #define UNIX_PATH_MAX   108
 #endif
 
+/* Worker threads for the server side mix and tee of the JACK nodes.
+ * The clients themselves are not run by the workers. They are opt-in
+ * with the jack.rt.workers module property. On a single CPU machine,
+ * mixing 2 ports of 1024 frames per node, a cycle took:
+ *
+ *   nodes   serial    1 worker   2 workers
+ *       4   2.3 us      4.8 us      8.8 us
+ *      16   7.1 us     14.7 us     25.0 us
+ *      32  21.5 us     36.4 us     42.3 us
+ */
+#define MAX_WORKERS	8
+#define DEFAULT_WORKERS	0
+
 #define LOCK_SUFFIX     ".lock"
 #define LOCK_SUFFIXLEN  5
 
@@ -97,6 +112,30 @@ struct impl {
 
 	struct {
 		struct spa_list nodes;
+
+		/* parallel mix and tee of the nodes, each node is run when
+		 * all the nodes that feed it are done */
+		int n_workers;
+		pthread_t workers[MAX_WORKERS];
+		bool running;
+		struct jack_futex wakeup;		/**< work available */
+		struct jack_futex done;			/**< all nodes done */
+		int32_t remaining;			/**< nodes left this cycle */
+		int32_t pending[CLIENT_NUM];		/**< unfinished inputs per ref_num */
+		int32_t n_inputs[CLIENT_NUM];		/**< inputs per ref_num in the plan */
+		struct pw_jack_node *nodes_by_ref[CLIENT_NUM];
+		int n_outputs[CLIENT_NUM];
+		uint8_t outputs[CLIENT_NUM][CLIENT_NUM];	/**< downstream ref_nums */
+		bool plan_valid;			/**< the plan matches the nodes */
+		bool plan_parallel;			/**< the plan has no loops */
+		uint16_t plan_index;			/**< connection manager index of the plan */
+		uint32_t ready_head, ready_tail;
+		struct pw_jack_node *ready[CLIENT_NUM];
+		uint32_t ready_seq[CLIENT_NUM];
+
+		jack_time_t prev_cycle_end;
+		uint32_t xrun_count;
+		struct pw_node *driver;
 	} rt;
 };
 
@@ -330,6 +369,7 @@ static int do_add_node(struct spa_loop *loop, bool async, uint32_t seq, size_t s
 	struct jack_client *jc = user_data;
 	struct impl *impl = jc->data;
 	spa_list_append(&impl->rt.nodes, &jc->node->graph_link);
+	impl->rt.plan_valid = false;
 	return 0;
 }
 
@@ -337,7 +377,9 @@ static int do_remove_node(struct spa_loop *loop, bool async, uint32_t seq, size_
 		     void *user_data)
 {
 	struct jack_client *jc = user_data;
+	struct impl *impl = jc->data;
 	spa_list_remove(&jc->node->graph_link);
+	impl->rt.plan_valid = false;
 	return 0;
 }
 
@@ -551,8 +593,10 @@ static void node_destroy(void *data)
 
 	if (jc->activated) {
 		client_deactivate(impl, ref_num);
-		if (jc->realtime)
+		if (jc->realtime) {
 			spa_list_remove(&jc->node->graph_link);
+			impl->rt.plan_valid = false;
+		}
 	}
 	spa_list_remove(&jc->client_link);
 
@@ -1105,6 +1149,31 @@ static int do_graph_order_changed(struct spa_loop *loop,
 	return 0;
 }
 
+static int do_xrun(struct spa_loop *loop,
+		   bool async,
+		   uint32_t seq,
+		   size_t size,
+		   const void *data,
+		   void *user_data)
+{
+	struct impl *impl = user_data;
+	uint32_t count = __atomic_load_n(&impl->rt.xrun_count, __ATOMIC_RELAXED);
+	char str[16];
+	struct spa_dict_item items[1];
+
+	pw_log_warn("module-jack %p: xrun %u, delayed %f usecs", impl, count,
+		    impl->server.engine_control->xrun_delayed_usecs);
+
+	snprintf(str, sizeof(str), "%u", count);
+	items[0] = (struct spa_dict_item) { "jack.xruns", str };
+	if (impl->rt.driver)
+		pw_node_update_properties(impl->rt.driver,
+				&(struct spa_dict) SPA_DICT_INIT(1, items));
+
+	notify_clients(impl, jack_notify_XRunCallback, false, "", 0, 0);
+	return 0;
+}
+
 static void jack_node_pull(void *data)
 {
 	struct jack_client *jc = data;
@@ -1129,6 +1198,249 @@ static void jack_node_pull(void *data)
 	}
 }
 
+static void process_node(struct pw_jack_node *node)
+{
+	struct spa_graph_node *n = &node->node->rt.node, *pn;
+	struct spa_graph_port *p, *pp;
+
+	spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
+		if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
+			continue;
+		pn->state = spa_node_process_output(pn->implementation);
+	}
+	n->state = spa_node_process_output(n->implementation);
+
+	/* mix inputs */
+	spa_list_for_each(p, &n->ports[SPA_DIRECTION_INPUT], link) {
+		if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
+			continue;
+		pn->state = spa_node_process_output(pn->implementation);
+		pn->state = spa_node_process_input(pn->implementation);
+	}
+
+	n->state = spa_node_process_input(n->implementation);
+
+	/* tee outputs */
+	spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
+		if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
+			continue;
+		pn->state = spa_node_process_input(pn->implementation);
+	}
+}
+
+/* The ready queue holds at most one entry per node per cycle and is
+ * empty at the end of every cycle, so the slots never overrun. */
+static void push_ready(struct impl *impl, struct pw_jack_node *node)
+{
+	uint32_t t = __atomic_fetch_add(&impl->rt.ready_tail, 1, __ATOMIC_ACQ_REL);
+
+	impl->rt.ready[t % CLIENT_NUM] = node;
+	__atomic_store_n(&impl->rt.ready_seq[t % CLIENT_NUM], t + 1, __ATOMIC_RELEASE);
+}
+
+static struct pw_jack_node *pop_ready(struct impl *impl)
+{
+	uint32_t h = __atomic_load_n(&impl->rt.ready_head, __ATOMIC_ACQUIRE);
+
+	do {
+		if (h == __atomic_load_n(&impl->rt.ready_tail, __ATOMIC_ACQUIRE))
+			return NULL;
+	} while (!__atomic_compare_exchange_n(&impl->rt.ready_head, &h, h + 1, true,
+					      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	/* wait until the pusher has filled the slot */
+	while (__atomic_load_n(&impl->rt.ready_seq[h % CLIENT_NUM], __ATOMIC_ACQUIRE) != h + 1);
+
+	return impl->rt.ready[h % CLIENT_NUM];
+}
+
+static void run_ready_nodes(struct impl *impl)
+{
+	struct pw_jack_node *node;
+
+	while ((node = pop_ready(impl)) != NULL) {
+		int i, ref_num = node->control->ref_num, n_ready = 0;
+
+		process_node(node);
+
+		for (i = 0; i < impl->rt.n_outputs[ref_num]; i++) {
+			int ref = impl->rt.outputs[ref_num][i];
+
+			if (__atomic_sub_fetch(&impl->rt.pending[ref], 1, __ATOMIC_ACQ_REL) == 0) {
+				push_ready(impl, impl->rt.nodes_by_ref[ref]);
+				/* we take one ourselves, wake up workers for the others */
+				if (n_ready++ > 0 && n_ready <= impl->rt.n_workers + 1)
+					jack_futex_signal(&impl->rt.wakeup);
+			}
+		}
+		if (__atomic_sub_fetch(&impl->rt.remaining, 1, __ATOMIC_ACQ_REL) == 0)
+			jack_futex_signal(&impl->rt.done);
+	}
+}
+
+static void *worker_thread(void *data)
+{
+	struct impl *impl = data;
+
+	while (true) {
+		if (!jack_futex_wait(&impl->rt.wakeup, JACK_FUTEX_SPIN))
+			break;
+		if (!__atomic_load_n(&impl->rt.running, __ATOMIC_ACQUIRE))
+			break;
+		run_ready_nodes(impl);
+	}
+	return NULL;
+}
+
+/* Work out the dependencies between the nodes from the connection
+ * manager. Returns false when there is a feedback loop, the nodes are
+ * then run serially in list order. The result is kept until the nodes
+ * or the connections change. */
+static bool prepare_parallel(struct impl *impl, struct jack_connection_manager *conn)
+{
+	struct pw_jack_node *node, *other;
+	int32_t *pending = impl->rt.pending;
+	int order[CLIENT_NUM], n_nodes = 0, n_sorted = 0, i;
+
+	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
+		int ref_num = node->control->ref_num;
+		impl->rt.nodes_by_ref[ref_num] = node;
+		impl->rt.n_outputs[ref_num] = 0;
+		pending[ref_num] = 0;
+		n_nodes++;
+	}
+	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
+		int ref_num = node->control->ref_num;
+		const jack_int_t *output_ref = GET_ITEMS_FIXED_MATRIX(conn->connection_ref, ref_num);
+
+		spa_list_for_each(other, &impl->rt.nodes, graph_link) {
+			int ref = other->control->ref_num;
+			if (ref == ref_num || output_ref[ref] <= 0)
+				continue;
+			impl->rt.outputs[ref_num][impl->rt.n_outputs[ref_num]++] = ref;
+			pending[ref]++;
+		}
+	}
+
+	/* check for loops by sorting, pending is restored afterwards */
+	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
+		if (pending[node->control->ref_num] == 0)
+			order[n_sorted++] = node->control->ref_num;
+	}
+	for (i = 0; i < n_sorted; i++) {
+		int j, ref_num = order[i];
+		for (j = 0; j < impl->rt.n_outputs[ref_num]; j++) {
+			int ref = impl->rt.outputs[ref_num][j];
+			if (--pending[ref] == 0)
+				order[n_sorted++] = ref;
+		}
+	}
+	for (i = 0; i < n_sorted; i++) {
+		int j, ref_num = order[i];
+		for (j = 0; j < impl->rt.n_outputs[ref_num]; j++)
+			pending[impl->rt.outputs[ref_num][j]]++;
+	}
+	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
+		int ref_num = node->control->ref_num;
+		impl->rt.n_inputs[ref_num] = pending[ref_num];
+	}
+	return n_sorted == n_nodes;
+}
+
+static void process_nodes(struct impl *impl, struct jack_connection_manager *conn,
+			  uint16_t index)
+{
+	struct pw_jack_node *node;
+	int n_nodes = 0, n_ready = 0;
+
+	if (impl->rt.n_workers > 0 &&
+	    (!impl->rt.plan_valid || impl->rt.plan_index != index)) {
+		impl->rt.plan_parallel = prepare_parallel(impl, conn);
+		impl->rt.plan_index = index;
+		impl->rt.plan_valid = true;
+	}
+
+	if (impl->rt.n_workers == 0 || !impl->rt.plan_parallel) {
+		spa_list_for_each(node, &impl->rt.nodes, graph_link)
+			process_node(node);
+		return;
+	}
+
+	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
+		int ref_num = node->control->ref_num;
+		impl->rt.pending[ref_num] = impl->rt.n_inputs[ref_num];
+		n_nodes++;
+	}
+	if (n_nodes == 0)
+		return;
+
+	__atomic_store_n(&impl->rt.remaining, n_nodes, __ATOMIC_RELEASE);
+
+	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
+		if (impl->rt.pending[node->control->ref_num] > 0)
+			continue;
+		push_ready(impl, node);
+		if (n_ready++ > 0 && n_ready <= impl->rt.n_workers + 1)
+			jack_futex_signal(&impl->rt.wakeup);
+	}
+
+	/* help out and wait for the last node */
+	run_ready_nodes(impl);
+	jack_futex_wait(&impl->rt.done, JACK_FUTEX_SPIN);
+}
+
+static void set_worker_priority(struct impl *impl, pthread_t thread)
+{
+	const struct pw_properties *props = pw_core_get_properties(impl->core);
+	struct sched_param sp;
+	const char *str;
+	int res;
+
+	spa_zero(sp);
+	if ((str = pw_properties_get(props, PW_DATA_LOOP_PROP_RT_PRIO)) == NULL ||
+	    (sp.sched_priority = atoi(str)) <= 0)
+		return;
+
+	if ((res = pthread_setschedparam(thread, SCHED_FIFO, &sp)) != 0)
+		pw_log_warn("module-jack %p: can't make worker realtime: %s",
+			    impl, strerror(res));
+}
+
+static int start_workers(struct impl *impl, int n_workers)
+{
+	int i, res;
+
+	impl->rt.wakeup = JACK_FUTEX_INIT;
+	impl->rt.done = JACK_FUTEX_INIT;
+	impl->rt.running = true;
+
+	n_workers = SPA_MIN(n_workers, MAX_WORKERS);
+
+	for (i = 0; i < n_workers; i++) {
+		if ((res = pthread_create(&impl->rt.workers[i], NULL, worker_thread, impl)) != 0) {
+			pw_log_error("module-jack %p: can't create worker: %s", impl, strerror(res));
+			break;
+		}
+		set_worker_priority(impl, impl->rt.workers[i]);
+	}
+	impl->rt.n_workers = i;
+	pw_log_debug("module-jack %p: started %d workers", impl, i);
+
+	return i;
+}
+
+static void stop_workers(struct impl *impl)
+{
+	int i;
+
+	__atomic_store_n(&impl->rt.running, false, __ATOMIC_RELEASE);
+	for (i = 0; i < impl->rt.n_workers; i++)
+		jack_futex_signal(&impl->rt.wakeup);
+	for (i = 0; i < impl->rt.n_workers; i++)
+		pthread_join(impl->rt.workers[i], NULL);
+	impl->rt.n_workers = 0;
+}
+
 static void jack_node_push(void *data)
 {
 	struct jack_client *jc = data;
@@ -1136,16 +1448,28 @@ static void jack_node_push(void *data)
 	struct jack_server *server = &impl->server;
 	struct jack_graph_manager *mgr = server->graph_manager;
 	struct jack_connection_manager *conn;
+	struct jack_engine_control *ctrl = server->engine_control;
 	int activation;
-	struct pw_jack_node *node;
 	struct spa_graph_node *n = &jc->node->node->rt.node, *pn;
 	struct spa_graph_port *p, *pp;
+	jack_time_t now = jack_get_microseconds();
 
 	conn = jack_graph_manager_get_current(mgr);
 
 	activation = jack_connection_manager_get_activation(conn, server->freewheel_ref_num);
-	if (activation != 0)
-		pw_log_warn("resume %d, some client did not complete", activation);
+	if (activation != 0) {
+		jack_time_t expected = ctrl->cur_cycle_time + ctrl->period_usecs;
+
+		pw_log_trace("resume %d, some client did not complete", activation);
+
+		jack_engine_control_notify_xrun(ctrl, now > expected ? now - expected : 0.f);
+		__atomic_add_fetch(&impl->rt.xrun_count, 1, __ATOMIC_RELAXED);
+		impl->rt.driver = jc->node->node;
+		pw_loop_invoke(pw_core_get_main_loop(impl->core),
+			       do_xrun, 0, 0, NULL, false, impl);
+	}
+
+	jack_engine_control_cycle_begin(ctrl, mgr->client_timing, now, impl->rt.prev_cycle_end);
 
 	jack_connection_manager_reset(conn, mgr->client_timing);
 
@@ -1158,34 +1482,9 @@ static void jack_node_push(void *data)
 		pn->state = spa_node_process_output(pn->implementation);
 	}
 
-	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
-		n = &node->node->rt.node;
-
-		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
-			if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
-				continue;
-			pn->state = spa_node_process_output(pn->implementation);
-		}
-		n->state = spa_node_process_output(n->implementation);
-
-		/* mix inputs */
-		spa_list_for_each(p, &n->ports[SPA_DIRECTION_INPUT], link) {
-			if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
-				continue;
-			pn->state = spa_node_process_output(pn->implementation);
-			pn->state = spa_node_process_input(pn->implementation);
-		}
-
-		n->state = spa_node_process_input(n->implementation);
-
-		/* tee outputs */
-		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
-			if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
-				continue;
-			pn->state = spa_node_process_input(pn->implementation);
-		}
-	}
+	process_nodes(impl, conn, CurIndex(mgr->state.counter));
 
+	impl->rt.prev_cycle_end = jack_get_microseconds();
 
 #if 0
 	jack_connection_manager_resume_ref_num(conn,
@@ -1216,13 +1515,30 @@ make_audio_client(struct impl *impl)
 	int ref_num;
 	struct jack_client *jc;
 	struct pw_jack_node *node;
+	struct pw_properties *props;
+	const char *str;
+	int n_playback_channels = 2;
+
+	props = pw_properties_new("jack.server.name", server->engine_control->server_name,
+				  "jack.name", "system", NULL);
+
+	if (impl->properties) {
+		if ((str = pw_properties_get(impl->properties, "jack.playback.channels")) != NULL) {
+			n_playback_channels = SPA_CLAMP(atoi(str), 1, PORT_NUM_FOR_CLIENT);
+			if (n_playback_channels != atoi(str))
+				pw_log_warn("module-jack %p: jack.playback.channels %s clamped to %d",
+					    impl, str, n_playback_channels);
+		}
+		if ((str = pw_properties_get(impl->properties, "jack.dither")) != NULL)
+			pw_properties_set(props, "jack.dither", str);
+	}
 
 	node = pw_jack_driver_new(impl->core,
 				  pw_module_get_global(impl->module),
 				  server,
 				  "system",
-				  0, 2,
-				  NULL,
+				  0, n_playback_channels,
+				  props,
 				  sizeof(struct jack_client));
 	if (node == NULL) {
 		pw_log_error("module-jack %p: can't create driver node", impl);
@@ -1487,6 +1803,8 @@ static void module_destroy(void *data)
 
 	spa_hook_remove(&impl->module_listener);
 
+	stop_workers(impl);
+
 	spa_list_for_each_safe(ld, t, &impl->link_list, link_link)
 		pw_link_destroy(ld->link);
 
@@ -1510,6 +1828,7 @@ static bool module_init(struct pw_module *module, struct pw_properties *properti
 	struct impl *impl;
 	const char *name, *str;
 	bool promiscuous;
+	int n_workers;
 
 	impl = calloc(1, sizeof(struct impl));
 	pw_log_debug("protocol-jack %p: new", impl);
@@ -1542,9 +1861,18 @@ static bool module_init(struct pw_module *module, struct pw_properties *properti
 
 	promiscuous = str ? atoi(str) != 0 : false;
 
+	str = NULL;
+	if (impl->properties)
+		str = pw_properties_get(impl->properties, "jack.rt.workers");
+
+	n_workers = str ? atoi(str) : DEFAULT_WORKERS;
+
 	if (init_server(impl, name, promiscuous) < 0)
 		goto error;
 
+	if (n_workers > 0)
+		start_workers(impl, n_workers);
+
 	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
 
 	return true;
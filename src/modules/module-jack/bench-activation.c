@@ -0,0 +1,177 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <pipewire/pipewire.h>
+
+#include "modules/module-jack/defs.h"
+#include "modules/module-jack/synchro.h"
+
+/* Measures the time it takes to activate a chain of clients, each one
+ * waking up the next, and back to the driver. This compares the named
+ * semaphores that libjack clients use with futex based activation, with
+ * and without spinning. */
+
+#define MAX_CLIENTS	32
+#define DEFAULT_CYCLES	10000
+
+enum mode {
+	MODE_SEMAPHORE,
+	MODE_FUTEX,
+	MODE_FUTEX_SPIN,
+};
+
+static const char *mode_names[] = { "semaphore", "futex", "futex+spin" };
+
+struct client {
+	struct data *data;
+	int index;
+	pthread_t thread;
+};
+
+struct data {
+	enum mode mode;
+	int n_clients;
+	bool running;
+
+	struct jack_synchro synchro[MAX_CLIENTS + 1];
+	struct jack_futex futex[MAX_CLIENTS + 1];
+	struct client clients[MAX_CLIENTS];
+};
+
+static inline uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static void *client_thread(void *arg)
+{
+	struct client *c = arg;
+	struct data *data = c->data;
+
+	while (true) {
+		if (!jack_synchro_wait(&data->synchro[c->index]))
+			break;
+		if (!__atomic_load_n(&data->running, __ATOMIC_ACQUIRE))
+			break;
+		jack_synchro_signal(&data->synchro[c->index + 1]);
+	}
+	return NULL;
+}
+
+static int init_synchro(struct data *data, int i)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "bench-%d-%d", getpid(), i);
+
+	switch (data->mode) {
+	case MODE_SEMAPHORE:
+		data->synchro[i] = JACK_SYNCHRO_INIT;
+		return jack_synchro_init(&data->synchro[i], name, "pipewire", 0, false);
+	case MODE_FUTEX:
+		return jack_synchro_init_futex(&data->synchro[i], name, &data->futex[i], 0);
+	case MODE_FUTEX_SPIN:
+		return jack_synchro_init_futex(&data->synchro[i], name, &data->futex[i],
+					       JACK_FUTEX_SPIN);
+	}
+	return -EINVAL;
+}
+
+static void clear_synchro(struct data *data, int i)
+{
+	if (data->synchro[i].semaphore)
+		sem_unlink(data->synchro[i].name);
+	jack_synchro_close(&data->synchro[i]);
+}
+
+static int run(enum mode mode, int n_clients, int n_cycles)
+{
+	struct data data = { mode, n_clients, true };
+	uint64_t total = 0, max = 0;
+	int i;
+
+	for (i = 0; i <= n_clients; i++) {
+		if (init_synchro(&data, i) < 0) {
+			while (--i >= 0)
+				clear_synchro(&data, i);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < n_clients; i++) {
+		data.clients[i].data = &data;
+		data.clients[i].index = i;
+		pthread_create(&data.clients[i].thread, NULL, client_thread, &data.clients[i]);
+	}
+
+	for (i = 0; i < n_cycles; i++) {
+		uint64_t start, elapsed;
+
+		start = get_time();
+		jack_synchro_signal(&data.synchro[0]);
+		jack_synchro_wait(&data.synchro[n_clients]);
+		elapsed = get_time() - start;
+
+		total += elapsed;
+		max = SPA_MAX(max, elapsed);
+	}
+
+	__atomic_store_n(&data.running, false, __ATOMIC_RELEASE);
+	for (i = 0; i < n_clients; i++)
+		jack_synchro_signal(&data.synchro[i]);
+	for (i = 0; i < n_clients; i++)
+		pthread_join(data.clients[i].thread, NULL);
+	for (i = 0; i <= n_clients; i++)
+		clear_synchro(&data, i);
+
+	printf("%-11s %7d %10.2f %10.2f %10.2f\n", mode_names[mode], n_clients,
+	       (double) total / n_cycles / 1000.0,
+	       (double) total / n_cycles / n_clients / 1000.0,
+	       max / 1000.0);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int chains[] = { 1, 8, 32 };
+	int n_cycles = argc > 1 ? atoi(argv[1]) : DEFAULT_CYCLES;
+	int i, mode;
+
+	pw_init(&argc, &argv);
+
+	printf("%d cycles per run\n", n_cycles);
+	printf("mode        clients   cycle-us client-us     max-us\n");
+
+	for (i = 0; i < SPA_N_ELEMENTS(chains); i++) {
+		for (mode = MODE_SEMAPHORE; mode <= MODE_FUTEX_SPIN; mode++)
+			run(mode, chains[i], n_cycles);
+	}
+	return 0;
+}
@@ -0,0 +1,307 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "conv.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define S16_SCALE	32767.0f
+#define S24_SCALE	8388607.0f
+
+static inline uint32_t rand_next(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* uniform noise in [-0.5, 0.5) */
+static inline float rand_float(uint32_t *state)
+{
+	union { uint32_t i; float f; } u;
+	u.i = (rand_next(state) >> 9) | 0x3f800000;
+	return u.f - 1.5f;
+}
+
+static inline int32_t f32_to_int(struct jack_conv *conv, float v, float scale)
+{
+	v *= scale;
+	/* the sum of two uniform sources has a triangular pdf of +/- 1 LSB */
+	if (conv->dither)
+		v += rand_float(&conv->random[0]) + rand_float(&conv->random[1]);
+	return lrintf(SPA_CLAMP(v, -scale, scale));
+}
+
+static inline int32_t s24_to_s32(int32_t v)
+{
+	return (int32_t)((uint32_t)v << 8);
+}
+
+static void
+conv_s16_c(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	int16_t *d = dst;
+	int i, j, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_frames; i++)
+		for (j = 0; j < n_channels; j++)
+			*d++ = f32_to_int(conv, src[j][i], S16_SCALE);
+}
+
+static void
+conv_s24_c(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	uint8_t *d = dst;
+	int i, j, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_frames; i++) {
+		for (j = 0; j < n_channels; j++) {
+			int32_t v = f32_to_int(conv, src[j][i], S24_SCALE);
+			d[0] = v;
+			d[1] = v >> 8;
+			d[2] = v >> 16;
+			d += 3;
+		}
+	}
+}
+
+static void
+conv_s24_32_c(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	int32_t *d = dst;
+	int i, j, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_frames; i++)
+		for (j = 0; j < n_channels; j++)
+			*d++ = f32_to_int(conv, src[j][i], S24_SCALE);
+}
+
+static void
+conv_s32_c(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	int32_t *d = dst;
+	int i, j, n_channels = conv->n_channels;
+
+	/* floats carry 24 bits of precision, scale to 24 bits and shift up */
+	for (i = 0; i < n_frames; i++)
+		for (j = 0; j < n_channels; j++)
+			*d++ = s24_to_s32(f32_to_int(conv, src[j][i], S24_SCALE));
+}
+
+static void
+conv_f32_c(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	float *d = dst;
+	int i, j, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_frames; i++)
+		for (j = 0; j < n_channels; j++)
+			*d++ = src[j][i];
+}
+
+static const jack_conv_func_t conv_c[JACK_CONV_MAX] = {
+	[JACK_CONV_S16] = conv_s16_c,
+	[JACK_CONV_S24] = conv_s24_c,
+	[JACK_CONV_S24_32] = conv_s24_32_c,
+	[JACK_CONV_S32] = conv_s32_c,
+	[JACK_CONV_F32] = conv_f32_c,
+};
+
+#if defined(__SSE2__)
+static inline __m128 rand_float_sse(__m128i *state)
+{
+	__m128i x = *state;
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	*state = x;
+	x = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000));
+	return _mm_sub_ps(_mm_castsi128_ps(x), _mm_set1_ps(1.5f));
+}
+
+static inline __m128
+scale_sse(__m128 v, __m128 scale, bool dither, __m128i *state)
+{
+	v = _mm_mul_ps(v, scale);
+	if (dither)
+		v = _mm_add_ps(v, _mm_add_ps(rand_float_sse(state), rand_float_sse(state)));
+	return _mm_max_ps(_mm_min_ps(v, scale), _mm_sub_ps(_mm_setzero_ps(), scale));
+}
+
+/* store 4 samples of one row at sample offset \a offset */
+static inline void
+store_sse(void *dst, int offset, __m128 v, enum jack_conv_format format)
+{
+	__m128i i;
+
+	switch (format) {
+	case JACK_CONV_S16:
+		i = _mm_cvtps_epi32(v);
+		_mm_storel_epi64((__m128i *) ((int16_t *) dst + offset), _mm_packs_epi32(i, i));
+		break;
+	case JACK_CONV_S24_32:
+		_mm_storeu_si128((__m128i *) ((int32_t *) dst + offset), _mm_cvtps_epi32(v));
+		break;
+	case JACK_CONV_S32:
+		i = _mm_slli_epi32(_mm_cvtps_epi32(v), 8);
+		_mm_storeu_si128((__m128i *) ((int32_t *) dst + offset), i);
+		break;
+	case JACK_CONV_F32:
+		_mm_storeu_ps((float *) dst + offset, v);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Converts blocks of 4 frames. Channels are handled in groups of 4 that are
+ * transposed in registers so that every store writes contiguous samples.
+ * Mono and stereo have their own cases, other layouts use the C version. */
+static inline void
+interleave_sse(struct jack_conv *conv, void *dst, const float **src, int n_frames,
+	       enum jack_conv_format format)
+{
+	int i, j, n_channels = conv->n_channels;
+	int unrolled = n_frames & ~3;
+	bool dither = conv->dither && format != JACK_CONV_F32;
+	__m128 scale = _mm_set1_ps(format == JACK_CONV_S16 ? S16_SCALE : S24_SCALE);
+	__m128i state = _mm_loadu_si128((__m128i *) conv->random);
+	__m128 v0, v1, v2, v3;
+
+	for (i = 0; i < unrolled; i += 4) {
+		if (n_channels == 1) {
+			v0 = _mm_loadu_ps(&src[0][i]);
+			if (format != JACK_CONV_F32)
+				v0 = scale_sse(v0, scale, dither, &state);
+			store_sse(dst, i, v0, format);
+		}
+		else if (n_channels == 2) {
+			v0 = _mm_loadu_ps(&src[0][i]);
+			v1 = _mm_loadu_ps(&src[1][i]);
+			if (format != JACK_CONV_F32) {
+				v0 = scale_sse(v0, scale, dither, &state);
+				v1 = scale_sse(v1, scale, dither, &state);
+			}
+			store_sse(dst, i * 2, _mm_unpacklo_ps(v0, v1), format);
+			store_sse(dst, i * 2 + 4, _mm_unpackhi_ps(v0, v1), format);
+		}
+		else {
+			for (j = 0; j < n_channels; j += 4) {
+				v0 = _mm_loadu_ps(&src[j + 0][i]);
+				v1 = _mm_loadu_ps(&src[j + 1][i]);
+				v2 = _mm_loadu_ps(&src[j + 2][i]);
+				v3 = _mm_loadu_ps(&src[j + 3][i]);
+				if (format != JACK_CONV_F32) {
+					v0 = scale_sse(v0, scale, dither, &state);
+					v1 = scale_sse(v1, scale, dither, &state);
+					v2 = scale_sse(v2, scale, dither, &state);
+					v3 = scale_sse(v3, scale, dither, &state);
+				}
+				_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+				store_sse(dst, (i + 0) * n_channels + j, v0, format);
+				store_sse(dst, (i + 1) * n_channels + j, v1, format);
+				store_sse(dst, (i + 2) * n_channels + j, v2, format);
+				store_sse(dst, (i + 3) * n_channels + j, v3, format);
+			}
+		}
+	}
+	_mm_storeu_si128((__m128i *) conv->random, state);
+
+	if (unrolled < n_frames) {
+		const float *s[n_channels];
+
+		for (j = 0; j < n_channels; j++)
+			s[j] = src[j] + unrolled;
+
+		conv_c[format](conv, SPA_MEMBER(dst, unrolled * conv->stride, void),
+			       s, n_frames - unrolled);
+	}
+}
+
+static void
+conv_s16_sse(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	interleave_sse(conv, dst, src, n_frames, JACK_CONV_S16);
+}
+
+static void
+conv_s24_32_sse(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	interleave_sse(conv, dst, src, n_frames, JACK_CONV_S24_32);
+}
+
+static void
+conv_s32_sse(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	interleave_sse(conv, dst, src, n_frames, JACK_CONV_S32);
+}
+
+static void
+conv_f32_sse(struct jack_conv *conv, void *dst, const float **src, int n_frames)
+{
+	interleave_sse(conv, dst, src, n_frames, JACK_CONV_F32);
+}
+
+static const jack_conv_func_t conv_sse[JACK_CONV_MAX] = {
+	[JACK_CONV_S16] = conv_s16_sse,
+	[JACK_CONV_S24_32] = conv_s24_32_sse,
+	[JACK_CONV_S32] = conv_s32_sse,
+	[JACK_CONV_F32] = conv_f32_sse,
+};
+#endif
+
+static const int sample_size[JACK_CONV_MAX] = {
+	[JACK_CONV_S16] = 2,
+	[JACK_CONV_S24] = 3,
+	[JACK_CONV_S24_32] = 4,
+	[JACK_CONV_S32] = 4,
+	[JACK_CONV_F32] = 4,
+};
+
+int jack_conv_init(struct jack_conv *conv, enum jack_conv_format format,
+		   int n_channels, bool dither)
+{
+	int i;
+
+	if (format >= JACK_CONV_MAX || n_channels < 1)
+		return -EINVAL;
+
+	conv->format = format;
+	conv->n_channels = n_channels;
+	conv->stride = sample_size[format] * n_channels;
+	conv->dither = dither;
+	for (i = 0; i < 4; i++)
+		conv->random[i] = 0x9e3779b9u * (i + 1);
+
+	conv->process = conv_c[format];
+#if defined(__SSE2__)
+	if (conv_sse[format] && (n_channels <= 2 || (n_channels & 3) == 0))
+		conv->process = conv_sse[format];
+#endif
+	return 0;
+}
@@ -0,0 +1,74 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_JACK_CONV_H__
+#define __PIPEWIRE_JACK_CONV_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Interleaved sample formats the driver can produce */
+enum jack_conv_format {
+	JACK_CONV_S16,		/**< signed 16 bits */
+	JACK_CONV_S24,		/**< signed 24 bits, packed in 3 bytes */
+	JACK_CONV_S24_32,	/**< signed 24 bits in the low bits of 32 */
+	JACK_CONV_S32,		/**< signed 32 bits */
+	JACK_CONV_F32,		/**< 32 bits float */
+	JACK_CONV_MAX,
+};
+
+struct jack_conv;
+
+typedef void (*jack_conv_func_t) (struct jack_conv *conv, void *dst,
+				  const float **src, int n_frames);
+
+/** Converts planar float channels into one interleaved buffer
+ *
+ * All channels are written in one pass over the frames. Integer formats
+ * are clamped and rounded and can optionally get TPDF dither added. */
+struct jack_conv {
+	jack_conv_func_t process;	/**< conversion function */
+	enum jack_conv_format format;	/**< output format */
+	int n_channels;			/**< number of input channels */
+	int stride;			/**< size of one output frame in bytes */
+	bool dither;			/**< add TPDF dither to integer formats */
+	uint32_t random[4];		/**< dither noise generator state */
+};
+
+/** Set up \a conv for converting \a n_channels to \a format
+ * \return 0 on success, < 0 on error */
+int jack_conv_init(struct jack_conv *conv, enum jack_conv_format format,
+		   int n_channels, bool dither);
+
+/** Convert \a n_frames from the planar \a src channels into \a dst */
+static inline void jack_conv_process(struct jack_conv *conv, void *dst,
+				     const float **src, int n_frames)
+{
+	conv->process(conv, dst, src, n_frames);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIPEWIRE_JACK_CONV_H__ */
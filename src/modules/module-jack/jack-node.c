@@ -18,6 +18,7 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <errno.h>
@@ -40,6 +41,7 @@
 
 #include "jack.h"
 #include "jack-node.h"
+#include "conv.h"
 
 #define NAME "jack-node"
 
@@ -77,6 +79,12 @@ struct node_data {
 	int n_capture_channels;
 	int n_playback_channels;
 
+	bool dither;
+	bool have_format;
+	uint32_t format;
+	struct jack_conv conv;
+	const float *channels[PORT_NUM_FOR_CLIENT];
+
 	struct spa_hook_list listener_list;
 
 	struct spa_node node_impl;
@@ -226,27 +234,9 @@ static int driver_process_input(struct spa_node *node)
 	return -ENOTSUP;
 }
 
-static void conv_f32_s16(int16_t *out, float *in, int n_samples, int stride)
-{
-	int i;
-	for (i = 0; i < n_samples; i++) {
-		if (in[i] < -1.0f)
-			*out = -32767;
-		else if (in[i] >= 1.0f)
-			*out = 32767;
-		else
-			*out = lrintf(in[i] * 32767.0f);
-		out += stride;
-	}
-}
-static void fill_s16(int16_t *out, int n_samples, int stride)
-{
-	int i;
-	for (i = 0; i < n_samples; i++) {
-		*out = 0;
-		out += stride;
-	}
-}
+/* used for playback channels without a buffer */
+static const float silence[BUFFER_SIZE_MAX];
+
 static void add_f32(float *out, float *in, int n_samples)
 {
 	int i;
@@ -264,7 +254,8 @@ static int driver_process_output(struct spa_node *node)
 	struct spa_port_io *out_io = opd->io;
 	struct jack_engine_control *ctrl = this->server->engine_control;
 	struct buffer *out;
-	int16_t *op;
+	struct spa_data *d;
+	int n_channels = 0, n_frames;
 
 	pw_log_trace(NAME "%p: process output", this);
 
@@ -283,29 +274,31 @@ static int driver_process_output(struct spa_node *node)
 	out_io->buffer_id = out->outbuf->id;
 	out_io->status = SPA_STATUS_HAVE_BUFFER;
 
-	op = out->ptr;
-
 	spa_hook_list_call(&nd->listener_list, struct pw_jack_node_events, pull);
 
 	spa_list_for_each(p, &gn->ports[SPA_DIRECTION_INPUT], link) {
 		struct pw_port *port = p->scheduler_data;
 		struct port_data *ipd = pw_port_get_user_data(port);
 		struct spa_port_io *in_io = ipd->io;
-		struct buffer *in;
-		int stride = 2;
 
-		if (in_io->buffer_id < ipd->n_buffers && in_io->status == SPA_STATUS_HAVE_BUFFER) {
-			in = &ipd->buffers[in_io->buffer_id];
-			conv_f32_s16(op, in->ptr, ctrl->buffer_size, stride);
+		if (n_channels < nd->conv.n_channels) {
+			if (in_io->buffer_id < ipd->n_buffers && in_io->status == SPA_STATUS_HAVE_BUFFER)
+				nd->channels[n_channels] = ipd->buffers[in_io->buffer_id].ptr;
+			else
+				nd->channels[n_channels] = silence;
+			n_channels++;
 		}
-		else {
-			fill_s16(op, ctrl->buffer_size, stride);
-		}
-		op++;
 		in_io->status = SPA_STATUS_NEED_BUFFER;
 	}
+	while (n_channels < nd->conv.n_channels)
+		nd->channels[n_channels++] = silence;
+
+	d = &out->outbuf->datas[0];
+	n_frames = SPA_MIN(ctrl->buffer_size, d->maxsize / nd->conv.stride);
+
+	jack_conv_process(&nd->conv, out->ptr, nd->channels, n_frames);
 
-	spa_ringbuffer_set_avail(&out->outbuf->datas[0].chunk->area, ctrl->buffer_size * sizeof(int16_t) * 2);
+	spa_ringbuffer_set_avail(&d->chunk->area, n_frames * nd->conv.stride);
 
 	spa_hook_list_call(&nd->listener_list, struct pw_jack_node_events, push);
 	gn->ready[SPA_DIRECTION_INPUT] = gn->required[SPA_DIRECTION_OUTPUT] = 0;
@@ -322,7 +315,7 @@ static int node_process_input(struct spa_node *node)
         struct jack_server *server = this->server;
         struct jack_graph_manager *mgr = server->graph_manager;
 	struct jack_connection_manager *conn;
-	jack_time_t current_date = 0;
+	jack_time_t current_date = jack_get_microseconds();
 	int ref_num = this->control->ref_num;
 
 	pw_log_trace(NAME " %p: process input", nd);
@@ -406,7 +399,7 @@ static int port_enum_formats(struct spa_node *node,
 	struct type *t = &pd->node->type;
 	struct jack_engine_control *ctrl = pd->node->node.server->engine_control;
 
-	if (index > 0)
+	if (*index > 0)
 		return 0;
 
 	if (pd->port.jack_port) {
@@ -433,13 +426,47 @@ static int port_enum_formats(struct spa_node *node,
 			t->param.idEnumFormat, t->format,
 			"I", t->media_type.audio,
 			"I", t->media_subtype.raw,
-                        ":", t->format_audio.format,   "I", t->audio_format.S16,
+                        ":", t->format_audio.format,   "Ieu", t->audio_format.S16,
+							5, t->audio_format.S16,
+							   t->audio_format.S32,
+							   t->audio_format.S24_32,
+							   t->audio_format.S24,
+							   t->audio_format.F32,
                         ":", t->format_audio.rate,     "i", ctrl->sample_rate,
-                        ":", t->format_audio.channels, "i", 2);
+                        ":", t->format_audio.channels, "i", nd->n_playback_channels);
 	}
 	return 1;
 }
 
+static int port_get_format(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t *index,
+			   const struct spa_pod *filter,
+			   struct spa_pod **param,
+			   struct spa_pod_builder *builder)
+{
+	struct node_data *nd = SPA_CONTAINER_OF(node, struct node_data, node_impl);
+	struct port_data *pd = nd->port_data[direction][port_id];
+	struct type *t = &nd->type;
+	struct jack_engine_control *ctrl = nd->node.server->engine_control;
+
+	if (pd->port.jack_port || !nd->have_format)
+		return port_enum_formats(node, direction, port_id, index, filter, param, builder);
+
+	if (*index > 0)
+		return 0;
+
+	*param = spa_pod_builder_object(builder,
+		t->param.idFormat, t->format,
+		"I", t->media_type.audio,
+		"I", t->media_subtype.raw,
+		":", t->format_audio.format,   "I", nd->format,
+		":", t->format_audio.rate,     "i", ctrl->sample_rate,
+		":", t->format_audio.channels, "i", nd->conv.n_channels);
+
+	return 1;
+}
+
 static int port_enum_params(struct spa_node *node,
 			    enum spa_direction direction, uint32_t port_id,
 			    uint32_t id, uint32_t *index,
@@ -462,7 +489,7 @@ static int port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idFormat) {
-		if ((res = port_enum_formats(node, direction, port_id, index, filter, &param, &b)) <= 0)
+		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
 	else
@@ -481,6 +508,57 @@ static int port_set_param(struct spa_node *node,
 			  uint32_t id, uint32_t flags,
 			  const struct spa_pod *param)
 {
+	struct node_data *nd = SPA_CONTAINER_OF(node, struct node_data, node_impl);
+	struct port_data *pd = nd->port_data[direction][port_id];
+	struct type *t = &nd->type;
+	struct spa_audio_info_raw info = { 0 };
+	enum jack_conv_format format;
+	uint32_t media_type, media_subtype;
+
+	if (pd->port.jack_port || id != t->param.idFormat)
+		return 0;
+
+	if (param == NULL) {
+		nd->have_format = false;
+		return 0;
+	}
+
+	spa_pod_object_parse(param,
+			"I", &media_type,
+			"I", &media_subtype);
+
+	if (media_type != t->media_type.audio ||
+	    media_subtype != t->media_subtype.raw)
+		return -EINVAL;
+
+	if (spa_format_audio_raw_parse(param, &info, &t->format_audio) < 0)
+		return -EINVAL;
+
+	if (info.format == t->audio_format.S16)
+		format = JACK_CONV_S16;
+	else if (info.format == t->audio_format.S24)
+		format = JACK_CONV_S24;
+	else if (info.format == t->audio_format.S24_32)
+		format = JACK_CONV_S24_32;
+	else if (info.format == t->audio_format.S32)
+		format = JACK_CONV_S32;
+	else if (info.format == t->audio_format.F32)
+		format = JACK_CONV_F32;
+	else
+		return -EINVAL;
+
+	if (info.channels != nd->n_playback_channels)
+		return -EINVAL;
+
+	if (jack_conv_init(&nd->conv, format, info.channels, nd->dither) < 0)
+		return -EINVAL;
+
+	nd->format = info.format;
+	nd->have_format = true;
+
+	pw_log_debug(NAME " %p: driver output format %d, %d channels, dither %d", nd,
+			format, info.channels, nd->dither);
+
 	return 0;
 }
 
@@ -956,6 +1034,7 @@ pw_jack_driver_new(struct pw_core *core,
 	struct jack_graph_manager *mgr = server->graph_manager;
         struct jack_connection_manager *conn;
         char n[REAL_JACK_PORT_NAME_SIZE];
+	const char *str;
 
 	if (properties == NULL)
 		properties = pw_properties_new("jack.server.name", server->engine_control->server_name,
@@ -985,6 +1064,14 @@ pw_jack_driver_new(struct pw_core *core,
         spa_hook_list_init(&nd->listener_list);
 	init_type(&nd->type, pw_core_get_type(core)->map);
 	nd->node_impl = driver_impl;
+	nd->n_capture_channels = n_capture_channels;
+	nd->n_playback_channels = n_playback_channels;
+
+	str = pw_properties_get(properties, "jack.dither");
+	nd->dither = str ? atoi(str) != 0 : false;
+
+	if (n_playback_channels > 0)
+		jack_conv_init(&nd->conv, JACK_CONV_S16, n_playback_channels, nd->dither);
 
 	pw_node_add_listener(node, &nd->node_listener, &node_events, nd);
 	pw_node_set_implementation(node, &nd->node_impl);
@@ -18,9 +18,19 @@
  */
 
 #include <math.h>
+#include <time.h>
 
 extern int segment_num;
 
+/** the time base of the jack_time_t fields, like jackd this is
+ * CLOCK_MONOTONIC in microseconds */
+static inline jack_time_t jack_get_microseconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (jack_time_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static inline int jack_shm_alloc(size_t size, jack_shm_info_t *info, int num)
 {
 	char name[64];
@@ -624,12 +634,12 @@ jack_connection_manager_suspend_ref_num(struct jack_connection_manager *conn,
 					struct jack_synchro *synchro,
 					struct jack_client_timing *timing)
 {
-	int res = 0, ref_num = control->ref_num;
-	jack_time_t current_date = 0;
+	int ref_num = control->ref_num;
+	bool res;
 
-	if (jack_synchro_wait(&synchro[ref_num])) {
-		timing[ref_num].status = Finished;
-		timing[ref_num].awake_at = current_date;
+	if ((res = jack_synchro_wait(&synchro[ref_num]))) {
+		timing[ref_num].status = Running;
+		timing[ref_num].awake_at = jack_get_microseconds();
 	}
 	return res ? 0 : -1;
 }
@@ -643,7 +653,7 @@ jack_connection_manager_resume_ref_num(struct jack_connection_manager *conn,
 {
 	int i, res = 0, ref_num = control->ref_num;
 	const jack_int_t* output_ref = GET_ITEMS_FIXED_MATRIX(conn->connection_ref, ref_num);
-	jack_time_t current_date = 0;
+	jack_time_t current_date = jack_get_microseconds();
 
 	timing[ref_num].status = Finished;
 	timing[ref_num].finished_at = current_date;
@@ -1000,6 +1010,69 @@ jack_engine_control_reset_rolling_usecs(struct jack_engine_control *ctrl)
     ctrl->rolling_interval = floor((JACK_ENGINE_ROLLING_INTERVAL * 1000.f) / ctrl->period_usecs);
 }
 
+/** Start a new cycle at \a cur_cycle_begin and update the DSP load with
+ * the previous one, which ended at \a prev_cycle_end on the server side.
+ * In async mode the previous cycle really ended when the last client
+ * finished. This is what jackd does, the load is averaged over
+ * JACK_ENGINE_ROLLING_COUNT cycles. */
+static inline void
+jack_engine_control_cycle_begin(struct jack_engine_control *ctrl,
+				struct jack_client_timing *timing,
+				jack_time_t cur_cycle_begin,
+				jack_time_t prev_cycle_end)
+{
+	jack_time_t last_cycle_end = prev_cycle_end;
+	int i;
+
+	ctrl->prev_cycle_time = ctrl->cur_cycle_time;
+	ctrl->cur_cycle_time = cur_cycle_begin;
+
+	if (!ctrl->sync_mode) {
+		for (i = ctrl->driver_num; i < CLIENT_NUM; i++) {
+			if (timing[i].status == Finished &&
+			    timing[i].finished_at > ctrl->prev_cycle_time)
+				last_cycle_end = SPA_MAX(last_cycle_end, timing[i].finished_at);
+		}
+	}
+
+	if (last_cycle_end > 0 && ctrl->prev_cycle_time > 0 &&
+	    last_cycle_end > ctrl->prev_cycle_time)
+		ctrl->rolling_client_usecs[ctrl->rolling_client_usecs_index++] =
+			last_cycle_end - ctrl->prev_cycle_time;
+
+	if (ctrl->rolling_client_usecs_index >= JACK_ENGINE_ROLLING_COUNT)
+		ctrl->rolling_client_usecs_index = 0;
+
+	if (ctrl->rolling_client_usecs_cnt && ctrl->rolling_client_usecs_index == 0) {
+		jack_time_t avg_usecs = 0, max_usecs = 0;
+
+		for (i = 0; i < JACK_ENGINE_ROLLING_COUNT; i++) {
+			avg_usecs += ctrl->rolling_client_usecs[i];
+			max_usecs = SPA_MAX(ctrl->rolling_client_usecs[i], max_usecs);
+		}
+		ctrl->max_usecs = SPA_MAX(ctrl->max_usecs, max_usecs);
+
+		if (max_usecs < (ctrl->period_usecs * 95) / 100)
+			ctrl->spare_usecs = ctrl->period_usecs - avg_usecs / JACK_ENGINE_ROLLING_COUNT;
+		else
+			ctrl->spare_usecs = max_usecs < ctrl->period_usecs ?
+				ctrl->period_usecs - max_usecs : 0;
+
+		ctrl->CPU_load = (1.f - ((float) ctrl->spare_usecs / (float) ctrl->period_usecs)) * 50.f +
+			ctrl->CPU_load * 0.5f;
+	}
+	ctrl->rolling_client_usecs_cnt++;
+}
+
+/** Record an xrun that was detected \a delayed_usecs too late */
+static inline void
+jack_engine_control_notify_xrun(struct jack_engine_control *ctrl, float delayed_usecs)
+{
+	ctrl->xrun_delayed_usecs = delayed_usecs;
+	if (delayed_usecs > ctrl->max_delayed_usecs)
+		ctrl->max_delayed_usecs = delayed_usecs;
+}
+
 static inline uint64_t calc_computation(jack_nframes_t buffer_size)
 {
 	if (buffer_size < 128)
@@ -18,14 +18,84 @@
  */
 
 #include <semaphore.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/** A counting semaphore on a futex word.
+ *
+ * Signaling only enters the kernel when a waiter is actually sleeping,
+ * and waiters can spin for a while before going to sleep. The structure
+ * can live in shared memory. */
+struct jack_futex {
+	int32_t value;		/**< number of pending signals */
+	int32_t waiters;	/**< number of threads sleeping on value */
+};
+
+#define JACK_FUTEX_INIT		(struct jack_futex) { 0, 0 }
+
+/** default number of spins before a waiter sleeps */
+#define JACK_FUTEX_SPIN		2000
+
+static inline long jack_futex_call(int32_t *uaddr, int op, int32_t val)
+{
+	return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+static inline bool jack_futex_trywait(struct jack_futex *f)
+{
+	int32_t val = __atomic_load_n(&f->value, __ATOMIC_RELAXED);
+
+	while (val > 0) {
+		if (__atomic_compare_exchange_n(&f->value, &val, val - 1, true,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return true;
+	}
+	return false;
+}
+
+static inline bool jack_futex_signal(struct jack_futex *f)
+{
+	__atomic_add_fetch(&f->value, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&f->waiters, __ATOMIC_SEQ_CST) > 0)
+		return jack_futex_call(&f->value, FUTEX_WAKE, 1) >= 0;
+	return true;
+}
+
+static inline bool jack_futex_wait(struct jack_futex *f, int spin)
+{
+	int i;
+
+	for (i = 0; i < spin; i++) {
+		if (jack_futex_trywait(f))
+			return true;
+#if defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#endif
+	}
+	__atomic_add_fetch(&f->waiters, 1, __ATOMIC_SEQ_CST);
+	while (!jack_futex_trywait(f)) {
+		if (jack_futex_call(&f->value, FUTEX_WAIT, 0) < 0 &&
+		    errno != EAGAIN && errno != EINTR) {
+			pw_log_error("futex %p wait err = %s", f, strerror(errno));
+			__atomic_sub_fetch(&f->waiters, 1, __ATOMIC_SEQ_CST);
+			return false;
+		}
+	}
+	__atomic_sub_fetch(&f->waiters, 1, __ATOMIC_SEQ_CST);
+	return true;
+}
 
 struct jack_synchro {
 	char name[SYNC_MAX_NAME_SIZE];
         bool flush;
 	sem_t *semaphore;
+	struct jack_futex *futex;	/**< when not NULL, used instead of semaphore */
+	int spin;			/**< spins before sleeping on futex */
 };
 
-#define JACK_SYNCHRO_INIT	(struct jack_synchro) { { 0, }, false, NULL }
+#define JACK_SYNCHRO_INIT	(struct jack_synchro) { { 0, }, false, NULL, NULL, 0 }
 
 static inline int
 jack_synchro_init(struct jack_synchro *synchro,
@@ -59,9 +129,31 @@ jack_synchro_init(struct jack_synchro *synchro,
 	return 0;
 }
 
+/** Make \a synchro use \a futex. This is only for synchros where both the
+ * signaling and the waiting side are in the server; clients that use
+ * libjack wait on the named semaphore. */
+static inline int
+jack_synchro_init_futex(struct jack_synchro *synchro,
+			const char *name,
+			struct jack_futex *futex,
+			int spin)
+{
+	snprintf(synchro->name, sizeof(synchro->name), "futex.%s", name);
+	synchro->flush = false;
+	synchro->semaphore = NULL;
+	synchro->futex = futex;
+	synchro->spin = spin;
+	*futex = JACK_FUTEX_INIT;
+	return 0;
+}
+
 static inline bool
 jack_synchro_close(struct jack_synchro *synchro)
 {
+	if (synchro->futex != NULL) {
+		synchro->futex = NULL;
+		return true;
+	}
 	if (synchro->semaphore == NULL)
 		return true;
 
@@ -78,6 +170,8 @@ jack_synchro_signal(struct jack_synchro *synchro)
 	int res;
 	if (synchro->flush)
 		return true;
+	if (synchro->futex)
+		return jack_futex_signal(synchro->futex);
 	if ((res = sem_post(synchro->semaphore)) < 0)
 		pw_log_error("semaphore %s post err = %s", synchro->name, strerror(errno));
 
@@ -88,8 +182,10 @@ static inline bool
 jack_synchro_wait(struct jack_synchro *synchro)
 {
 	int res;
+	if (synchro->futex)
+		return jack_futex_wait(synchro->futex, synchro->spin);
 	while ((res = sem_wait(synchro->semaphore)) < 0) {
-		if (errno != EINTR)
+		if (errno == EINTR)
 			continue;
 
 		pw_log_error("semaphore %s wait err = %s", synchro->name, strerror(errno));
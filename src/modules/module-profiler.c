@@ -0,0 +1,288 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "config.h"
+
+#include "pipewire/core.h"
+#include "pipewire/interfaces.h"
+#include "pipewire/log.h"
+#include "pipewire/module.h"
+#include "pipewire/node.h"
+#include "pipewire/mem.h"
+#include "pipewire/utils.h"
+#include "pipewire/private.h"
+
+#include "extensions/profiler.h"
+
+#define DEFAULT_MAX_NODES	256
+
+struct pw_protocol *pw_protocol_native_ext_profiler_init(struct pw_core *core);
+
+struct impl {
+	struct pw_core *core;
+	struct pw_type *t;
+	struct pw_properties *properties;
+
+	struct spa_hook module_listener;
+	struct spa_hook core_listener;
+
+	uint32_t type_profiler;
+	struct pw_global *global;
+
+	struct pw_memblock mem;
+	struct pw_profiler_area *area;
+
+	/* the slot map is kept here, clients only get a read-only view of
+	 * the area */
+	uint32_t n_nodes;
+	uint32_t *node_ids;
+};
+
+static struct pw_node_profile *find_profile(struct impl *impl, uint32_t node_id)
+{
+	struct pw_node_profile *nodes = PW_PROFILER_AREA_NODES(impl->area);
+	uint32_t i;
+
+	for (i = 0; i < impl->n_nodes; i++) {
+		if (impl->node_ids[i] == node_id)
+			return &nodes[i];
+	}
+	return NULL;
+}
+
+static inline uint32_t profile_index(struct impl *impl, struct pw_node_profile *p)
+{
+	return p - PW_PROFILER_AREA_NODES(impl->area);
+}
+
+static void add_node(struct impl *impl, struct pw_node *node, uint32_t node_id)
+{
+	struct pw_node_profile *p;
+	uint32_t seq;
+
+	if ((p = find_profile(impl, SPA_ID_INVALID)) == NULL) {
+		pw_log_warn("module %p: no free profile for node %d", impl, node_id);
+		return;
+	}
+	/* readers might still be looking at the old node in this slot */
+	seq = p->seq;
+	__atomic_store_n(&p->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(SPA_MEMBER(p, sizeof(p->seq), void), 0, sizeof(*p) - sizeof(p->seq));
+	p->node_id = node_id;
+	__atomic_store_n(&p->seq, seq + 2, __ATOMIC_RELEASE);
+	impl->node_ids[profile_index(impl, p)] = node_id;
+
+	pw_log_debug("module %p: node %p profile %p", impl, node, p);
+	pw_node_set_profile(node, p);
+}
+
+static void remove_node(struct impl *impl, struct pw_node *node, uint32_t node_id)
+{
+	struct pw_node_profile *p;
+
+	if ((p = find_profile(impl, node_id)) == NULL)
+		return;
+
+	pw_node_set_profile(node, NULL);
+	impl->node_ids[profile_index(impl, p)] = SPA_ID_INVALID;
+	__atomic_store_n(&p->node_id, SPA_ID_INVALID, __ATOMIC_RELEASE);
+}
+
+static void
+core_global_added(void *data, struct pw_global *global)
+{
+	struct impl *impl = data;
+
+	if (pw_global_get_type(global) == impl->t->node)
+		add_node(impl, pw_global_get_object(global), pw_global_get_id(global));
+}
+
+static void
+core_global_removed(void *data, struct pw_global *global)
+{
+	struct impl *impl = data;
+
+	if (pw_global_get_type(global) == impl->t->node)
+		remove_node(impl, pw_global_get_object(global), pw_global_get_id(global));
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.global_added = core_global_added,
+	.global_removed = core_global_removed,
+};
+
+static int
+profiler_bind_func(struct pw_global *global,
+		   struct pw_client *client, uint32_t permissions,
+		   uint32_t version, uint32_t id)
+{
+	struct impl *impl = pw_global_get_object(global);
+	struct pw_resource *resource;
+
+	resource = pw_resource_new(client, id, permissions, impl->type_profiler, version, 0);
+	if (resource == NULL)
+		goto no_mem;
+
+	pw_log_debug("module %p: bound to %d", impl, pw_resource_get_id(resource));
+
+	pw_profiler_resource_area(resource, impl->mem.fd, impl->mem.offset, impl->mem.size);
+
+	return 0;
+
+      no_mem:
+	pw_log_error("can't create profiler resource");
+	pw_core_resource_error(client->core_resource,
+			       client->core_resource->id, -ENOMEM, "no memory");
+	return -ENOMEM;
+}
+
+static void module_destroy(void *data)
+{
+	struct impl *impl = data;
+	struct pw_node *node;
+
+	spa_hook_remove(&impl->core_listener);
+	spa_hook_remove(&impl->module_listener);
+
+	spa_list_for_each(node, &impl->core->node_list, link)
+		pw_node_set_profile(node, NULL);
+
+	if (impl->global)
+		pw_global_destroy(impl->global);
+
+	pw_memblock_free(&impl->mem);
+	free(impl->node_ids);
+
+	if (impl->properties)
+		pw_properties_free(impl->properties);
+
+	free(impl);
+}
+
+static const struct pw_module_events module_events = {
+	PW_VERSION_MODULE_EVENTS,
+	.destroy = module_destroy,
+};
+
+static bool module_init(struct pw_module *module, struct pw_properties *properties)
+{
+	struct pw_core *core = pw_module_get_core(module);
+	struct impl *impl;
+	struct pw_node_profile *nodes;
+	struct pw_node *node;
+	const char *str;
+	uint32_t i, max_nodes = DEFAULT_MAX_NODES;
+	int res;
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		return false;
+
+	pw_log_debug("module %p: new", impl);
+
+	impl->core = core;
+	impl->t = pw_core_get_type(core);
+	impl->properties = properties;
+	impl->type_profiler = spa_type_map_get_id(impl->t->map, PW_TYPE_INTERFACE__Profiler);
+
+	if (properties && (str = pw_properties_get(properties, "max-nodes")) != NULL)
+		max_nodes = pw_properties_parse_int(str);
+
+	impl->node_ids = calloc(max_nodes, sizeof(uint32_t));
+	if (impl->node_ids == NULL)
+		goto no_mem;
+
+	if ((res = pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
+				     PW_MEMBLOCK_FLAG_MAP_READWRITE |
+				     PW_MEMBLOCK_FLAG_SEAL |
+				     PW_MEMBLOCK_FLAG_SEAL_WRITE,
+				     PW_PROFILER_AREA_SIZE(max_nodes),
+				     &impl->mem)) < 0) {
+		if (res == -ENOTSUP) {
+			pw_log_warn("module %p: profiler disabled, memory can't be sealed", impl);
+			goto error;
+		}
+		goto no_mem;
+	}
+
+	impl->n_nodes = max_nodes;
+	impl->area = impl->mem.ptr;
+	impl->area->n_nodes = max_nodes;
+	nodes = PW_PROFILER_AREA_NODES(impl->area);
+	for (i = 0; i < max_nodes; i++) {
+		nodes[i].node_id = SPA_ID_INVALID;
+		impl->node_ids[i] = SPA_ID_INVALID;
+	}
+
+	pw_protocol_native_ext_profiler_init(core);
+
+	spa_list_for_each(node, &core->node_list, link) {
+		if (node->global)
+			add_node(impl, node, pw_global_get_id(node->global));
+	}
+
+	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
+	pw_core_add_listener(core, &impl->core_listener, &core_events, impl);
+
+	impl->global = pw_core_add_global(core, NULL, pw_module_get_global(module),
+					  impl->type_profiler, PW_VERSION_PROFILER,
+					  profiler_bind_func, impl);
+
+	return true;
+
+      no_mem:
+	pw_log_error("module %p: can't allocate profiler memory", impl);
+      error:
+	if (properties)
+		pw_properties_free(properties);
+	free(impl->node_ids);
+	free(impl);
+	return false;
+}
+
+bool pipewire__module_init(struct pw_module *module, const char *args)
+{
+	struct pw_properties *properties = NULL;
+	char **argv;
+	int i, n_tokens;
+
+	if (args != NULL) {
+		properties = pw_properties_new(NULL, NULL);
+		argv = pw_split_strv(args, " \t", INT_MAX, &n_tokens);
+		for (i = 0; i < n_tokens; i++) {
+			char **prop;
+			int n_props;
+
+			prop = pw_split_strv(argv[i], "=", INT_MAX, &n_props);
+			if (n_props >= 2)
+				pw_properties_set(properties, prop[0], prop[1]);
+
+			pw_free_strv(prop);
+		}
+		pw_free_strv(argv);
+	}
+	return module_init(module, properties);
+}
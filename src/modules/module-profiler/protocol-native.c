@@ -0,0 +1,104 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+
+#include <spa/pod/parser.h>
+
+#include "pipewire/pipewire.h"
+#include "pipewire/interfaces.h"
+#include "pipewire/protocol.h"
+
+#include "extensions/protocol-native.h"
+#include "extensions/profiler.h"
+
+static void
+profiler_marshal_area(void *object, int memfd, uint32_t offset, uint32_t size)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_resource(resource, PW_PROFILER_PROXY_EVENT_AREA);
+
+	spa_pod_builder_struct(b,
+			       "i", pw_protocol_native_add_resource_fd(resource, memfd),
+			       "i", offset,
+			       "i", size);
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
+static bool profiler_demarshal_area(void *object, void *data, size_t size)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	uint32_t memfd_idx, offset, sz;
+	int memfd;
+
+	spa_pod_parser_init(&prs, data, size, 0);
+	if (spa_pod_parser_get(&prs,
+			"["
+			"i", &memfd_idx,
+			"i", &offset,
+			"i", &sz, NULL) < 0)
+		return false;
+
+	memfd = pw_protocol_native_get_proxy_fd(proxy, memfd_idx);
+
+	pw_proxy_notify(proxy, struct pw_profiler_proxy_events, area, memfd, offset, sz);
+	return true;
+}
+
+static const struct pw_profiler_proxy_methods pw_protocol_native_profiler_method_marshal = {
+	PW_VERSION_PROFILER_PROXY_METHODS,
+};
+
+static const struct pw_profiler_proxy_events pw_protocol_native_profiler_event_marshal = {
+	PW_VERSION_PROFILER_PROXY_EVENTS,
+	&profiler_marshal_area,
+};
+
+static const struct pw_protocol_native_demarshal pw_protocol_native_profiler_event_demarshal[] = {
+	{ &profiler_demarshal_area, 0 },
+};
+
+const struct pw_protocol_marshal pw_protocol_native_profiler_marshal = {
+	PW_TYPE_INTERFACE__Profiler,
+	PW_VERSION_PROFILER,
+	PW_PROFILER_PROXY_METHOD_NUM,
+	&pw_protocol_native_profiler_method_marshal,
+	NULL,
+	PW_PROFILER_PROXY_EVENT_NUM,
+	&pw_protocol_native_profiler_event_marshal,
+	pw_protocol_native_profiler_event_demarshal,
+};
+
+struct pw_protocol *pw_protocol_native_ext_profiler_init(struct pw_core *core)
+{
+	struct pw_protocol *protocol;
+
+	protocol = pw_core_find_protocol(core, PW_TYPE_PROTOCOL__Native);
+
+	if (protocol == NULL)
+		return NULL;
+
+	pw_protocol_add_marshal(protocol, &pw_protocol_native_profiler_marshal);
+
+	return protocol;
+}
@@ -55,6 +55,16 @@
 #define LOCK_SUFFIX     ".lock"
 #define LOCK_SUFFIXLEN  5
 
+#define PROTOCOL_NATIVE_PROP_MAX_CLIENT_BUFFER	"protocol-native.max-client-buffer"
+#define DEFAULT_MAX_CLIENT_BUFFER		(8 * 1024 * 1024)
+#define PROTOCOL_NATIVE_PROP_MAX_CLIENT_INPUT	"protocol-native.max-client-input"
+#define DEFAULT_MAX_CLIENT_INPUT		(1024 * 1024)
+
+/* the messages and bytes handled for a client before the other clients
+ * and the other sources of the main loop get a turn */
+#define DISPATCH_MAX_MESSAGES	64
+#define DISPATCH_MAX_BYTES	(64 * 1024)
+
 void pw_protocol_native_init(struct pw_protocol *protocol);
 
 struct protocol_data {
@@ -75,6 +85,7 @@ struct client {
 
         bool disconnecting;
 	bool flush_signaled;
+	bool flushing;
         struct spa_source *flush_event;
 };
 
@@ -88,14 +99,33 @@ struct server {
 	struct pw_loop *loop;
 	struct spa_source *source;
 	struct spa_hook hook;
+
+	size_t max_client_buffer;
+	size_t max_client_input;
+	struct spa_list flush_list;	/**< clients with pending output */
+	struct spa_list dispatch_list;	/**< clients with deferred messages */
+	struct spa_source *dispatch_source;	/**< idle source to continue deferred clients */
+
+	uint64_t n_deferred;		/**< times a client used up its budget */
+	uint64_t n_dispatch_rounds;	/**< number of dispatch_source runs */
 };
 
 struct client_data {
+	struct server *server;
 	struct pw_client *client;
 	struct spa_hook client_listener;
 	struct spa_source *source;
 	struct pw_protocol_native_connection *connection;
+	struct spa_hook conn_listener;
+	struct spa_list flush_link;
+	struct spa_list dispatch_link;
+	bool flush_queued;
+	bool flushing;		/**< socket full, waiting for SPA_IO_OUT */
 	bool busy;
+	bool deferred;		/**< budget used up, in the server dispatch_list */
+
+	uint64_t n_messages;	/**< messages handled */
+	uint64_t n_deferred;	/**< times the budget was used up */
 };
 
 static bool pod_remap_data(uint32_t type, void *body, uint32_t size, struct pw_map *types)
@@ -163,27 +193,38 @@ static bool pod_remap_data(uint32_t type, void *body, uint32_t size, struct pw_m
 	return true;
 }
 
-static void
+/* handle the messages of a client until its budget is used up. Returns 1
+ * when the client has more messages, 0 when all messages are handled or the
+ * client is busy and < 0 when the client was destroyed */
+static int
 process_messages(struct client_data *data)
 {
 	struct pw_protocol_native_connection *conn = data->connection;
 	struct pw_client *client = data->client;
+	uint32_t n_messages = 0, n_bytes = 0;
 	uint8_t opcode;
 	uint32_t id;
 	uint32_t size;
 	void *message;
 
-	while (pw_protocol_native_connection_get_next(conn, &opcode, &id, &message, &size)) {
+	/* when the client is busy processing an async action, stop processing messages
+	 * for the client until it finishes the action */
+	while (!data->busy) {
 		struct pw_resource *resource;
 		const struct pw_protocol_native_demarshal *demarshal;
 	        const struct pw_protocol_marshal *marshal;
 		uint32_t permissions;
 
-		/* when the client is busy processing an async action, stop processing messages
-		 * for the client until it finishes the action */
-		if (data->busy)
+		if (n_messages >= DISPATCH_MAX_MESSAGES || n_bytes >= DISPATCH_MAX_BYTES)
+			return 1;
+
+		if (!pw_protocol_native_connection_get_next(conn, &opcode, &id, &message, &size))
 			break;
 
+		n_messages++;
+		n_bytes += size + 8;
+		data->n_messages++;
+
 		pw_log_trace("protocol-native %p: got message %d from %u", client->protocol,
 			     opcode, id);
 
@@ -222,38 +263,143 @@ process_messages(struct client_data *data)
 		if (!demarshal[opcode].func(resource, message, size))
 			goto invalid_message;
 	}
-	return;
+	return 0;
 
       invalid_method:
 	pw_log_error("protocol-native %p: invalid method %u on resource %u",
 		     client->protocol, opcode, id);
 	pw_client_destroy(client);
-	return;
+	return -EINVAL;
       invalid_message:
 	pw_log_error("protocol-native %p: invalid message received %u %u",
 		     client->protocol, id, opcode);
 	pw_client_destroy(client);
-	return;
+	return -EINVAL;
 }
 
 static void
-client_busy_changed(void *data, bool busy)
+client_update_mask(struct client_data *c)
 {
-	struct client_data *c = data;
 	struct pw_client *client = c->client;
 	enum spa_io mask = SPA_IO_ERR | SPA_IO_HUP;
 
-	c->busy = busy;
-
-	if (!busy)
+	if (!c->busy && !c->deferred)
 		mask |= SPA_IO_IN;
+	if (c->flushing)
+		mask |= SPA_IO_OUT;
 
-	pw_log_debug("protocol-native %p: busy changed %d", client->protocol, busy);
 	pw_loop_update_io(client->core->main_loop, c->source, mask);
+}
+
+/* write out the queued messages of the client. When the socket is full we
+ * wait for it to become writable again, a client that can't keep up with
+ * its messages is disconnected */
+static void
+client_flush(struct client_data *c)
+{
+	struct pw_client *client = c->client;
+	int res;
+
+	res = pw_protocol_native_connection_flush(c->connection);
+	if (res == -EAGAIN) {
+		if (!c->flushing) {
+			pw_log_debug("protocol-native %p: client %p socket full", client->protocol, client);
+			c->flushing = true;
+			client_update_mask(c);
+		}
+	} else if (res < 0) {
+		pw_log_error("protocol-native %p: client %p flush error: %s", client->protocol,
+			     client, spa_strerror(res));
+		pw_client_destroy(client);
+	} else if (c->flushing) {
+		c->flushing = false;
+		client_update_mask(c);
+	}
+}
+
+static void
+client_defer(struct client_data *c)
+{
+	struct server *s = c->server;
+	struct pw_loop *loop = pw_core_get_main_loop(s->this.protocol->core);
 
-	if (!busy)
-		process_messages(c);
+	c->n_deferred++;
+	s->n_deferred++;
 
+	if (!c->deferred) {
+		c->deferred = true;
+		spa_list_append(&s->dispatch_list, &c->dispatch_link);
+		pw_loop_enable_idle(loop, s->dispatch_source, true);
+		client_update_mask(c);
+	}
+}
+
+/* handle the messages of a client, when the budget is used up, the client
+ * continues from the dispatch_source after the other clients */
+static void
+client_process(struct client_data *c)
+{
+	if (process_messages(c) > 0)
+		client_defer(c);
+}
+
+static void
+do_dispatch(void *data)
+{
+	struct server *s = data;
+	struct pw_loop *loop = pw_core_get_main_loop(s->this.protocol->core);
+	struct client_data *c;
+	struct spa_list list;
+
+	s->n_dispatch_rounds++;
+
+	/* give every deferred client one budget, clients that have more
+	 * messages are added to the end of the list again for the next round.
+	 * Clients stay deferred while in the local list so that client_free()
+	 * can remove them. */
+	spa_list_init(&list);
+	spa_list_insert_list(&list, &s->dispatch_list);
+	spa_list_init(&s->dispatch_list);
+
+	while (!spa_list_is_empty(&list)) {
+		int res;
+
+		c = spa_list_first(&list, struct client_data, dispatch_link);
+		spa_list_remove(&c->dispatch_link);
+		c->deferred = false;
+
+		if ((res = process_messages(c)) < 0)
+			continue;
+
+		if (res > 0) {
+			c->deferred = true;
+			c->n_deferred++;
+			s->n_deferred++;
+			spa_list_append(&s->dispatch_list, &c->dispatch_link);
+		} else {
+			client_update_mask(c);
+		}
+	}
+	if (spa_list_is_empty(&s->dispatch_list))
+		pw_loop_enable_idle(loop, s->dispatch_source, false);
+
+	pw_log_trace("protocol-native %p: dispatch round %"PRIu64", %"PRIu64" deferred",
+		     s, s->n_dispatch_rounds, s->n_deferred);
+}
+
+static void
+client_busy_changed(void *data, bool busy)
+{
+	struct client_data *c = data;
+	struct pw_client *client = c->client;
+
+	c->busy = busy;
+
+	pw_log_debug("protocol-native %p: busy changed %d", client->protocol, busy);
+	client_update_mask(c);
+
+	if (!busy && !c->deferred)
+		client_process(c);
 }
 
 static void
@@ -268,8 +414,13 @@ connection_data(void *data, int fd, enum spa_io mask)
 		return;
 	}
 
+	if (mask & SPA_IO_OUT) {
+		client_flush(this);
+		return;
+	}
+
 	if (mask & SPA_IO_IN)
-		process_messages(this);
+		client_process(this);
 }
 
 static void client_free(void *data)
@@ -277,8 +428,15 @@ static void client_free(void *data)
 	struct client_data *this = data;
 	struct pw_client *client = this->client;
 
+	pw_log_debug("protocol-native %p: client %p handled %"PRIu64" messages, deferred %"PRIu64
+		     " times", client->protocol, client, this->n_messages, this->n_deferred);
+
 	pw_loop_destroy_source(client->protocol->core->main_loop, this->source);
 	spa_list_remove(&client->protocol_link);
+	if (this->flush_queued)
+		spa_list_remove(&this->flush_link);
+	if (this->deferred)
+		spa_list_remove(&this->dispatch_link);
 
 	pw_protocol_native_connection_destroy(this->connection);
 }
@@ -289,6 +447,33 @@ static const struct pw_client_events client_events = {
 	.busy_changed = client_busy_changed,
 };
 
+static void client_need_flush(void *data)
+{
+	struct client_data *this = data;
+
+	if (!this->flush_queued) {
+		spa_list_append(&this->server->flush_list, &this->flush_link);
+		this->flush_queued = true;
+	}
+}
+
+static void client_conn_error(void *data, int error)
+{
+	struct client_data *this = data;
+
+	/* the client is destroyed when the error is returned from the
+	 * next flush, we might be called from a client method here */
+	pw_log_warn("protocol-native %p: client %p connection error: %s",
+		    this->client->protocol, this->client, spa_strerror(error));
+	client_need_flush(this);
+}
+
+static const struct pw_protocol_native_connection_events client_conn_events = {
+	PW_VERSION_PROTOCOL_NATIVE_CONNECTION_EVENTS,
+	.error = client_conn_error,
+	.need_flush = client_need_flush,
+};
+
 static struct pw_client *client_new(struct server *s, int fd)
 {
 	struct client_data *this;
@@ -320,6 +505,7 @@ static struct pw_client *client_new(struct server *s, int fd)
 		goto no_client;
 
 	this = pw_client_get_user_data(client);
+	this->server = s;
 	this->client = client;
 	this->source = pw_loop_add_io(pw_core_get_main_loop(core),
 				      fd, SPA_IO_ERR | SPA_IO_HUP, true, connection_data, this);
@@ -330,6 +516,13 @@ static struct pw_client *client_new(struct server *s, int fd)
 	if (this->connection == NULL)
 		goto no_connection;
 
+	pw_protocol_native_connection_set_max_size(this->connection, s->max_client_buffer);
+	pw_protocol_native_connection_set_max_input_size(this->connection, s->max_client_input);
+	pw_protocol_native_connection_add_listener(this->connection,
+						   &this->conn_listener,
+						   &client_conn_events,
+						   this);
+
 	client->protocol = protocol;
 	spa_list_append(&s->this.client_list, &client->protocol_link);
 
@@ -436,8 +629,7 @@ socket_data(void *data, int fd, enum spa_io mask)
 	}
 	c = client->user_data;
 
-	pw_loop_update_io(client->protocol->core->main_loop,
-			  c->source, SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP);
+	client_update_mask(c);
 }
 
 static bool add_socket(struct pw_protocol *protocol, struct server *s)
@@ -528,6 +720,34 @@ static int impl_connect(struct pw_protocol_client *client)
 }
 
 
+static void do_flush_event(void *data, uint64_t count)
+{
+        struct client *impl = data;
+	struct pw_remote *remote = impl->this.remote;
+	int res;
+
+	impl->flush_signaled = false;
+        if (impl->connection == NULL)
+		return;
+
+	res = pw_protocol_native_connection_flush(impl->connection);
+	if (res == -EAGAIN) {
+		/* socket full, continue when it becomes writable */
+		if (!impl->flushing && impl->source) {
+			impl->flushing = true;
+			pw_loop_update_io(remote->core->main_loop, impl->source,
+					  SPA_IO_IN | SPA_IO_OUT | SPA_IO_HUP | SPA_IO_ERR);
+		}
+	} else if (res < 0) {
+		impl->this.disconnect(&impl->this);
+	} else if (impl->flushing) {
+		impl->flushing = false;
+		if (impl->source)
+			pw_loop_update_io(remote->core->main_loop, impl->source,
+					  SPA_IO_IN | SPA_IO_HUP | SPA_IO_ERR);
+	}
+}
+
 static void
 on_remote_data(void *data, int fd, enum spa_io mask)
 {
@@ -544,6 +764,12 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 		return;
         }
 
+	if (mask & SPA_IO_OUT) {
+		do_flush_event(impl, 0);
+		if (impl->source == NULL)
+			return;
+	}
+
         if (mask & SPA_IO_IN) {
                 uint8_t opcode;
                 uint32_t id;
@@ -597,15 +823,6 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 }
 
 
-static void do_flush_event(void *data, uint64_t count)
-{
-        struct client *impl = data;
-	impl->flush_signaled = false;
-        if (impl->connection)
-                if (!pw_protocol_native_connection_flush(impl->connection))
-                        impl->this.disconnect(&impl->this);
-}
-
 static void on_need_flush(void *data)
 {
         struct client *impl = data;
@@ -721,6 +938,8 @@ static void destroy_server(struct pw_protocol_server *server)
 
 	if (s->source)
 		pw_loop_destroy_source(s->loop, s->source);
+	if (s->dispatch_source)
+		pw_loop_destroy_source(pw_core_get_main_loop(server->protocol->core), s->dispatch_source);
 	if (s->addr.sun_path[0])
 		unlink(s->addr.sun_path);
 	if (s->lock_addr[0])
@@ -733,13 +952,18 @@ static void destroy_server(struct pw_protocol_server *server)
 static void on_before_hook(void *_data)
 {
 	struct server *server = _data;
-	struct pw_protocol_server *this = &server->this;
-	struct pw_client *client, *tmp;
 	struct client_data *data;
 
-	spa_list_for_each_safe(client, tmp, &this->client_list, protocol_link) {
-		data = client->user_data;
-		pw_protocol_native_connection_flush(data->connection);
+	/* flush the clients that got new messages, once per loop iteration.
+	 * Clients waiting for their socket to drain are flushed from
+	 * connection_data() instead. */
+	while (!spa_list_is_empty(&server->flush_list)) {
+		data = spa_list_first(&server->flush_list, struct client_data, flush_link);
+		spa_list_remove(&data->flush_link);
+		data->flush_queued = false;
+
+		if (!data->flushing)
+			client_flush(data);
 	}
 }
 
@@ -769,12 +993,14 @@ impl_add_server(struct pw_protocol *protocol,
 {
 	struct pw_protocol_server *this;
 	struct server *s;
-	const char *name;
+	const char *name, *str;
 
 	if ((s = calloc(1, sizeof(struct server))) == NULL)
 		return NULL;
 
 	s->fd_lock = -1;
+	spa_list_init(&s->flush_list);
+	spa_list_init(&s->dispatch_list);
 
 	this = &s->this;
 	this->protocol = protocol;
@@ -785,6 +1011,20 @@ impl_add_server(struct pw_protocol *protocol,
 
 	name = get_name(pw_core_get_properties(core));
 
+	s->max_client_buffer = DEFAULT_MAX_CLIENT_BUFFER;
+	str = pw_properties_get(pw_core_get_properties(core), PROTOCOL_NATIVE_PROP_MAX_CLIENT_BUFFER);
+	if (str != NULL)
+		s->max_client_buffer = pw_properties_parse_int64(str);
+
+	s->max_client_input = DEFAULT_MAX_CLIENT_INPUT;
+	str = pw_properties_get(pw_core_get_properties(core), PROTOCOL_NATIVE_PROP_MAX_CLIENT_INPUT);
+	if (str != NULL)
+		s->max_client_input = pw_properties_parse_int64(str);
+
+	s->dispatch_source = pw_loop_add_idle(pw_core_get_main_loop(core), false, do_dispatch, s);
+	if (s->dispatch_source == NULL)
+		goto error;
+
 	if (!init_socket_name(s, name))
 		goto error;
 
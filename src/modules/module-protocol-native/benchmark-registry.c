@@ -0,0 +1,165 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/interfaces.h>
+
+/* Measures how fast a client can enumerate the registry. Every round
+ * binds a new registry, which makes the daemon send all globals, and
+ * waits for the done event of a sync. */
+
+#define DEFAULT_ROUNDS	1000
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	struct pw_core_proxy *core_proxy;
+	struct spa_hook core_listener;
+
+	uint32_t n_rounds;
+	uint32_t round;
+	uint64_t n_globals;
+	uint64_t start;
+	int res;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void registry_event_global(void *data, uint32_t id, uint32_t parent_id,
+				  uint32_t permissions, uint32_t type, uint32_t version)
+{
+	struct data *d = data;
+	d->n_globals++;
+}
+
+static const struct pw_registry_proxy_events registry_events = {
+	PW_VERSION_REGISTRY_PROXY_EVENTS,
+	.global = registry_event_global,
+};
+
+static void next_round(struct data *d)
+{
+	struct pw_registry_proxy *registry;
+
+	registry = pw_core_proxy_get_registry(d->core_proxy, d->t->registry,
+					      PW_VERSION_REGISTRY, sizeof(struct spa_hook));
+	pw_registry_proxy_add_listener(registry,
+				       pw_proxy_get_user_data((struct pw_proxy *) registry),
+				       &registry_events, d);
+	pw_core_proxy_sync(d->core_proxy, ++d->round);
+}
+
+static void on_core_done(void *data, uint32_t seq)
+{
+	struct data *d = data;
+	uint64_t elapsed;
+
+	if (seq != d->round)
+		return;
+
+	if (d->round < d->n_rounds) {
+		next_round(d);
+		return;
+	}
+
+	elapsed = get_time() - d->start;
+	printf("%u rounds, %"PRIu64" globals in %f seconds\n", d->round, d->n_globals,
+	       (double) elapsed / SPA_NSEC_PER_SEC);
+	printf("%f rounds/s, %f globals/s\n",
+	       (double) d->round * SPA_NSEC_PER_SEC / elapsed,
+	       (double) d->n_globals * SPA_NSEC_PER_SEC / elapsed);
+
+	d->res = 0;
+	pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_proxy_events core_events = {
+	PW_VERSION_CORE_PROXY_EVENTS,
+	.done = on_core_done,
+};
+
+static void on_state_changed(void *data, enum pw_remote_state old,
+			     enum pw_remote_state state, const char *error)
+{
+	struct data *d = data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		fprintf(stderr, "remote error: %s\n", error);
+		pw_main_loop_quit(d->loop);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		d->core_proxy = pw_remote_get_core_proxy(d->remote);
+		pw_core_proxy_add_listener(d->core_proxy, &d->core_listener, &core_events, d);
+		d->start = get_time();
+		next_round(d);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_state_changed,
+};
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+
+	pw_init(&argc, &argv);
+
+	data.n_rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+	data.res = -1;
+
+	data.loop = pw_main_loop_new(NULL);
+	data.core = pw_core_new(pw_main_loop_get_loop(data.loop), NULL);
+	data.t = pw_core_get_type(data.core);
+	data.remote = pw_remote_new(data.core, NULL, 0);
+
+	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
+	if (pw_remote_connect(data.remote) < 0)
+		return -1;
+
+	pw_main_loop_run(data.loop);
+
+	pw_remote_destroy(data.remote);
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	return data.res;
+}
@@ -23,7 +23,10 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <spa/lib/debug.h>
 
@@ -34,6 +37,30 @@
 
 #define MAX_BUFFER_SIZE (1024 * 32)
 #define MAX_FDS 28
+#define MAX_IOV 64
+#define DEFAULT_MAX_OUT_SIZE (1024 * 1024 * 8)
+
+/* messages with a payload of at least this size are sent in a memfd */
+#define MEMFD_THRESHOLD (1024 * 128)
+/* opcode flag for a message with a payload in a memfd, the message
+ * contains the index of the fd and the size of the payload */
+#define OPCODE_MEMFD	(1 << 7)
+
+#ifndef F_LINUX_SPECIFIC_BASE
+#define F_LINUX_SPECIFIC_BASE 1024
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS	(F_LINUX_SPECIFIC_BASE + 9)
+#define F_GET_SEALS	(F_LINUX_SPECIFIC_BASE + 10)
+
+#define F_SEAL_SEAL	0x0001
+#define F_SEAL_SHRINK	0x0002
+#define F_SEAL_GROW	0x0004
+#define F_SEAL_WRITE	0x0008
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE	0x0010
+#endif
 
 static bool debug_messages = 0;
 
@@ -44,6 +71,8 @@ struct buffer {
 	int fds[MAX_FDS];
 	uint32_t n_fds;
 
+	size_t limit;		/**< max size of buffer_data, 0 for no limit */
+
 	off_t offset;
 	void *data;
 	size_t size;
@@ -51,10 +80,35 @@ struct buffer {
 	bool update;
 };
 
+/** a block of queued output messages */
+struct block {
+	struct spa_list link;
+	size_t offset;		/**< bytes sent */
+	size_t size;		/**< bytes used */
+	size_t maxsize;
+	uint8_t data[0];
+};
+
+/** the output queue, messages are appended to the last block and
+ * all blocks are written with one sendmsg */
+struct queue {
+	struct spa_list blocks;
+	struct block *spare;	/**< empty block kept for reuse */
+	size_t size;		/**< bytes queued */
+	size_t limit;		/**< max bytes queued, 0 for no limit */
+	int fds[MAX_FDS];	/**< fds to send, negative fds are closed when sent */
+	uint32_t n_fds;
+	size_t fds_offset;	/**< offset of the first message using fds */
+};
+
 struct impl {
 	struct pw_protocol_native_connection this;
 
-	struct buffer in, out;
+	struct buffer in;
+	struct pw_memblock in_mem;	/**< mapped memfd payload of the current message */
+
+	struct queue out;
+	int out_error;
 
 	uint32_t dest_id;
 	uint8_t opcode;
@@ -84,7 +138,8 @@ int pw_protocol_native_connection_get_fd(struct pw_protocol_native_connection *c
 /** Add an fd to a connection
  *
  * \param conn the connection
- * \param fd the fd to add
+ * \param fd the fd to add, a negative value adds the fd -\a fd and
+ *        passes ownership, it is closed after sending
  * \return the index of the fd or -1 when an error occured
  *
  * \memberof pw_protocol_native_connection
@@ -104,6 +159,8 @@ uint32_t pw_protocol_native_connection_add_fd(struct pw_protocol_native_connecti
 		pw_log_error("connection %p: too many fds", conn);
 		return -1;
 	}
+	if (index == 0)
+		impl->out.fds_offset = impl->out.size;
 
 	impl->out.fds[index] = fd;
 	impl->out.n_fds++;
@@ -111,22 +168,151 @@ uint32_t pw_protocol_native_connection_add_fd(struct pw_protocol_native_connecti
 	return index;
 }
 
+static void out_error(struct pw_protocol_native_connection *conn, int res)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+
+	if (impl->out_error == 0) {
+		impl->out_error = res;
+		spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, error, res);
+	}
+}
+
 static void *connection_ensure_size(struct pw_protocol_native_connection *conn, struct buffer *buf, size_t size)
 {
 	if (buf->buffer_size + size > buf->buffer_maxsize) {
-		buf->buffer_maxsize = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
-		buf->buffer_data = realloc(buf->buffer_data, buf->buffer_maxsize);
-		if (buf->buffer_data == NULL) {
-			buf->buffer_maxsize = 0;
-			spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, error, -ENOMEM);
+		size_t maxsize = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
+		uint8_t *data;
+
+		/* the connection is unusable when a message does not fit, make
+		 * the next flush fail */
+		if (buf->limit && buf->buffer_size + size > buf->limit) {
+			pw_log_error("connection %p: message of %zd bytes exceeds the limit of %zd",
+				     conn, buf->buffer_size + size, buf->limit);
+			out_error(conn, -EMSGSIZE);
 			return NULL;
 		}
+		if ((data = realloc(buf->buffer_data, maxsize)) == NULL) {
+			out_error(conn, -ENOMEM);
+			return NULL;
+		}
+		buf->buffer_data = data;
+		buf->buffer_maxsize = maxsize;
+
 		pw_log_warn("connection %p: resize buffer to %zd %zd %zd",
 			    conn, buf->buffer_size, size, buf->buffer_maxsize);
 	}
 	return (uint8_t *) buf->buffer_data + buf->buffer_size;
 }
 
+static void block_release(struct queue *q, struct block *b)
+{
+	if (q->spare == NULL && b->maxsize == MAX_BUFFER_SIZE) {
+		b->offset = b->size = 0;
+		q->spare = b;
+	} else
+		free(b);
+}
+
+/* reserve \a size bytes for a message at the end of the queue. When the
+ * message does not fit in the last block, the \a keep bytes of the message
+ * that were already written are moved to a new block. */
+static void *queue_reserve(struct pw_protocol_native_connection *conn, size_t size, size_t keep)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct queue *q = &impl->out;
+	struct block *tail = NULL, *b;
+
+	if (impl->out_error < 0)
+		return NULL;
+
+	if (q->limit > 0 && q->size + size > q->limit) {
+		pw_log_error("connection %p: peer too slow, %zd bytes queued, limit %zd",
+			     conn, q->size, q->limit);
+		out_error(conn, -ENOSPC);
+		return NULL;
+	}
+
+	if (!spa_list_is_empty(&q->blocks)) {
+		tail = spa_list_last(&q->blocks, struct block, link);
+		if (tail->maxsize - tail->size >= size)
+			return tail->data + tail->size;
+	}
+
+	if (q->spare && size <= q->spare->maxsize) {
+		b = q->spare;
+		q->spare = NULL;
+	} else {
+		size_t maxsize = SPA_MAX(MAX_BUFFER_SIZE, SPA_ROUND_UP_N(size, 4096));
+
+		if ((b = malloc(sizeof(struct block) + maxsize)) == NULL) {
+			out_error(conn, -ENOMEM);
+			return NULL;
+		}
+		b->offset = b->size = 0;
+		b->maxsize = maxsize;
+	}
+	if (tail) {
+		if (keep > 0)
+			memcpy(b->data, tail->data + tail->size, keep);
+		if (tail->size == tail->offset) {
+			spa_list_remove(&tail->link);
+			block_release(q, tail);
+		}
+	}
+	spa_list_append(&q->blocks, &b->link);
+
+	return b->data;
+}
+
+/* remove \a size sent bytes from the queue */
+static void queue_consume(struct queue *q, size_t size)
+{
+	struct block *b, *t;
+	size_t avail;
+
+	spa_list_for_each_safe(b, t, &q->blocks, link) {
+		avail = SPA_MIN(size, b->size - b->offset);
+		b->offset += avail;
+		size -= avail;
+
+		if (b->offset < b->size)
+			break;
+
+		if (b->link.next != &q->blocks || b->maxsize > MAX_BUFFER_SIZE) {
+			spa_list_remove(&b->link);
+			block_release(q, b);
+		} else {
+			/* keep the last block for new messages */
+			b->offset = b->size = 0;
+		}
+	}
+}
+
+static void queue_close_fds(struct queue *q)
+{
+	uint32_t i;
+
+	for (i = 0; i < q->n_fds; i++) {
+		if (q->fds[i] < 0)
+			close(-q->fds[i]);
+	}
+	q->n_fds = 0;
+}
+
+static void clear_queue(struct queue *q)
+{
+	struct block *b, *t;
+
+	spa_list_for_each_safe(b, t, &q->blocks, link) {
+		spa_list_remove(&b->link);
+		block_release(q, b);
+	}
+	queue_close_fds(q);
+	q->size = 0;
+	q->fds_offset = 0;
+}
+
 static bool refill_buffer(struct pw_protocol_native_connection *conn, struct buffer *buf)
 {
 	ssize_t len;
@@ -148,8 +334,9 @@ static bool refill_buffer(struct pw_protocol_native_connection *conn, struct buf
 		if (len < 0) {
 			if (errno == EINTR)
 				continue;
-			if (errno != EAGAIN || errno != EWOULDBLOCK)
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
 				goto recv_error;
+			return false;
 		}
 		break;
 	}
@@ -176,6 +363,16 @@ static bool refill_buffer(struct pw_protocol_native_connection *conn, struct buf
 	return false;
 }
 
+/* move the partial message at the end of the buffer to the start */
+static void compact_buffer(struct buffer *buf)
+{
+	if (buf->offset == 0)
+		return;
+	buf->buffer_size -= buf->offset;
+	memmove(buf->buffer_data, buf->buffer_data + buf->offset, buf->buffer_size);
+	buf->offset = 0;
+}
+
 static void clear_buffer(struct buffer *buf)
 {
 	buf->n_fds = 0;
@@ -209,20 +406,19 @@ struct pw_protocol_native_connection *pw_protocol_native_connection_new(int fd)
 	this->fd = fd;
 	spa_hook_list_init(&this->listener_list);
 
-	impl->out.buffer_data = malloc(MAX_BUFFER_SIZE);
-	impl->out.buffer_maxsize = MAX_BUFFER_SIZE;
+	spa_list_init(&impl->out.blocks);
+	impl->out.limit = DEFAULT_MAX_OUT_SIZE;
 	impl->in.buffer_data = malloc(MAX_BUFFER_SIZE);
 	impl->in.buffer_maxsize = MAX_BUFFER_SIZE;
 	impl->in.update = true;
+	impl->in_mem.fd = -1;
 
-	if (impl->out.buffer_data == NULL || impl->in.buffer_data == NULL)
+	if (impl->in.buffer_data == NULL)
 		goto no_mem;
 
 	return this;
 
       no_mem:
-	free(impl->out.buffer_data);
-	free(impl->in.buffer_data);
 	free(impl);
 	return NULL;
 }
@@ -241,11 +437,32 @@ void pw_protocol_native_connection_destroy(struct pw_protocol_native_connection
 
 	spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, destroy);
 
-	free(impl->out.buffer_data);
+	clear_queue(&impl->out);
+	free(impl->out.spare);
+	pw_memblock_free(&impl->in_mem);
 	free(impl->in.buffer_data);
 	free(impl);
 }
 
+/* the payload memfd must hold the message and the sender must not be able
+ * to shrink or change it while we parse it */
+static int check_memfd(int fd, uint32_t size)
+{
+	struct stat st;
+	int seals;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+	if (size == 0 || size > st.st_size)
+		return -EINVAL;
+	if ((seals = fcntl(fd, F_GET_SEALS)) < 0)
+		return -errno;
+	if (!(seals & F_SEAL_SHRINK) ||
+	    !(seals & (F_SEAL_WRITE | F_SEAL_FUTURE_WRITE)))
+		return -EPERM;
+	return 0;
+}
+
 /** Move to the next packet in the connection
  *
  * \param conn the connection
@@ -272,11 +489,14 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 	uint8_t *data;
 	struct buffer *buf;
 	uint32_t *p;
+	int res;
 
 	buf = &impl->in;
 
 	/* move to next packet */
 	buf->offset += buf->size;
+	buf->size = 0;
+	pw_memblock_free(&impl->in_mem);
 
       again:
 	if (buf->update) {
@@ -299,7 +519,8 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 	size -= buf->offset;
 
 	if (size < 8) {
-		if (connection_ensure_size(conn, buf, 8) == NULL)
+		compact_buffer(buf);
+		if (connection_ensure_size(conn, buf, 8 - size) == NULL)
 			return false;
 		buf->update = true;
 		goto again;
@@ -313,7 +534,8 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 	len = p[1] & 0xffffff;
 
 	if (len > size) {
-		if (connection_ensure_size(conn, buf, len) == NULL)
+		compact_buffer(buf);
+		if (connection_ensure_size(conn, buf, len - size) == NULL)
 			return false;
 		buf->update = true;
 		goto again;
@@ -325,6 +547,35 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 	*dt = buf->data;
 	*sz = buf->size;
 
+	if (*opcode & OPCODE_MEMFD) {
+		uint32_t *m = (uint32_t *) data;
+
+		*opcode &= ~OPCODE_MEMFD;
+		*sz = 0;
+		if (len < 8 || (impl->in_mem.fd = pw_protocol_native_connection_get_fd(conn, m[0])) < 0) {
+			pw_log_error("connection %p: invalid memfd message", conn);
+			return true;
+		}
+		/* we own the fd now */
+		buf->fds[m[0]] = -1;
+		impl->in_mem.flags = PW_MEMBLOCK_FLAG_WITH_FD | PW_MEMBLOCK_FLAG_MAP_READ;
+		impl->in_mem.size = m[1];
+		if ((res = check_memfd(impl->in_mem.fd, m[1])) < 0) {
+			pw_log_error("connection %p: rejected memfd message: %s",
+				     conn, strerror(-res));
+			pw_memblock_free(&impl->in_mem);
+			return true;
+		}
+		if (pw_memblock_map(&impl->in_mem) < 0) {
+			pw_log_error("connection %p: can't map memfd message: %m", conn);
+			pw_memblock_free(&impl->in_mem);
+			return true;
+		}
+		*dt = data = impl->in_mem.ptr;
+		*sz = impl->in_mem.size;
+		len = *sz;
+	}
+
 	if (debug_messages) {
 		printf("<<<<<<<<< in: %d %d %zd\n", *dest_id, *opcode, len);
 	        spa_debug_pod((struct spa_pod *)data, 0);
@@ -333,13 +584,12 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 	return true;
 }
 
-static inline void *begin_write(struct pw_protocol_native_connection *conn, uint32_t size)
+static inline void *begin_write(struct pw_protocol_native_connection *conn, uint32_t size,
+				uint32_t keep)
 {
-	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	uint32_t *p;
-	struct buffer *buf = &impl->out;
 	/* 4 for dest_id, 1 for opcode, 3 for size and size for payload */
-	if ((p = connection_ensure_size(conn, buf, 8 + size)) == NULL)
+	if ((p = queue_reserve(conn, 8 + size, keep ? 8 + keep : 0)) == NULL)
 		return NULL;
 
 	return p + 2;
@@ -350,9 +600,13 @@ static uint32_t write_pod(struct spa_pod_builder *b, const void *data, uint32_t
 	struct impl *impl = SPA_CONTAINER_OF(b, struct impl, builder);
 	uint32_t ref = b->state.offset;
 
-        if (b->size <= ref) {
+        if (b->size < ref + size) {
                 b->size = SPA_ROUND_UP_N(ref + size, 4096);
-                b->data = begin_write(&impl->this, b->size);
+                b->data = begin_write(&impl->this, b->size, ref);
+		if (b->data == NULL) {
+			b->size = 0;
+			return -1;
+		}
         }
         memcpy(b->data + ref, data, size);
 
@@ -417,99 +671,216 @@ pw_protocol_native_connection_begin_proxy(struct pw_protocol_native_connection *
 	return &impl->builder;
 }
 
+/* move a large payload to a memfd and write the fd index and size
+ * to \a msg */
+static bool write_memfd(struct pw_protocol_native_connection *conn,
+			const void *data, uint32_t size, uint32_t *msg)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct pw_memblock mem;
+	uint32_t index;
+
+	if (impl->out.n_fds >= MAX_FDS)
+		return false;
+
+	if (pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
+			      PW_MEMBLOCK_FLAG_MAP_READWRITE, size, &mem) < 0)
+		return false;
+
+	memcpy(mem.ptr, data, size);
+	munmap(mem.ptr, size);
+
+	/* the receiver only accepts memory that can't change anymore, the
+	 * write seal needs the writable mapping to be gone */
+	if (fcntl(mem.fd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK |
+				       F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+		pw_log_debug("connection %p: can't seal memfd: %m", conn);
+		close(mem.fd);
+		return false;
+	}
+
+	/* negative fds are closed after sending */
+	index = pw_protocol_native_connection_add_fd(conn, -mem.fd);
+
+	msg[0] = index;
+	msg[1] = size;
+
+	return true;
+}
+
 void
 pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 				  struct spa_pod_builder *builder)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	uint32_t *p, size = builder->state.offset;
-	struct buffer *buf = &impl->out;
+	struct queue *q = &impl->out;
+	struct block *b;
 
-	if ((p = connection_ensure_size(conn, buf, 8 + size)) == NULL)
+	if (size > 0 && builder->data == NULL)
 		return;
 
-	*p++ = impl->dest_id;
-	*p++ = (impl->opcode << 24) | (size & 0xffffff);
-
-	buf->buffer_size += 8 + size;
+	if ((p = queue_reserve(conn, 8 + size, 8 + size)) == NULL)
+		return;
 
 	if (debug_messages) {
 		printf(">>>>>>>>> out: %d %d %d\n", impl->dest_id, impl->opcode, size);
-	        spa_debug_pod((struct spa_pod *)p, 0);
+	        spa_debug_pod((struct spa_pod *)(p + 2), 0);
 	}
+
+	p[0] = impl->dest_id;
+	if (size >= MEMFD_THRESHOLD && write_memfd(conn, p + 2, size, p + 2)) {
+		p[1] = ((impl->opcode | OPCODE_MEMFD) << 24) | 8;
+		size = 8;
+	} else
+		p[1] = (impl->opcode << 24) | (size & 0xffffff);
+
+	b = spa_list_last(&q->blocks, struct block, link);
+	b->size += 8 + size;
+	q->size += 8 + size;
+
 	spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, need_flush);
 }
 
 /** Flush the connection object
  *
  * \param conn the connection object
- * \return true on success
+ * \return 0 when all data was written, -EAGAIN when the socket is full
+ * and data remains queued, or a negative errno on error
  *
- * Write the queued messages on the connection to the socket
+ * Write the queued messages on the connection to the socket. Data that
+ * can't be written is kept and sent on the next flush, wait for the socket
+ * to become writable before trying again when -EAGAIN is returned.
  *
  * \memberof pw_protocol_native_connection
  */
-bool pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
+int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	ssize_t len;
+	size_t size, total, avail;
 	struct msghdr msg = { 0 };
-	struct iovec iov[1];
+	struct iovec iov[MAX_IOV];
 	struct cmsghdr *cmsg;
 	char cmsgbuf[CMSG_SPACE(MAX_FDS * sizeof(int))];
-	int *cm, i, fds_len;
-	struct buffer *buf;
-
-	buf = &impl->out;
-
-	if (buf->buffer_size == 0)
-		return true;
-
-	fds_len = buf->n_fds * sizeof(int);
-
-	iov[0].iov_base = buf->buffer_data;
-	iov[0].iov_len = buf->buffer_size;
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
+	int *cm, i, fds_len, n_iov;
+	uint32_t n_fds;
+	struct queue *q;
+	struct block *b;
+
+	q = &impl->out;
+
+	if (impl->out_error < 0)
+		return impl->out_error;
+
+	while (q->size > 0) {
+		/* the fds go with the first byte that is sent, finish the data
+		 * of older messages first so that the fds arrive together with
+		 * the messages that use them */
+		if (q->n_fds > 0 && q->fds_offset > 0) {
+			size = q->fds_offset;
+			n_fds = 0;
+		} else {
+			size = q->size;
+			n_fds = q->n_fds;
+		}
 
-	if (buf->n_fds > 0) {
-		msg.msg_control = cmsgbuf;
-		msg.msg_controllen = CMSG_SPACE(fds_len);
-		cmsg = CMSG_FIRSTHDR(&msg);
-		cmsg->cmsg_level = SOL_SOCKET;
-		cmsg->cmsg_type = SCM_RIGHTS;
-		cmsg->cmsg_len = CMSG_LEN(fds_len);
-		cm = (int *) CMSG_DATA(cmsg);
-		for (i = 0; i < buf->n_fds; i++)
-			cm[i] = buf->fds[i] > 0 ? buf->fds[i] : -buf->fds[i];
-		msg.msg_controllen = cmsg->cmsg_len;
-	} else {
-		msg.msg_control = NULL;
-		msg.msg_controllen = 0;
-	}
+		n_iov = 0;
+		total = 0;
+		spa_list_for_each(b, &q->blocks, link) {
+			if (n_iov == MAX_IOV || total == size)
+				break;
+			avail = SPA_MIN(b->size - b->offset, size - total);
+			if (avail == 0)
+				continue;
+			iov[n_iov].iov_base = b->data + b->offset;
+			iov[n_iov].iov_len = avail;
+			n_iov++;
+			total += avail;
+		}
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n_iov;
+
+		if (n_fds > 0) {
+			fds_len = n_fds * sizeof(int);
+			msg.msg_control = cmsgbuf;
+			msg.msg_controllen = CMSG_SPACE(fds_len);
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(fds_len);
+			cm = (int *) CMSG_DATA(cmsg);
+			for (i = 0; i < n_fds; i++)
+				cm[i] = q->fds[i] > 0 ? q->fds[i] : -q->fds[i];
+			msg.msg_controllen = cmsg->cmsg_len;
+		} else {
+			msg.msg_control = NULL;
+			msg.msg_controllen = 0;
+		}
 
-	while (true) {
 		len = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
 		if (len < 0) {
 			if (errno == EINTR)
 				continue;
-			else
-				goto send_error;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				pw_log_trace("connection %p: %d socket full, %zd bytes queued",
+					     conn, conn->fd, q->size);
+				return -EAGAIN;
+			}
+			goto send_error;
 		}
-		break;
-	}
-	pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, len,
-		     buf->n_fds);
+		pw_log_trace("connection %p: %d written %zd bytes in %d blocks and %u fds",
+			     conn, conn->fd, len, n_iov, n_fds);
 
-	buf->buffer_size -= len;
-	buf->n_fds = 0;
+		if (n_fds > 0)
+			queue_close_fds(q);
 
-	return true;
+		queue_consume(q, len);
+		q->size -= len;
+		q->fds_offset = q->fds_offset > len ? q->fds_offset - len : 0;
+	}
+	return 0;
 
 	/* ERRORS */
       send_error:
 	pw_log_error("could not sendmsg: %s", strerror(errno));
-	return false;
+	return -errno;
+}
+
+/** Set the maximum amount of unsent data
+ *
+ * \param conn the connection object
+ * \param max_size the maximum number of queued bytes, 0 for no limit
+ *
+ * When a message would make the queued data grow beyond \a max_size, the
+ * message is dropped, the error event is emited with -ENOSPC and all
+ * following flushes fail.
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void pw_protocol_native_connection_set_max_size(struct pw_protocol_native_connection *conn,
+						size_t max_size)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	impl->out.limit = max_size;
+}
+
+/** Set the maximum size of an incoming message
+ *
+ * \param conn the connection object
+ * \param max_size the maximum size of the input buffer, 0 for no limit
+ *
+ * The input buffer grows to hold a complete message. When a message
+ * does not fit in \a max_size, the error event is emited with -EMSGSIZE
+ * and all following flushes fail.
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void pw_protocol_native_connection_set_max_input_size(struct pw_protocol_native_connection *conn,
+						      size_t max_size)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	impl->in.limit = max_size;
 }
 
 /** Clear the connection object
@@ -525,7 +896,7 @@ bool pw_protocol_native_connection_clear(struct pw_protocol_native_connection *c
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 
-	clear_buffer(&impl->out);
+	clear_queue(&impl->out);
 	clear_buffer(&impl->in);
 	impl->in.update = true;
 
@@ -87,9 +87,17 @@ void
 pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
                                   struct spa_pod_builder *builder);
 
-bool
+int
 pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn);
 
+void
+pw_protocol_native_connection_set_max_size(struct pw_protocol_native_connection *conn,
+					   size_t max_size);
+
+void
+pw_protocol_native_connection_set_max_input_size(struct pw_protocol_native_connection *conn,
+						 size_t max_size);
+
 bool
 pw_protocol_native_connection_clear(struct pw_protocol_native_connection *conn);
 
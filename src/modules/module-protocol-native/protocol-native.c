@@ -19,6 +19,8 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "spa/pod/parser.h"
 
@@ -172,6 +174,18 @@ core_marshal_update_types_client(void *object, uint32_t first_id, uint32_t n_typ
 	pw_protocol_native_end_proxy(proxy, b);
 }
 
+static void core_marshal_get_registry_snapshot(void *object)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_GET_REGISTRY_SNAPSHOT);
+
+	spa_pod_builder_add(b, "[]", NULL);
+
+	pw_protocol_native_end_proxy(proxy, b);
+}
+
 static bool core_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
@@ -252,6 +266,30 @@ static bool core_demarshal_remove_id(void *object, void *data, size_t size)
 	return true;
 }
 
+static bool core_demarshal_registry_snapshot(void *object, void *data, size_t size)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	int32_t index;
+	uint32_t memsize;
+	uint64_t serial;
+	int fd = -1;
+
+	spa_pod_parser_init(&prs, data, size, 0);
+	if (spa_pod_parser_get(&prs,
+			"["
+			"i", &index,
+			"i", &memsize,
+			"l", &serial, NULL) < 0)
+		return false;
+
+	if (index >= 0 && (fd = pw_protocol_native_get_proxy_fd(proxy, index)) < 0)
+		return false;
+
+	pw_proxy_notify(proxy, struct pw_core_proxy_events, registry_snapshot, fd, memsize, serial);
+	return true;
+}
+
 static bool core_demarshal_update_types_client(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
@@ -352,6 +390,30 @@ static void core_marshal_remove_id(void *object, uint32_t id)
 	pw_protocol_native_end_resource(resource, b);
 }
 
+static void core_marshal_registry_snapshot(void *object, int fd, uint32_t size, uint64_t serial)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+	int32_t index = -1;
+
+	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_REGISTRY_SNAPSHOT);
+
+	/* the server can replace the memfd before this message is flushed, send
+	 * a dup that the connection closes after sending (negative fd) */
+	if (fd >= 0) {
+		int dfd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+		if (dfd >= 0 && (index = pw_protocol_native_add_resource_fd(resource, -dfd)) < 0)
+			close(dfd);
+	}
+
+	spa_pod_builder_struct(b,
+			       "i", index,
+			       "i", size,
+			       "l", serial);
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
 static void
 core_marshal_update_types_server(void *object, uint32_t first_id, uint32_t n_types, const char **types)
 {
@@ -496,6 +558,19 @@ static bool core_demarshal_create_link(void *object, void *data, size_t size)
 	return true;
 }
 
+static bool core_demarshal_get_registry_snapshot(void *object, void *data, size_t size)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_parser prs;
+
+	spa_pod_parser_init(&prs, data, size, 0);
+	if (spa_pod_parser_get(&prs, "[", NULL) < 0)
+		return false;
+
+	pw_resource_do(resource, struct pw_core_proxy_methods, get_registry_snapshot);
+	return true;
+}
+
 static bool core_demarshal_update_types_server(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
@@ -688,45 +763,62 @@ static bool factory_demarshal_info(void *object, void *data, size_t size)
 	return true;
 }
 
+static void marshal_props(struct spa_pod_builder *b, const struct spa_dict *props)
+{
+	uint32_t i, n_items;
+
+	n_items = props ? props->n_items : 0;
+
+	spa_pod_builder_add(b, "i", n_items, NULL);
+	for (i = 0; i < n_items; i++) {
+		spa_pod_builder_add(b,
+				    "s", props->items[i].key,
+				    "s", props->items[i].value, NULL);
+	}
+}
+
 static void node_marshal_info(void *object, struct pw_node_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t mask = info->change_mask;
+	uint32_t i;
 
 	b = pw_protocol_native_begin_resource(resource, PW_NODE_PROXY_EVENT_INFO);
 
+	/* only the fields flagged in the change_mask are serialized */
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "s", info->name,
-			    "i", info->max_input_ports,
-			    "i", info->n_input_ports,
-			    "i", info->n_input_params, NULL);
-
-	for (i = 0; i < info->n_input_params; i++)
-		spa_pod_builder_add(b, "P", info->input_params[i], NULL);
-
-	spa_pod_builder_add(b,
-			    "i", info->max_output_ports,
-			    "i", info->n_output_ports,
-			    "i", info->n_output_params, 0);
-
-	for (i = 0; i < info->n_output_params; i++)
-		spa_pod_builder_add(b, "P", info->output_params[i], NULL);
+			    "l", mask, NULL);
 
-	n_items = info->props ? info->props->n_items : 0;
-
-	spa_pod_builder_add(b,
-			    "i", info->state,
-			    "s", info->error, "i", n_items, NULL);
-
-	for (i = 0; i < n_items; i++) {
+	if (mask & PW_NODE_CHANGE_MASK_NAME)
+		spa_pod_builder_add(b, "s", info->name, NULL);
+	if (mask & PW_NODE_CHANGE_MASK_INPUT_PORTS)
 		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
+				    "i", info->max_input_ports,
+				    "i", info->n_input_ports, NULL);
+	if (mask & PW_NODE_CHANGE_MASK_INPUT_PARAMS) {
+		spa_pod_builder_add(b, "i", info->n_input_params, NULL);
+		for (i = 0; i < info->n_input_params; i++)
+			spa_pod_builder_add(b, "P", info->input_params[i], NULL);
+	}
+	if (mask & PW_NODE_CHANGE_MASK_OUTPUT_PORTS)
+		spa_pod_builder_add(b,
+				    "i", info->max_output_ports,
+				    "i", info->n_output_ports, NULL);
+	if (mask & PW_NODE_CHANGE_MASK_OUTPUT_PARAMS) {
+		spa_pod_builder_add(b, "i", info->n_output_params, NULL);
+		for (i = 0; i < info->n_output_params; i++)
+			spa_pod_builder_add(b, "P", info->output_params[i], NULL);
 	}
+	if (mask & PW_NODE_CHANGE_MASK_STATE)
+		spa_pod_builder_add(b,
+				    "i", info->state,
+				    "s", info->error, NULL);
+	if (mask & PW_NODE_CHANGE_MASK_PROPS)
+		marshal_props(b, info->props);
+
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -737,49 +829,68 @@ static bool node_demarshal_info(void *object, void *data, size_t size)
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
 	struct spa_dict props;
-	struct pw_node_info info;
+	struct pw_node_info info = { 0, };
 	int i;
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
 			"["
 			"i", &info.id,
-			"l", &info.change_mask,
-			"s", &info.name,
-			"i", &info.max_input_ports,
-			"i", &info.n_input_ports,
-			"i", &info.n_input_params, NULL) < 0)
+			"l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.input_params = alloca(info.n_input_params * sizeof(struct spa_pod *));
-	for (i = 0; i < info.n_input_params; i++)
-		if (spa_pod_parser_get(&prs, "P", &info.input_params[i], NULL) < 0)
+	if (info.change_mask & PW_NODE_CHANGE_MASK_NAME) {
+		if (spa_pod_parser_get(&prs, "s", &info.name, NULL) < 0)
 			return false;
-
-	if (spa_pod_parser_get(&prs,
-			      "i", &info.max_output_ports,
-			      "i", &info.n_output_ports,
-			      "i", &info.n_output_params, NULL) < 0)
-		return false;
-
-	info.output_params = alloca(info.n_output_params * sizeof(struct spa_pod *));
-	for (i = 0; i < info.n_output_params; i++)
-		if (spa_pod_parser_get(&prs, "P", &info.output_params[i], NULL) < 0)
+	}
+	if (info.change_mask & PW_NODE_CHANGE_MASK_INPUT_PORTS) {
+		if (spa_pod_parser_get(&prs,
+				      "i", &info.max_input_ports,
+				      "i", &info.n_input_ports, NULL) < 0)
+			return false;
+	}
+	if (info.change_mask & PW_NODE_CHANGE_MASK_INPUT_PARAMS) {
+		if (spa_pod_parser_get(&prs, "i", &info.n_input_params, NULL) < 0)
 			return false;
 
-	if (spa_pod_parser_get(&prs,
-			      "i", &info.state,
-			      "s", &info.error,
-			      "i", &props.n_items, NULL) < 0)
-		return false;
+		info.input_params = alloca(info.n_input_params * sizeof(struct spa_pod *));
+		for (i = 0; i < info.n_input_params; i++)
+			if (spa_pod_parser_get(&prs, "P", &info.input_params[i], NULL) < 0)
+				return false;
+	}
+	if (info.change_mask & PW_NODE_CHANGE_MASK_OUTPUT_PORTS) {
+		if (spa_pod_parser_get(&prs,
+				      "i", &info.max_output_ports,
+				      "i", &info.n_output_ports, NULL) < 0)
+			return false;
+	}
+	if (info.change_mask & PW_NODE_CHANGE_MASK_OUTPUT_PARAMS) {
+		if (spa_pod_parser_get(&prs, "i", &info.n_output_params, NULL) < 0)
+			return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
+		info.output_params = alloca(info.n_output_params * sizeof(struct spa_pod *));
+		for (i = 0; i < info.n_output_params; i++)
+			if (spa_pod_parser_get(&prs, "P", &info.output_params[i], NULL) < 0)
+				return false;
+	}
+	if (info.change_mask & PW_NODE_CHANGE_MASK_STATE) {
 		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value, NULL) < 0)
+				      "i", &info.state,
+				      "s", &info.error, NULL) < 0)
+			return false;
+	}
+	if (info.change_mask & PW_NODE_CHANGE_MASK_PROPS) {
+		if (spa_pod_parser_get(&prs, "i", &props.n_items, NULL) < 0)
 			return false;
+
+		info.props = &props;
+		props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+		for (i = 0; i < props.n_items; i++) {
+			if (spa_pod_parser_get(&prs,
+					       "s", &props.items[i].key,
+					       "s", &props.items[i].value, NULL) < 0)
+				return false;
+		}
 	}
 	pw_proxy_notify(proxy, struct pw_node_proxy_events, info, &info);
 	return true;
@@ -789,23 +900,17 @@ static void client_marshal_info(void *object, struct pw_client_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
-
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "i", n_items, NULL);
+			    "l", info->change_mask, NULL);
+
+	if (info->change_mask & PW_CLIENT_CHANGE_MASK_PROPS)
+		marshal_props(b, info->props);
 
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -816,24 +921,28 @@ static bool client_demarshal_info(void *object, void *data, size_t size)
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
 	struct spa_dict props;
-	struct pw_client_info info;
+	struct pw_client_info info = { 0, };
 	uint32_t i;
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
 			"["
 			"i", &info.id,
-			"l", &info.change_mask,
-			"i", &props.n_items, NULL) < 0)
+			"l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value, NULL) < 0)
+	if (info.change_mask & PW_CLIENT_CHANGE_MASK_PROPS) {
+		if (spa_pod_parser_get(&prs, "i", &props.n_items, NULL) < 0)
 			return false;
+
+		info.props = &props;
+		props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+		for (i = 0; i < props.n_items; i++) {
+			if (spa_pod_parser_get(&prs,
+					       "s", &props.items[i].key,
+					       "s", &props.items[i].value, NULL) < 0)
+				return false;
+		}
 	}
 	pw_proxy_notify(proxy, struct pw_client_proxy_events, info, &info);
 	return true;
@@ -843,28 +952,28 @@ static void link_marshal_info(void *object, struct pw_link_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t mask = info->change_mask;
 
 	b = pw_protocol_native_begin_resource(resource, PW_LINK_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
-
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "i", info->output_node_id,
-			    "i", info->output_port_id,
-			    "i", info->input_node_id,
-			    "i", info->input_port_id,
-			    "P", info->format,
-			    "i", n_items, NULL);
+			    "l", mask, NULL);
 
-	for (i = 0; i < n_items; i++) {
+	if (mask & PW_LINK_CHANGE_MASK_OUTPUT)
 		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
+				    "i", info->output_node_id,
+				    "i", info->output_port_id, NULL);
+	if (mask & PW_LINK_CHANGE_MASK_INPUT)
+		spa_pod_builder_add(b,
+				    "i", info->input_node_id,
+				    "i", info->input_port_id, NULL);
+	if (mask & PW_LINK_CHANGE_MASK_FORMAT)
+		spa_pod_builder_add(b, "P", info->format, NULL);
+	if (mask & PW_LINK_CHANGE_MASK_PROPS)
+		marshal_props(b, info->props);
+
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -882,23 +991,38 @@ static bool link_demarshal_info(void *object, void *data, size_t size)
 	if (spa_pod_parser_get(&prs,
 			"["
 			"i", &info.id,
-			"l", &info.change_mask,
-			"i", &info.output_node_id,
-			"i", &info.output_port_id,
-			"i", &info.input_node_id,
-			"i", &info.input_port_id,
-			"P", &info.format,
-			"i", &props.n_items, NULL) < 0)
+			"l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
+	if (info.change_mask & PW_LINK_CHANGE_MASK_OUTPUT) {
 		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value, NULL) < 0)
+				      "i", &info.output_node_id,
+				      "i", &info.output_port_id, NULL) < 0)
 			return false;
 	}
+	if (info.change_mask & PW_LINK_CHANGE_MASK_INPUT) {
+		if (spa_pod_parser_get(&prs,
+				      "i", &info.input_node_id,
+				      "i", &info.input_port_id, NULL) < 0)
+			return false;
+	}
+	if (info.change_mask & PW_LINK_CHANGE_MASK_FORMAT) {
+		if (spa_pod_parser_get(&prs, "P", &info.format, NULL) < 0)
+			return false;
+	}
+	if (info.change_mask & PW_LINK_CHANGE_MASK_PROPS) {
+		if (spa_pod_parser_get(&prs, "i", &props.n_items, NULL) < 0)
+			return false;
+
+		info.props = &props;
+		props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+		for (i = 0; i < props.n_items; i++) {
+			if (spa_pod_parser_get(&prs,
+					       "s", &props.items[i].key,
+					       "s", &props.items[i].value, NULL) < 0)
+				return false;
+		}
+	}
 	pw_proxy_notify(proxy, struct pw_link_proxy_events, info, &info);
 	return true;
 }
@@ -961,7 +1085,8 @@ static const struct pw_core_proxy_methods pw_protocol_native_core_method_marshal
 	&core_marshal_get_registry,
 	&core_marshal_client_update,
 	&core_marshal_create_object,
-	&core_marshal_create_link
+	&core_marshal_create_link,
+	&core_marshal_get_registry_snapshot,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_demarshal[PW_CORE_PROXY_METHOD_NUM] = {
@@ -970,7 +1095,8 @@ static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_
 	{ &core_demarshal_get_registry, 0, },
 	{ &core_demarshal_client_update, 0, },
 	{ &core_demarshal_create_object, PW_PROTOCOL_NATIVE_REMAP, },
-	{ &core_demarshal_create_link, PW_PROTOCOL_NATIVE_REMAP, }
+	{ &core_demarshal_create_link, PW_PROTOCOL_NATIVE_REMAP, },
+	{ &core_demarshal_get_registry_snapshot, 0, },
 };
 
 static const struct pw_core_proxy_events pw_protocol_native_core_event_marshal = {
@@ -979,7 +1105,8 @@ static const struct pw_core_proxy_events pw_protocol_native_core_event_marshal =
 	&core_marshal_done,
 	&core_marshal_error,
 	&core_marshal_remove_id,
-	&core_marshal_info
+	&core_marshal_info,
+	&core_marshal_registry_snapshot,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_core_event_demarshal[PW_CORE_PROXY_EVENT_NUM] = {
@@ -988,6 +1115,7 @@ static const struct pw_protocol_native_demarshal pw_protocol_native_core_event_d
 	{ &core_demarshal_error, 0, },
 	{ &core_demarshal_remove_id, 0, },
 	{ &core_demarshal_info, 0, },
+	{ &core_demarshal_registry_snapshot, 0, },
 };
 
 static const struct pw_protocol_marshal pw_protocol_native_core_marshal = {
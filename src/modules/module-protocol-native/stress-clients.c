@@ -0,0 +1,261 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/interfaces.h>
+
+/* Connects many clients to the daemon, some of which read their socket
+ * very slowly, and checks that the fast clients are not delayed by the
+ * slow ones and that the daemon drops clients that fall too far behind. */
+
+#define DEFAULT_CLIENTS		1000
+#define DEFAULT_ROUNDS		20
+#define SLOW_DELAY_MSEC		50
+#define SLOW_RCVBUF		4096
+
+struct data;
+
+struct client {
+	struct data *data;
+	bool slow;
+
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	struct pw_core_proxy *core_proxy;
+	struct spa_hook core_listener;
+
+	uint32_t round;
+	bool finished;
+	bool failed;
+};
+
+struct data {
+	struct pw_loop *fast_loop;
+	struct pw_core *fast_core;
+	struct pw_loop *slow_loop;
+	struct pw_core *slow_core;
+
+	uint32_t n_rounds;
+	uint32_t n_clients;
+	struct client *clients;
+
+	uint32_t fast_pending;
+	uint32_t fast_finished;
+	uint32_t slow_finished;
+	uint32_t n_failed;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void client_finish(struct client *c, bool failed)
+{
+	struct data *d = c->data;
+
+	if (c->finished)
+		return;
+	c->finished = true;
+	c->failed = failed;
+
+	if (failed)
+		d->n_failed++;
+	else if (c->slow)
+		d->slow_finished++;
+	else
+		d->fast_finished++;
+
+	if (!c->slow)
+		d->fast_pending--;
+}
+
+static void client_next_round(struct client *c)
+{
+	struct pw_type *t = pw_core_get_type(c->slow ? c->data->slow_core : c->data->fast_core);
+
+	if (c->round++ == c->data->n_rounds) {
+		client_finish(c, false);
+		return;
+	}
+	/* every new registry makes the daemon send all globals again */
+	pw_core_proxy_get_registry(c->core_proxy, t->registry, PW_VERSION_REGISTRY, 0);
+	pw_core_proxy_sync(c->core_proxy, c->round);
+}
+
+static void on_core_done(void *data, uint32_t seq)
+{
+	struct client *c = data;
+
+	if (seq == c->round)
+		client_next_round(c);
+}
+
+static const struct pw_core_proxy_events core_events = {
+	PW_VERSION_CORE_PROXY_EVENTS,
+	.done = on_core_done,
+};
+
+static void on_state_changed(void *data, enum pw_remote_state old,
+			     enum pw_remote_state state, const char *error)
+{
+	struct client *c = data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+	case PW_REMOTE_STATE_UNCONNECTED:
+		client_finish(c, true);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		c->core_proxy = pw_remote_get_core_proxy(c->remote);
+		pw_core_proxy_add_listener(c->core_proxy, &c->core_listener, &core_events, c);
+		client_next_round(c);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_state_changed,
+};
+
+static int connect_socket(bool slow)
+{
+	struct sockaddr_un addr = { 0 };
+	const char *runtime_dir, *name;
+	int fd, rcvbuf = SLOW_RCVBUF;
+
+	if ((runtime_dir = getenv("XDG_RUNTIME_DIR")) == NULL)
+		return -ENOENT;
+	if ((name = getenv("PIPEWIRE_REMOTE")) == NULL)
+		name = "pipewire-0";
+
+	if ((fd = socket(PF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+		return -errno;
+
+	/* make the slow clients fill up their socket quickly */
+	if (slow)
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	addr.sun_family = AF_LOCAL;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s", runtime_dir, name);
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -errno;
+	}
+	return fd;
+}
+
+static int client_init(struct data *d, struct client *c, bool slow)
+{
+	int fd;
+
+	c->data = d;
+	c->slow = slow;
+	c->remote = pw_remote_new(slow ? d->slow_core : d->fast_core, NULL, 0);
+	if (c->remote == NULL)
+		return -ENOMEM;
+
+	pw_remote_add_listener(c->remote, &c->remote_listener, &remote_events, c);
+
+	if ((fd = connect_socket(slow)) < 0)
+		return fd;
+
+	if (!slow)
+		d->fast_pending++;
+
+	return pw_remote_connect_fd(c->remote, fd);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	uint64_t start, elapsed, next_slow;
+	uint32_t i;
+	int res;
+
+	pw_init(&argc, &argv);
+
+	data.n_clients = argc > 1 ? atoi(argv[1]) : DEFAULT_CLIENTS;
+	data.n_rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+	data.clients = calloc(data.n_clients, sizeof(struct client));
+
+	data.fast_loop = pw_loop_new(NULL);
+	data.fast_core = pw_core_new(data.fast_loop, NULL);
+	data.slow_loop = pw_loop_new(NULL);
+	data.slow_core = pw_core_new(data.slow_loop, NULL);
+
+	pw_loop_enter(data.fast_loop);
+	pw_loop_enter(data.slow_loop);
+
+	/* one in ten clients is fast, the others are slow readers */
+	for (i = 0; i < data.n_clients; i++) {
+		if ((res = client_init(&data, &data.clients[i], i % 10 != 0)) < 0) {
+			fprintf(stderr, "can't connect client %u: %s\n", i, spa_strerror(res));
+			return -1;
+		}
+	}
+
+	start = next_slow = get_time();
+	while (data.fast_pending > 0) {
+		pw_loop_iterate(data.fast_loop, SLOW_DELAY_MSEC);
+
+		if (get_time() >= next_slow) {
+			pw_loop_iterate(data.slow_loop, 0);
+			next_slow = get_time() + SLOW_DELAY_MSEC * SPA_NSEC_PER_MSEC;
+		}
+	}
+	elapsed = get_time() - start;
+
+	printf("clients: %u, rounds: %u\n", data.n_clients, data.n_rounds);
+	printf("fast clients finished in %f seconds\n", (double) elapsed / SPA_NSEC_PER_SEC);
+	printf("finished: %u fast, %u slow\n", data.fast_finished, data.slow_finished);
+	printf("failed: %u\n", data.n_failed);
+
+	for (i = 0; i < data.n_clients; i++)
+		pw_remote_destroy(data.clients[i].remote);
+
+	pw_loop_leave(data.slow_loop);
+	pw_loop_leave(data.fast_loop);
+
+	pw_core_destroy(data.slow_core);
+	pw_core_destroy(data.fast_core);
+	pw_loop_destroy(data.slow_loop);
+	pw_loop_destroy(data.fast_loop);
+	free(data.clients);
+
+	return 0;
+}
@@ -69,7 +69,7 @@ client_bind_func(struct pw_global *global,
 
 	spa_list_append(&this->resource_list, &resource->link);
 
-	this->info.change_mask = ~0;
+	this->info.change_mask = PW_CLIENT_CHANGE_MASK_ALL;
 	pw_client_resource_info(resource, &this->info);
 	this->info.change_mask = 0;
 
@@ -130,6 +130,7 @@ struct pw_client *pw_client_new(struct pw_core *core,
 
 	pw_map_init(&this->objects, 0, 32);
 	pw_map_init(&this->types, 0, 32);
+	pw_array_init(&this->permission_cache, 64);
 
 	this->info.props = this->properties ? &this->properties->dict : NULL;
 
@@ -220,8 +221,12 @@ void pw_client_destroy(struct pw_client *client)
 	spa_hook_list_call(&client->listener_list, struct pw_client_events, free);
 	pw_log_debug("client %p: free", impl);
 
+	/* the client could still have the buffer memory of its links mapped */
+	pw_mempool_remove_user(client->core->mempool, client);
+
 	pw_map_clear(&client->objects);
 	pw_map_clear(&client->types);
+	pw_array_clear(&client->permission_cache);
 
 	if (client->properties)
 		pw_properties_free(client->properties);
@@ -229,6 +234,20 @@ void pw_client_destroy(struct pw_client *client)
 	free(impl);
 }
 
+void pw_client_invalidate_permissions(struct pw_client *client, struct pw_global *global)
+{
+	uint32_t *cache;
+
+	if (global == NULL) {
+		client->permission_cache.size = 0;
+		return;
+	}
+	if (pw_array_check_index(&client->permission_cache, global->id, uint32_t)) {
+		cache = pw_array_get_unchecked(&client->permission_cache, global->id, uint32_t);
+		*cache = 0;
+	}
+}
+
 void pw_client_add_listener(struct pw_client *client,
 			    struct spa_hook *listener,
 			    const struct pw_client_events *events,
@@ -256,14 +275,30 @@ const struct pw_client_info *pw_client_get_info(struct pw_client *client)
 void pw_client_update_properties(struct pw_client *client, const struct spa_dict *dict)
 {
 	struct pw_resource *resource;
+	struct pw_client_info info;
+	struct spa_dict changed = { 0, };
+	struct spa_dict_item *items;
+	uint32_t i, n_items = dict ? dict->n_items : 0;
+
+	/* collect the keys that really change, only those are sent to the
+	 * resources */
+	changed.items = items = alloca(n_items * sizeof(struct spa_dict_item));
+	for (i = 0; i < n_items; i++) {
+		const char *old = client->properties ?
+			pw_properties_get(client->properties, dict->items[i].key) : NULL;
+		const char *value = dict->items[i].value;
+
+		if (old == value || (old && value && strcmp(old, value) == 0))
+			continue;
+		items[changed.n_items++] = dict->items[i];
+	}
+	if (changed.n_items == 0)
+		return;
 
 	if (client->properties == NULL) {
-		if (dict)
-			client->properties = pw_properties_new_dict(dict);
+		client->properties = pw_properties_new_dict(dict);
 	} else {
-		uint32_t i;
-
-		for (i = 0; i < dict->n_items; i++)
+		for (i = 0; i < n_items; i++)
 			pw_properties_set(client->properties,
 					  dict->items[i].key, dict->items[i].value);
 	}
@@ -271,10 +306,19 @@ void pw_client_update_properties(struct pw_client *client, const struct spa_dict
 	client->info.change_mask |= PW_CLIENT_CHANGE_MASK_PROPS;
 	client->info.props = client->properties ? &client->properties->dict : NULL;
 
+	/* the permissions might depend on the properties */
+	pw_client_invalidate_permissions(client, NULL);
+
 	spa_hook_list_call(&client->listener_list, struct pw_client_events, info_changed, &client->info);
 
+	info = client->info;
+	info.change_mask |= PW_CLIENT_CHANGE_MASK_PROPS_DELTA;
+	info.props = &changed;
+
 	spa_list_for_each(resource, &client->resource_list, link)
-		pw_client_resource_info(resource, &client->info);
+		pw_client_resource_info(resource, &info);
+
+	pw_core_registry_snapshot_changed(client->core);
 
 	client->info.change_mask = 0;
 }
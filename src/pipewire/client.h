@@ -173,6 +173,11 @@ void pw_client_add_listener(struct pw_client *client,
   * started and no further processing is allowed to happen for the client */
 void pw_client_set_busy(struct pw_client *client, bool busy);
 
+/** Forget the cached permissions of the client for \a global or for all
+  * globals when \a global is NULL. Call this when the permission callback
+  * would return a different result for the client */
+void pw_client_invalidate_permissions(struct pw_client *client, struct pw_global *global);
+
 #ifdef __cplusplus
 }
 #endif
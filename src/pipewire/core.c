@@ -17,6 +17,8 @@
  * Boston, MA 02110-1301, USA.
  */
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdio.h>
@@ -36,9 +38,26 @@
 
 /** \cond */
 struct resource_data {
+	struct pw_resource *resource;
+	struct spa_hook resource_listener;
+	struct spa_list snapshot_link;	/**< link in core snapshot subscriber_list */
+	bool snapshot;			/**< the client uses the registry snapshot */
+};
+
+struct registry_data {
 	struct spa_hook resource_listener;
+	struct pw_registry_sync sync;
 };
 
+/** max number of globals to send to a new registry in one loop iteration */
+#define REGISTRY_BATCH	128
+
+/** minimum size of the registry snapshot memory */
+#define SNAPSHOT_MIN_SIZE	(16 * 1024)
+
+/** default number of free link buffer slabs to keep */
+#define DEFAULT_MEMPOOL_MAX_FREE	16
+
 /** \endcond */
 
 static void registry_bind(void *object, uint32_t id,
@@ -90,7 +109,12 @@ static const struct pw_registry_proxy_methods registry_methods = {
 static void destroy_registry_resource(void *object)
 {
 	struct pw_resource *resource = object;
-	spa_list_remove(&resource->link);
+	struct registry_data *data = pw_resource_get_user_data(resource);
+
+	if (data->sync.resource)
+		spa_list_remove(&data->sync.link);
+	else
+		spa_list_remove(&resource->link);
 }
 
 static const struct pw_resource_events resource_events = {
@@ -112,14 +136,95 @@ static void core_sync(void *object, uint32_t seq)
 	pw_core_resource_done(resource, seq);
 }
 
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* send the next batch of globals, returns true when all globals are sent */
+static bool registry_sync_batch(struct pw_core *core, struct pw_registry_sync *sync)
+{
+	struct pw_client *client = sync->resource->client;
+	struct pw_global *global = sync->next;
+	uint32_t n_globals;
+
+	for (n_globals = 0; global && n_globals < REGISTRY_BATCH; n_globals++) {
+		uint32_t permissions = pw_global_get_permissions(global, client);
+		if (PW_PERM_IS_R(permissions)) {
+			pw_registry_resource_global(sync->resource,
+						    global->id,
+						    global->parent->id,
+						    permissions,
+						    global->type,
+						    global->version);
+		}
+		if (global->link.next == &core->global_list)
+			global = NULL;
+		else
+			global = SPA_CONTAINER_OF(global->link.next, struct pw_global, link);
+	}
+	sync->next = global;
+	sync->n_batches++;
+
+	core->stats.n_registry_batches++;
+	core->stats.n_registry_globals += n_globals;
+
+	return global == NULL;
+}
+
+static void registry_sync_done(struct pw_core *core, struct pw_registry_sync *sync)
+{
+	struct pw_resource *resource = sync->resource;
+	uint64_t elapsed = get_time() - sync->start;
+
+	sync->resource = NULL;
+	spa_list_append(&core->registry_resource_list, &resource->link);
+
+	core->stats.last_sync_time = elapsed;
+	core->stats.max_sync_time = SPA_MAX(core->stats.max_sync_time, elapsed);
+
+	pw_log_debug("core %p: registry %p synced in %u batches, %"PRIu64" nsec", core,
+		     resource, sync->n_batches, elapsed);
+}
+
+static void do_registry_sync(void *data)
+{
+	struct pw_core *this = data;
+	struct pw_registry_sync *sync, *t;
+	struct spa_list done;
+
+	spa_list_init(&done);
+
+	spa_list_for_each_safe(sync, t, &this->registry_sync_list, link) {
+		if (registry_sync_batch(this, sync)) {
+			spa_list_remove(&sync->link);
+			spa_list_append(&done, &sync->link);
+		}
+	}
+	if (spa_list_is_empty(&this->registry_sync_list))
+		pw_loop_enable_idle(this->main_loop, this->registry_sync_source, false);
+
+	/* the clients can process messages again, this might add or remove
+	 * registries so do this after walking the list */
+	spa_list_for_each_safe(sync, t, &done, link) {
+		struct pw_client *client = sync->resource->client;
+
+		spa_list_remove(&sync->link);
+		registry_sync_done(this, sync);
+		pw_client_set_busy(client, false);
+	}
+}
+
 static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
 {
 	struct pw_resource *resource = object;
 	struct pw_client *client = resource->client;
 	struct pw_core *this = resource->core;
-	struct pw_global *global;
 	struct pw_resource *registry_resource;
-	struct resource_data *data;
+	struct registry_data *data;
+	struct pw_registry_sync *sync;
 
 	registry_resource = pw_resource_new(client,
 					    new_id,
@@ -140,20 +245,26 @@ static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
 				       &registry_methods,
 				       registry_resource);
 
-	spa_list_append(&this->registry_resource_list, &registry_resource->link);
+	this->stats.n_registry_syncs++;
 
-	spa_list_for_each(global, &this->global_list, link) {
-		uint32_t permissions = pw_global_get_permissions(global, client);
-		if (PW_PERM_IS_R(permissions)) {
-			pw_registry_resource_global(registry_resource,
-						    global->id,
-						    global->parent->id,
-						    permissions,
-						    global->type,
-						    global->version);
-		}
+	sync = &data->sync;
+	sync->resource = registry_resource;
+	sync->start = get_time();
+	sync->next = spa_list_is_empty(&this->global_list) ? NULL :
+		spa_list_first(&this->global_list, struct pw_global, link);
+
+	if (registry_sync_batch(this, sync)) {
+		registry_sync_done(this, sync);
+		return;
 	}
 
+	/* send the remaining globals from the main loop, in batches. The client
+	 * is busy until then so that a sync is only answered after all globals
+	 * were sent */
+	spa_list_append(&this->registry_sync_list, &sync->link);
+	pw_loop_enable_idle(this->main_loop, this->registry_sync_source, true);
+	pw_client_set_busy(client, true);
+
 	return;
 
       no_mem:
@@ -162,6 +273,287 @@ static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
 			       resource->id, -ENOMEM, "no memory");
 }
 
+static const struct spa_dict *global_get_props(struct pw_core *core, struct pw_global *global)
+{
+	struct pw_type *t = &core->type;
+	const struct pw_properties *props = NULL;
+
+	if (global->type == t->core)
+		props = core->properties;
+	else if (global->type == t->node)
+		props = ((struct pw_node *) global->object)->properties;
+	else if (global->type == t->client)
+		props = ((struct pw_client *) global->object)->properties;
+	else if (global->type == t->link)
+		props = ((struct pw_link *) global->object)->properties;
+	else if (global->type == t->factory)
+		props = ((struct pw_factory *) global->object)->properties;
+	else if (global->type == t->module)
+		return ((struct pw_module *) global->object)->info.props;
+
+	return props ? &props->dict : NULL;
+}
+
+/* the snapshot is shared by all clients, only clients that can see all
+ * globals can use it */
+static bool snapshot_allowed(struct pw_core *core, struct pw_client *client)
+{
+	struct pw_global *global;
+
+	if (core->permission_func == NULL)
+		return true;
+
+	spa_list_for_each(global, &core->global_list, link) {
+		if (!PW_PERM_IS_R(pw_global_get_permissions(global, client)))
+			return false;
+	}
+	return true;
+}
+
+/* serialize the globals into the snapshot data, returns the number of globals */
+static int snapshot_serialize(struct pw_core *core)
+{
+	struct pw_array *data = &core->snapshot.data;
+	struct pw_global *global;
+	int n_globals = 0;
+
+	data->size = 0;
+
+	spa_list_for_each(global, &core->global_list, link) {
+		const struct spa_dict *props = global_get_props(core, global);
+		const char *type = spa_type_map_get_type(core->type.map, global->type);
+		struct pw_registry_snapshot_global *g;
+		uint32_t i, n_props = 0;
+		size_t size;
+		char *p;
+
+		if (type == NULL)
+			type = "";
+
+		size = sizeof(*g) + strlen(type) + 1;
+		for (i = 0; props && i < props->n_items; i++) {
+			if (props->items[i].value == NULL)
+				continue;
+			size += strlen(props->items[i].key) + strlen(props->items[i].value) + 2;
+			n_props++;
+		}
+		size = SPA_ROUND_UP_N(size, 8);
+
+		if ((g = pw_array_add(data, size)) == NULL)
+			return -ENOMEM;
+
+		g->size = size;
+		g->id = global->id;
+		g->parent_id = global->parent->id;
+		g->version = global->version;
+		g->n_props = n_props;
+		g->padding = 0;
+
+		p = stpcpy(SPA_MEMBER(g, sizeof(*g), char), type) + 1;
+		for (i = 0; props && i < props->n_items; i++) {
+			if (props->items[i].value == NULL)
+				continue;
+			p = stpcpy(p, props->items[i].key) + 1;
+			p = stpcpy(p, props->items[i].value) + 1;
+		}
+		memset(p, 0, SPA_MEMBER(g, size, char) - p);
+
+		n_globals++;
+	}
+	return n_globals;
+}
+
+static void snapshot_free(struct pw_core *core)
+{
+	if (core->snapshot.mem.ptr)
+		pw_memblock_free(&core->snapshot.mem);
+	if (core->snapshot.fd != -1)
+		close(core->snapshot.fd);
+	core->snapshot.fd = -1;
+}
+
+static int snapshot_alloc(struct pw_core *core, size_t size)
+{
+	struct pw_memblock mem;
+	struct pw_registry_snapshot *snap;
+	char path[64];
+	int fd, res;
+
+	/* leave room to grow */
+	size = SPA_ROUND_UP_N(SPA_MAX(size + size / 2, SNAPSHOT_MIN_SIZE), 4096);
+
+	if ((res = pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
+				     PW_MEMBLOCK_FLAG_MAP_READWRITE |
+				     PW_MEMBLOCK_FLAG_SEAL |
+				     PW_MEMBLOCK_FLAG_SEAL_WRITE, size, &mem)) < 0) {
+		/* without the write seal clients could change the snapshot of
+		 * the others, don't offer it at all */
+		if (res == -ENOTSUP) {
+			pw_log_warn("core %p: registry snapshot disabled, memory can't be sealed",
+				    core);
+			core->snapshot.unsupported = true;
+		}
+		return res;
+	}
+
+	/* the memory is sealed against writes from other mappings, clients
+	 * also get a read-only fd so that they can't modify the snapshot
+	 * of the others */
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", mem.fd);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		res = -errno;
+		pw_memblock_free(&mem);
+		return res;
+	}
+
+	snap = mem.ptr;
+	snap->magic = PW_REGISTRY_SNAPSHOT_MAGIC;
+	snap->version = PW_REGISTRY_SNAPSHOT_VERSION;
+	snap->seq = core->snapshot.seq;
+	snap->n_globals = 0;
+	snap->serial = 0;
+	snap->size = sizeof(*snap);
+	snap->padding = 0;
+
+	snapshot_free(core);
+	core->snapshot.mem = mem;
+	core->snapshot.fd = fd;
+
+	return 0;
+}
+
+static void snapshot_write(struct pw_core *core, uint32_t n_globals)
+{
+	struct pw_registry_snapshot *snap = core->snapshot.mem.ptr;
+	struct pw_array *data = &core->snapshot.data;
+	/* never read the sequence back from shared memory */
+	uint32_t seq = core->snapshot.seq;
+
+	__atomic_store_n(&snap->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(SPA_MEMBER(snap, sizeof(*snap), void), data->data, data->size);
+	snap->n_globals = n_globals;
+	snap->serial = ++core->snapshot.serial;
+	snap->size = sizeof(*snap) + data->size;
+
+	__atomic_store_n(&snap->seq, seq + 2, __ATOMIC_RELEASE);
+	core->snapshot.seq = seq + 2;
+}
+
+static void snapshot_publish(struct pw_core *core)
+{
+	struct resource_data *data, *t;
+	bool new_fd = false;
+	size_t size;
+	int res;
+
+	core->snapshot.dirty = false;
+	pw_loop_enable_idle(core->main_loop, core->snapshot.source, false);
+
+	/* the permissions might have changed. Clients that can't see all globals
+	 * anymore are removed and the others move to a new memfd so that the
+	 * removed clients don't see the updates */
+	spa_list_for_each_safe(data, t, &core->snapshot.subscriber_list, snapshot_link) {
+		struct pw_resource *resource = data->resource;
+
+		if (snapshot_allowed(core, resource->client))
+			continue;
+
+		spa_list_remove(&data->snapshot_link);
+		data->snapshot = false;
+		new_fd = true;
+
+		pw_core_resource_error(resource, resource->id, -EACCES,
+				       "registry snapshot access revoked");
+	}
+
+	if ((res = snapshot_serialize(core)) < 0)
+		goto error;
+
+	size = sizeof(struct pw_registry_snapshot) + core->snapshot.data.size;
+
+	if (new_fd || core->snapshot.mem.ptr == NULL || size > core->snapshot.mem.size) {
+		if ((res = snapshot_alloc(core, size)) < 0)
+			goto error;
+		new_fd = true;
+	}
+	snapshot_write(core, res);
+
+	pw_log_trace("core %p: registry snapshot %"PRIu64", %d globals, %zd bytes", core,
+		     core->snapshot.serial, res, size);
+
+	spa_list_for_each(data, &core->snapshot.subscriber_list, snapshot_link)
+		pw_core_resource_registry_snapshot(data->resource,
+						   new_fd ? core->snapshot.fd : -1,
+						   core->snapshot.mem.size,
+						   core->snapshot.serial);
+	return;
+
+      error:
+	pw_log_error("core %p: can't update registry snapshot: %s", core, strerror(-res));
+}
+
+static void do_registry_snapshot(void *data)
+{
+	struct pw_core *this = data;
+	snapshot_publish(this);
+}
+
+/** Schedule an update of the registry snapshot
+ *
+ * \param core a core
+ *
+ * Mark the snapshot as outdated. When there are clients using the
+ * snapshot, it is updated from the main loop so that many changes are
+ * combined into one update.
+ */
+void pw_core_registry_snapshot_changed(struct pw_core *core)
+{
+	core->snapshot.dirty = true;
+
+	if (!spa_list_is_empty(&core->snapshot.subscriber_list))
+		pw_loop_enable_idle(core->main_loop, core->snapshot.source, true);
+}
+
+static void core_get_registry_snapshot(void *object)
+{
+	struct pw_resource *resource = object;
+	struct pw_core *this = resource->core;
+	struct resource_data *data = pw_resource_get_user_data(resource);
+
+	if (!snapshot_allowed(this, resource->client)) {
+		pw_core_resource_error(resource, resource->id, -EACCES,
+				       "no permission for the registry snapshot");
+		return;
+	}
+
+	if (!this->snapshot.unsupported &&
+	    (this->snapshot.dirty || this->snapshot.mem.ptr == NULL))
+		snapshot_publish(this);
+
+	if (this->snapshot.unsupported) {
+		pw_core_resource_error(resource, resource->id, -ENOTSUP,
+				       "registry snapshot not supported");
+		return;
+	}
+
+	if (this->snapshot.mem.ptr == NULL) {
+		pw_core_resource_error(resource, resource->id, -ENOMEM,
+				       "can't create registry snapshot");
+		return;
+	}
+
+	if (!data->snapshot) {
+		spa_list_append(&this->snapshot.subscriber_list, &data->snapshot_link);
+		data->snapshot = true;
+	}
+	pw_core_resource_registry_snapshot(resource,
+					   this->snapshot.fd,
+					   this->snapshot.mem.size,
+					   this->snapshot.serial);
+}
+
 static void
 core_create_object(void *object,
 		   const char *factory_name,
@@ -331,14 +723,28 @@ static const struct pw_core_proxy_methods core_methods = {
 	.get_registry = core_get_registry,
 	.client_update = core_client_update,
 	.create_object = core_create_object,
-	.create_link = core_create_link
+	.create_link = core_create_link,
+	.get_registry_snapshot = core_get_registry_snapshot,
 };
 
 static void core_unbind_func(void *data)
 {
 	struct pw_resource *resource = data;
+	struct pw_core *core = resource->core;
+	struct resource_data *d = pw_resource_get_user_data(resource);
+
 	resource->client->core_resource = NULL;
 	spa_list_remove(&resource->link);
+
+	if (d->snapshot) {
+		spa_list_remove(&d->snapshot_link);
+		/* no more users, free the memory until the next request */
+		if (spa_list_is_empty(&core->snapshot.subscriber_list)) {
+			pw_loop_enable_idle(core->main_loop, core->snapshot.source, false);
+			snapshot_free(core);
+			core->snapshot.dirty = true;
+		}
+	}
 }
 
 static const struct pw_resource_events core_resource_events = {
@@ -362,6 +768,7 @@ core_bind_func(struct pw_global *global,
 		goto no_mem;
 
 	data = pw_resource_get_user_data(resource);
+	data->resource = resource;
 	pw_resource_add_listener(resource, &data->resource_listener, &core_resource_events, resource);
 
 	pw_resource_set_implementation(resource, &core_methods, resource);
@@ -434,6 +841,7 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	spa_list_init(&this->remote_list);
 	spa_list_init(&this->resource_list);
 	spa_list_init(&this->registry_resource_list);
+	spa_list_init(&this->registry_sync_list);
 	spa_list_init(&this->global_list);
 	spa_list_init(&this->module_list);
 	spa_list_init(&this->client_list);
@@ -442,6 +850,41 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	spa_list_init(&this->link_list);
 	spa_hook_list_init(&this->listener_list);
 
+	this->registry_sync_source = pw_loop_add_idle(this->main_loop, false,
+						      do_registry_sync, this);
+
+	spa_list_init(&this->snapshot.subscriber_list);
+	pw_array_init(&this->snapshot.data, 4096);
+	this->snapshot.mem.fd = -1;
+	this->snapshot.fd = -1;
+	this->snapshot.source = pw_loop_add_idle(this->main_loop, false,
+						 do_registry_snapshot, this);
+
+	{
+		enum pw_mempool_flags flags = PW_MEMPOOL_FLAG_NONE;
+		uint32_t max_free = DEFAULT_MEMPOOL_MAX_FREE;
+		const char *str;
+
+		if ((str = pw_properties_get(properties, PW_CORE_PROP_MEMPOOL_MAX_FREE)))
+			max_free = pw_properties_parse_int(str);
+		if ((str = pw_properties_get(properties, PW_CORE_PROP_MEMPOOL_HUGEPAGES)) &&
+		    pw_properties_parse_bool(str))
+			flags |= PW_MEMPOOL_FLAG_HUGEPAGES;
+		if ((str = pw_properties_get(properties, PW_CORE_PROP_MEMPOOL_POPULATE)) &&
+		    pw_properties_parse_bool(str))
+			flags |= PW_MEMPOOL_FLAG_POPULATE;
+
+		this->mempool = pw_mempool_new(flags, max_free);
+
+		/* the data loop is started, its thread processes the buffers. The
+		 * thread is not pinned, the node is only meaningful when the
+		 * process is bound to one node */
+		str = pw_properties_get(properties, PW_CORE_PROP_MEMPOOL_NUMA);
+		if (this->mempool && str && pw_properties_parse_bool(str))
+			pw_mempool_set_numa_node(this->mempool,
+					pw_data_loop_get_numa_node(this->data_loop_impl));
+	}
+
 	if ((name = pw_properties_get(properties, PW_CORE_PROP_NAME)) == NULL) {
 		pw_properties_setf(properties,
 				   PW_CORE_PROP_NAME, "pipewire-%s-%d",
@@ -505,6 +948,12 @@ void pw_core_destroy(struct pw_core *core)
 
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, free);
 
+	pw_loop_destroy_source(core->main_loop, core->registry_sync_source);
+	pw_loop_destroy_source(core->main_loop, core->snapshot.source);
+	snapshot_free(core);
+	pw_array_clear(&core->snapshot.data);
+	if (core->mempool)
+		pw_mempool_destroy(core->mempool);
 	pw_data_loop_destroy(core->data_loop_impl);
 
 	pw_properties_free(core->properties);
@@ -537,8 +986,30 @@ void pw_core_set_permission_callback(struct pw_core *core,
 				     pw_permission_func_t callback,
 				     void *data)
 {
+	struct pw_client *client;
+
 	core->permission_func = callback;
 	core->permission_data = data;
+
+	spa_list_for_each(client, &core->client_list, link)
+		pw_client_invalidate_permissions(client, NULL);
+
+	pw_core_registry_snapshot_changed(core);
+}
+
+const struct pw_core_stats *pw_core_get_stats(struct pw_core *core)
+{
+	return &core->stats;
+}
+
+/** Get the memory pool of a core
+ * \param core a core
+ * \return the \ref pw_mempool used for link buffers, can be NULL
+ * \memberof pw_core
+ */
+struct pw_mempool *pw_core_get_mempool(struct pw_core *core)
+{
+	return core->mempool;
 }
 
 struct pw_type *pw_core_get_type(struct pw_core *core)
@@ -588,6 +1059,8 @@ void pw_core_update_properties(struct pw_core *core, const struct spa_dict *dict
 		pw_core_resource_info(resource, &core->info);
 
 	core->info.change_mask = 0;
+
+	pw_core_registry_snapshot_changed(core);
 }
 
 bool pw_core_for_each_global(struct pw_core *core,
@@ -45,6 +45,7 @@ struct pw_core;
 #include <pipewire/factory.h>
 #include <pipewire/port.h>
 #include <pipewire/properties.h>
+#include <pipewire/mem.h>
 
 /** \page page_core_api Core API
  *
@@ -105,12 +106,33 @@ struct pw_core_events {
 	void (*global_removed) (void *data, struct pw_global *global);
 };
 
+/** registry and permission statistics of a core, see \ref pw_core_get_stats */
+struct pw_core_stats {
+	uint64_t n_registry_syncs;	/**< number of registries bound */
+	uint64_t n_registry_batches;	/**< batches used to send the initial globals */
+	uint64_t n_registry_globals;	/**< globals sent to new registries */
+	uint64_t last_sync_time;	/**< nsec to send all globals to the last registry */
+	uint64_t max_sync_time;		/**< max nsec to send all globals to a registry */
+	uint64_t permission_hits;	/**< permission checks answered from the cache */
+	uint64_t permission_misses;	/**< permission checks that called the permission callback */
+};
+
 /** The name of the core. Default is pipewire-<user-name>-<pid> */
 #define PW_CORE_PROP_NAME	"pipewire.core.name"
 /** The version of the core. */
 #define PW_CORE_PROP_VERSION	"pipewire.core.version"
 /** If the core should listen for connections, boolean default false */
 #define PW_CORE_PROP_DAEMON	"pipewire.daemon"
+/** Max number of free link buffer memory slabs to keep for reuse, default 16 */
+#define PW_CORE_PROP_MEMPOOL_MAX_FREE	"pipewire.mempool.max-free"
+/** If large link buffer memory slabs should use huge pages, boolean default false */
+#define PW_CORE_PROP_MEMPOOL_HUGEPAGES	"pipewire.mempool.hugepages"
+/** If link buffer memory should be prefaulted, boolean default false */
+#define PW_CORE_PROP_MEMPOOL_POPULATE	"pipewire.mempool.populate"
+/** If link buffer memory should be placed on the NUMA node of the data loop,
+ * boolean default false. Only enable this when the process is bound to the
+ * CPUs of one node, the data loop thread is not pinned */
+#define PW_CORE_PROP_MEMPOOL_NUMA	"pipewire.mempool.numa"
 
 /** Make a new core object for a given main_loop. Ownership of the properties is taken */
 struct pw_core * pw_core_new(struct pw_loop *main_loop, struct pw_properties *props);
@@ -130,6 +152,12 @@ void pw_core_set_permission_callback(struct pw_core *core,
 				     pw_permission_func_t callback,
 				     void *data);
 
+/** Get the registry and permission statistics of a core */
+const struct pw_core_stats *pw_core_get_stats(struct pw_core *core);
+
+/** Get the memory pool used for link buffers */
+struct pw_mempool *pw_core_get_mempool(struct pw_core *core);
+
 /** Get the type object of a core */
 struct pw_type *pw_core_get_type(struct pw_core *core);
 
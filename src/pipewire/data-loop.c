@@ -20,53 +20,139 @@
 #include <pthread.h>
 #include <errno.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "pipewire/log.h"
 #include "pipewire/rtkit.h"
 #include "pipewire/data-loop.h"
 #include "pipewire/private.h"
 
-static void make_realtime(struct pw_data_loop *this)
-{
-	struct sched_param sp;
-	struct pw_rtkit_bus *system_bus;
-	struct rlimit rl;
-	int r, rtprio;
-	long long rttime;
+#define DEFAULT_RT_PRIO		20
+#define DEFAULT_RT_TIME		20000
 
-	rtprio = 20;
-	rttime = 20000;
+static const char *policy_name(int policy)
+{
+	switch (policy & ~SCHED_RESET_ON_FORK) {
+	case SCHED_FIFO:
+		return "SCHED_FIFO";
+	case SCHED_RR:
+		return "SCHED_RR";
+	default:
+		return "SCHED_OTHER";
+	}
+}
 
-	spa_zero(sp);
-	sp.sched_priority = rtprio;
+static void set_rttime(long long rttime)
+{
+	struct rlimit rl;
 
-	if (pthread_setschedparam(pthread_self(), SCHED_OTHER | SCHED_RESET_ON_FORK, &sp) == 0) {
-		pw_log_debug("SCHED_OTHER|SCHED_RESET_ON_FORK worked.");
+	if (rttime < 0)
 		return;
-	}
-	system_bus = pw_rtkit_bus_get_system();
 
 	rl.rlim_cur = rl.rlim_max = rttime;
-	if ((r = setrlimit(RLIMIT_RTTIME, &rl)) < 0)
+	if (setrlimit(RLIMIT_RTTIME, &rl) < 0)
 		pw_log_debug("setrlimit() failed: %s", strerror(errno));
+}
 
-	if (rttime >= 0) {
-		r = getrlimit(RLIMIT_RTTIME, &rl);
-		if (r >= 0 && (long long) rl.rlim_max > rttime) {
-			pw_log_debug("Clamping rlimit-rttime to %lld for RealtimeKit", rttime);
-			rl.rlim_cur = rl.rlim_max = rttime;
+static int make_realtime_rtkit(struct pw_data_loop *this, int *rtprio)
+{
+	struct pw_rtkit_bus *system_bus;
+	long long rttime = this->rt.time, max_rttime;
+	int r, max_prio;
+
+	system_bus = pw_rtkit_bus_get_system();
+	if (system_bus == NULL)
+		return -ENOTSUP;
+
+	/* RealtimeKit refuses the request when our limits exceed its own */
+	max_prio = pw_rtkit_get_max_realtime_priority(system_bus);
+	if (max_prio >= 0 && *rtprio > max_prio) {
+		pw_log_debug("data-loop %p: clamping rtprio %d to %d for RealtimeKit",
+			     this, *rtprio, max_prio);
+		*rtprio = max_prio;
+	}
+	if (*rtprio <= 0) {
+		r = -EPERM;
+		goto done;
+	}
+
+	max_rttime = pw_rtkit_get_rttime_usec_max(system_bus);
+	if (max_rttime >= 0 && (rttime < 0 || rttime > max_rttime)) {
+		rttime = max_rttime;
+		pw_log_debug("data-loop %p: clamping rlimit-rttime to %lld for RealtimeKit",
+			     this, rttime);
+		set_rttime(rttime);
+	}
+
+	r = pw_rtkit_make_realtime(system_bus, 0, *rtprio);
+
+      done:
+	pw_rtkit_bus_free(system_bus);
+	return r;
+}
+
+static void make_realtime(struct pw_data_loop *this)
+{
+	struct sched_param sp;
+	int r, policy, rtprio = this->rt.prio;
 
-			if ((r = setrlimit(RLIMIT_RTTIME, &rl)) < 0)
-				pw_log_debug("setrlimit() failed: %s", strerror(errno));
+	if (this->rt.mlock) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			pw_log_warn("data-loop %p: mlockall() failed: %s", this, strerror(errno));
+		} else {
+			pw_log_debug("data-loop %p: memory locked", this);
 		}
 	}
 
-	if ((r = pw_rtkit_make_realtime(system_bus, 0, rtprio)) < 0) {
-		pw_log_debug("could not make thread realtime: %s", strerror(r));
+	if (rtprio <= 0) {
+		pw_log_debug("data-loop %p: realtime disabled", this);
+		goto done;
+	}
+
+	/* limit the amount of CPU time we can consume without blocking, this
+	 * prevents a runaway realtime thread from locking up the machine */
+	set_rttime(this->rt.time);
+
+	spa_zero(sp);
+	sp.sched_priority = rtprio;
+	if ((r = pthread_setschedparam(pthread_self(), SCHED_FIFO | SCHED_RESET_ON_FORK, &sp)) == 0) {
+		pw_log_debug("data-loop %p: SCHED_FIFO|SCHED_RESET_ON_FORK with priority %d",
+			     this, rtprio);
+		goto done;
+	}
+	pw_log_debug("data-loop %p: SCHED_FIFO failed: %s, trying RealtimeKit",
+		     this, strerror(r));
+
+	if ((r = make_realtime_rtkit(this, &rtprio)) < 0) {
+		pw_log_warn("data-loop %p: could not make thread realtime: %s",
+			    this, strerror(-r));
 	} else {
-		pw_log_debug("thread made realtime");
+		pw_log_debug("data-loop %p: thread made realtime with priority %d",
+			     this, rtprio);
 	}
-	pw_rtkit_bus_free(system_bus);
+
+      done:
+	spa_zero(sp);
+	if (pthread_getschedparam(pthread_self(), &policy, &sp) == 0) {
+		this->rt.policy = policy;
+		this->rt.result_prio = sp.sched_priority;
+	}
+	pw_log_info("data-loop %p: running with %s priority %d", this,
+		    policy_name(this->rt.policy), this->rt.result_prio);
+}
+
+static void get_numa_node(struct pw_data_loop *this)
+{
+	unsigned int cpu, node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0) {
+		this->rt.numa_node = -1;
+		return;
+	}
+	this->rt.numa_node = node;
+	pw_log_debug("data-loop %p: running on cpu %u node %u", this, cpu, node);
 }
 
 static void *do_loop(void *user_data)
@@ -75,6 +161,12 @@ static void *do_loop(void *user_data)
 	int res;
 
 	make_realtime(this);
+	get_numa_node(this);
+
+	pthread_mutex_lock(&this->rt.lock);
+	this->rt.started = true;
+	pthread_cond_signal(&this->rt.cond);
+	pthread_mutex_unlock(&this->rt.lock);
 
 	pw_log_debug("data-loop %p: enter thread", this);
 	pw_loop_enter(this->loop);
@@ -97,6 +189,9 @@ static void do_stop(void *data, uint64_t count)
 }
 
 /** Create a new \ref pw_data_loop.
+ * \param properties extra properties, the realtime settings of the data
+ *	thread are read from these and the result is stored in them when the
+ *	loop is started
  * \return a newly allocated data loop
  *
  * \memberof pw_data_loop
@@ -104,6 +199,7 @@ static void do_stop(void *data, uint64_t count)
 struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 {
 	struct pw_data_loop *this;
+	const char *str;
 
 	this = calloc(1, sizeof(struct pw_data_loop));
 	if (this == NULL)
@@ -117,6 +213,21 @@ struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 
 	spa_hook_list_init(&this->listener_list);
 
+	this->properties = properties;
+	this->rt.prio = DEFAULT_RT_PRIO;
+	this->rt.time = DEFAULT_RT_TIME;
+	if (properties) {
+		if ((str = pw_properties_get(properties, PW_DATA_LOOP_PROP_RT_PRIO)))
+			this->rt.prio = pw_properties_parse_int(str);
+		if ((str = pw_properties_get(properties, PW_DATA_LOOP_PROP_RT_TIME)))
+			this->rt.time = pw_properties_parse_int64(str);
+		if ((str = pw_properties_get(properties, PW_DATA_LOOP_PROP_RT_MLOCK)))
+			this->rt.mlock = pw_properties_parse_bool(str);
+	}
+	this->rt.policy = SCHED_OTHER;
+	pthread_mutex_init(&this->rt.lock, NULL);
+	pthread_cond_init(&this->rt.cond, NULL);
+
 	this->event = pw_loop_add_event(this->loop, do_stop, this);
 
 	return this;
@@ -140,6 +251,8 @@ void pw_data_loop_destroy(struct pw_data_loop *loop)
 
 	pw_loop_destroy_source(loop->loop, loop->event);
 	pw_loop_destroy(loop->loop);
+	pthread_cond_destroy(&loop->rt.cond);
+	pthread_mutex_destroy(&loop->rt.lock);
 	free(loop);
 }
 
@@ -161,7 +274,11 @@ pw_data_loop_get_loop(struct pw_data_loop *loop)
  * \param loop the data loop to start
  * \return 0 if ok, -1 on error
  *
- * This will start the realtime thread that manages the loop.
+ * This will start the realtime thread that manages the loop. This function
+ * returns after the thread has configured its scheduling policy. The result
+ * is stored in the properties of the loop with the
+ * \ref PW_DATA_LOOP_PROP_RT_POLICY and \ref PW_DATA_LOOP_PROP_RT_GRANTED_PRIO
+ * keys, the configured priority is left unchanged.
  *
  * \memberof pw_data_loop
  */
@@ -171,15 +288,40 @@ int pw_data_loop_start(struct pw_data_loop *loop)
 		int err;
 
 		loop->running = true;
+		loop->rt.started = false;
 		if ((err = pthread_create(&loop->thread, NULL, do_loop, loop)) != 0) {
 			pw_log_warn("data-loop %p: can't create thread: %s", loop, strerror(err));
 			loop->running = false;
 			return -err;
 		}
+
+		pthread_mutex_lock(&loop->rt.lock);
+		while (!loop->rt.started)
+			pthread_cond_wait(&loop->rt.cond, &loop->rt.lock);
+		pthread_mutex_unlock(&loop->rt.lock);
+
+		if (loop->properties) {
+			pw_properties_set(loop->properties, PW_DATA_LOOP_PROP_RT_POLICY,
+					  policy_name(loop->rt.policy));
+			pw_properties_setf(loop->properties, PW_DATA_LOOP_PROP_RT_GRANTED_PRIO,
+					   "%d", loop->rt.result_prio);
+		}
 	}
 	return 0;
 }
 
+/** Get the NUMA node of a data loop
+ * \param loop the data loop
+ * \return the NUMA node the thread of \a loop was started on or -1 when
+ *	unknown or the loop is not started
+ *
+ * \memberof pw_data_loop
+ */
+int pw_data_loop_get_numa_node(struct pw_data_loop *loop)
+{
+	return loop->running ? loop->rt.numa_node : -1;
+}
+
 /** Stop a data loop
  * \param loop the data loop to Stop
  * \return 0
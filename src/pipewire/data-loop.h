@@ -44,6 +44,23 @@ struct pw_data_loop_events {
 	void (*destroy) (void *data);
 };
 
+/** The realtime priority of the data thread, default 20. When the priority
+ * can't be set directly, RealtimeKit is used and the priority is clamped to
+ * the maximum it allows. 0 disables realtime scheduling. */
+#define PW_DATA_LOOP_PROP_RT_PRIO	"pipewire.data-loop.rt.prio"
+/** The realtime priority the data thread obtained. Set when the loop is
+ * started. */
+#define PW_DATA_LOOP_PROP_RT_GRANTED_PRIO	"pipewire.data-loop.rt.granted-prio"
+/** The maximum CPU time in microseconds the data thread can consume without
+ * blocking (RLIMIT_RTTIME), default 20000, -1 leaves the limit unchanged. */
+#define PW_DATA_LOOP_PROP_RT_TIME	"pipewire.data-loop.rt.time"
+/** Lock all current and future memory of the process with mlockall() so that
+ * the data thread does not page fault, boolean default false */
+#define PW_DATA_LOOP_PROP_RT_MLOCK	"pipewire.data-loop.rt.mlock"
+/** The scheduling policy of the data thread, SCHED_FIFO, SCHED_RR or
+ * SCHED_OTHER. Set when the loop is started. */
+#define PW_DATA_LOOP_PROP_RT_POLICY	"pipewire.data-loop.rt.policy"
+
 /** Make a new loop */
 struct pw_data_loop *
 pw_data_loop_new(struct pw_properties *properties);
@@ -64,6 +81,9 @@ void pw_data_loop_destroy(struct pw_data_loop *loop);
 /** Start the processing thread */
 int pw_data_loop_start(struct pw_data_loop *loop);
 
+/** Get the NUMA node of the processing thread, -1 when unknown */
+int pw_data_loop_get_numa_node(struct pw_data_loop *loop);
+
 /** Stop the processing thread */
 int pw_data_loop_stop(struct pw_data_loop *loop);
 
@@ -18,6 +18,7 @@
  */
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdio.h>
@@ -33,16 +34,41 @@ struct global_impl {
 	struct pw_global this;
 };
 
+/** marks a valid entry in the permission cache of a client */
+#define PERM_CACHED	(1u << 31)
+
 /** \endcond */
 
 uint32_t pw_global_get_permissions(struct pw_global *global, struct pw_client *client)
 {
 	struct pw_core *core = client->core;
+	struct pw_array *cache = &client->permission_cache;
+	uint32_t *p, len, permissions;
 
 	if (core->permission_func == NULL)
 		return PW_PERM_RWX;
 
-	return core->permission_func(global, client, core->permission_data);
+	len = pw_array_get_len(cache, uint32_t);
+	if (global->id < len) {
+		p = pw_array_get_unchecked(cache, global->id, uint32_t);
+		if (*p & PERM_CACHED) {
+			core->stats.permission_hits++;
+			return *p & ~PERM_CACHED;
+		}
+	}
+
+	permissions = core->permission_func(global, client, core->permission_data);
+	core->stats.permission_misses++;
+
+	if (global->id >= len) {
+		if ((p = pw_array_add(cache, (global->id + 1 - len) * sizeof(uint32_t))) == NULL)
+			return permissions;
+		memset(p, 0, (global->id + 1 - len) * sizeof(uint32_t));
+	}
+	p = pw_array_get_unchecked(cache, global->id, uint32_t);
+	*p = permissions | PERM_CACHED;
+
+	return permissions;
 }
 
 /** Create and add a new global to the core
@@ -71,6 +97,7 @@ pw_core_add_global(struct pw_core *core,
 	struct global_impl *impl;
 	struct pw_global *this;
 	struct pw_resource *registry;
+	struct pw_registry_sync *sync;
 
 	impl = calloc(1, sizeof(struct global_impl));
 	if (impl == NULL)
@@ -84,6 +111,7 @@ pw_core_add_global(struct pw_core *core,
 	this->version = version;
 	this->bind = bind;
 	this->object = object;
+	this->serial = core->global_serial++;
 
 	this->id = pw_map_insert_new(&core->globals, this);
 
@@ -112,6 +140,14 @@ pw_core_add_global(struct pw_core *core,
 						    this->type,
 						    this->version);
 	}
+	/* registries that are still syncing will find the new global at the
+	 * end of the list */
+	spa_list_for_each(sync, &core->registry_sync_list, link) {
+		if (sync->next == NULL)
+			sync->next = this;
+	}
+	pw_core_registry_snapshot_changed(core);
+
 	return this;
 }
 
@@ -205,6 +241,8 @@ void pw_global_destroy(struct pw_global *global)
 {
 	struct pw_core *core = global->core;
 	struct pw_resource *registry;
+	struct pw_registry_sync *sync;
+	struct pw_client *client;
 
 	pw_log_debug("global %p: destroy %u", global, global->id);
 
@@ -213,12 +251,32 @@ void pw_global_destroy(struct pw_global *global)
 		if (PW_PERM_IS_R(permissions))
 			pw_registry_resource_global_remove(registry, global->id);
 	}
+	spa_list_for_each(sync, &core->registry_sync_list, link) {
+		if (sync->next == global) {
+			/* not sent yet, skip it */
+			if (global->link.next == &core->global_list)
+				sync->next = NULL;
+			else
+				sync->next = SPA_CONTAINER_OF(global->link.next, struct pw_global, link);
+		} else if (sync->next == NULL || global->serial < sync->next->serial) {
+			uint32_t permissions = pw_global_get_permissions(global,
+									 sync->resource->client);
+			if (PW_PERM_IS_R(permissions))
+				pw_registry_resource_global_remove(sync->resource, global->id);
+		}
+	}
+
+	/* the id can be reused for a new global */
+	spa_list_for_each(client, &core->client_list, link)
+		pw_client_invalidate_permissions(client, global);
 
 	pw_map_remove(&core->globals, global->id);
 
 	spa_list_remove(&global->link);
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, global_removed, global);
 
+	pw_core_registry_snapshot_changed(core);
+
 	pw_log_debug("global %p: free", global);
 	free(global);
 }
@@ -72,7 +72,8 @@ struct pw_link_proxy;
 #define PW_CORE_PROXY_METHOD_CLIENT_UPDATE	3
 #define PW_CORE_PROXY_METHOD_CREATE_OBJECT	4
 #define PW_CORE_PROXY_METHOD_CREATE_LINK	5
-#define PW_CORE_PROXY_METHOD_NUM		6
+#define PW_CORE_PROXY_METHOD_GET_REGISTRY_SNAPSHOT	6
+#define PW_CORE_PROXY_METHOD_NUM		7
 
 /**
  * \struct pw_core_proxy_methods
@@ -158,6 +159,15 @@ struct pw_core_proxy_methods {
 			     const struct spa_pod *filter,
 			     const struct spa_dict *props,
 			     uint32_t new_id);
+	/**
+	 * Get a shared memory snapshot of the registry
+	 *
+	 * Ask the server to emit the registry_snapshot event with a
+	 * read-only memfd containing the globals and their properties,
+	 * see \ref pw_registry_snapshot. The server emits the event again
+	 * whenever the snapshot changes.
+	 */
+	void (*get_registry_snapshot) (void *object);
 };
 
 static inline void
@@ -217,13 +227,20 @@ pw_core_proxy_create_link(struct pw_core_proxy *core,
 	return (struct pw_link_proxy*) p;
 }
 
+static inline void
+pw_core_proxy_get_registry_snapshot(struct pw_core_proxy *core)
+{
+	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, get_registry_snapshot);
+}
+
 
 #define PW_CORE_PROXY_EVENT_UPDATE_TYPES 0
 #define PW_CORE_PROXY_EVENT_DONE         1
 #define PW_CORE_PROXY_EVENT_ERROR        2
 #define PW_CORE_PROXY_EVENT_REMOVE_ID    3
 #define PW_CORE_PROXY_EVENT_INFO         4
-#define PW_CORE_PROXY_EVENT_NUM          5
+#define PW_CORE_PROXY_EVENT_REGISTRY_SNAPSHOT 5
+#define PW_CORE_PROXY_EVENT_NUM          6
 
 /** \struct pw_core_proxy_events
  *  \brief Core events
@@ -283,6 +300,17 @@ struct pw_core_proxy_events {
 	 * \param info new core info
 	 */
 	void (*info) (void *object, struct pw_core_info *info);
+	/**
+	 * Notify a new or updated registry snapshot
+	 *
+	 * Emited as a result of the get_registry_snapshot method and
+	 * every time the snapshot was updated afterwards.
+	 * \param fd a read-only memfd with the snapshot or -1 when the
+	 *	previously sent memfd was updated in place
+	 * \param size the size of the memfd
+	 * \param serial the serial of the snapshot
+	 */
+	void (*registry_snapshot) (void *object, int fd, uint32_t size, uint64_t serial);
 };
 
 static inline void
@@ -300,6 +328,7 @@ pw_core_proxy_add_listener(struct pw_core_proxy *core,
 #define pw_core_resource_error(r,...)        pw_resource_notify(r,struct pw_core_proxy_events,error,__VA_ARGS__)
 #define pw_core_resource_remove_id(r,...)    pw_resource_notify(r,struct pw_core_proxy_events,remove_id,__VA_ARGS__)
 #define pw_core_resource_info(r,...)         pw_resource_notify(r,struct pw_core_proxy_events,info,__VA_ARGS__)
+#define pw_core_resource_registry_snapshot(r,...) pw_resource_notify(r,struct pw_core_proxy_events,registry_snapshot,__VA_ARGS__)
 
 
 #define PW_VERSION_REGISTRY			0
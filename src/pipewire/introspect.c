@@ -115,6 +115,54 @@ static struct spa_dict *pw_spa_dict_copy(struct spa_dict *dict)
 	return NULL;
 }
 
+/* apply the changed keys in update to dict, a NULL value removes the key */
+static struct spa_dict *pw_spa_dict_patch(struct spa_dict *dict, const struct spa_dict *update)
+{
+	struct spa_dict_item *items;
+	uint32_t i, j;
+
+	if (update == NULL)
+		return dict;
+
+	if (dict == NULL) {
+		dict = calloc(1, sizeof(struct spa_dict));
+		if (dict == NULL)
+			return NULL;
+	}
+
+	for (i = 0; i < update->n_items; i++) {
+		const char *key = update->items[i].key;
+		const char *value = update->items[i].value;
+
+		items = (struct spa_dict_item *) dict->items;
+		for (j = 0; j < dict->n_items; j++) {
+			if (strcmp(items[j].key, key) == 0)
+				break;
+		}
+		if (j < dict->n_items) {
+			if (value && items[j].value && strcmp(items[j].value, value) == 0)
+				continue;
+
+			free((void *) items[j].value);
+			if (value) {
+				items[j].value = strdup(value);
+			} else {
+				free((void *) items[j].key);
+				items[j] = items[--dict->n_items];
+			}
+		} else if (value) {
+			items = realloc(items, (dict->n_items + 1) * sizeof(struct spa_dict_item));
+			if (items == NULL)
+				continue;
+			items[dict->n_items].key = strdup(key);
+			items[dict->n_items].value = strdup(value);
+			dict->items = items;
+			dict->n_items++;
+		}
+	}
+	return dict;
+}
+
 struct pw_core_info *pw_core_info_update(struct pw_core_info *info,
 					 const struct pw_core_info *update)
 {
@@ -242,7 +290,9 @@ struct pw_node_info *pw_node_info_update(struct pw_node_info *info,
 			free((void *) info->error);
 		info->error = update->error ? strdup(update->error) : NULL;
 	}
-	if (update->change_mask & PW_NODE_CHANGE_MASK_PROPS) {
+	if (update->change_mask & PW_NODE_CHANGE_MASK_PROPS_DELTA) {
+		info->props = pw_spa_dict_patch(info->props, update->props);
+	} else if (update->change_mask & PW_NODE_CHANGE_MASK_PROPS) {
 		if (info->props)
 			pw_spa_dict_destroy(info->props);
 		info->props = pw_spa_dict_copy(update->props);
@@ -374,7 +424,9 @@ struct pw_client_info *pw_client_info_update(struct pw_client_info *info,
 	info->id = update->id;
 	info->change_mask = update->change_mask;
 
-	if (update->change_mask & PW_CLIENT_CHANGE_MASK_PROPS) {
+	if (update->change_mask & PW_CLIENT_CHANGE_MASK_PROPS_DELTA) {
+		info->props = pw_spa_dict_patch(info->props, update->props);
+	} else if (update->change_mask & PW_CLIENT_CHANGE_MASK_PROPS) {
 		if (info->props)
 			pw_spa_dict_destroy(info->props);
 		info->props = pw_spa_dict_copy(update->props);
@@ -416,6 +468,13 @@ struct pw_link_info *pw_link_info_update(struct pw_link_info *info,
 			free(info->format);
 		info->format = pw_spa_pod_copy(update->format);
 	}
+	if (update->change_mask & PW_LINK_CHANGE_MASK_PROPS_DELTA) {
+		info->props = pw_spa_dict_patch(info->props, update->props);
+	} else if (update->change_mask & PW_LINK_CHANGE_MASK_PROPS) {
+		if (info->props)
+			pw_spa_dict_destroy(info->props);
+		info->props = pw_spa_dict_copy(update->props);
+	}
 	return info;
 }
 
@@ -423,5 +482,7 @@ void pw_link_info_free(struct pw_link_info *info)
 {
 	if (info->format)
 		free(info->format);
+	if (info->props)
+		pw_spa_dict_destroy(info->props);
 	free(info);
 }
@@ -125,11 +125,16 @@ void pw_module_info_free(struct pw_module_info *info);
 struct pw_client_info {
 	uint32_t id;		/**< id of the global */
 #define PW_CLIENT_CHANGE_MASK_PROPS		(1 << 0)
+#define PW_CLIENT_CHANGE_MASK_PROPS_DELTA	(1 << 1)	/**< props only contains the changed
+								  *  keys, a NULL value removes the key */
+#define PW_CLIENT_CHANGE_MASK_ALL		(PW_CLIENT_CHANGE_MASK_PROPS)
 	uint64_t change_mask;	/**< bitfield of changed fields since last call */
 	struct spa_dict *props;	/**< extra properties */
 };
 
-/** Update and existing \ref pw_client_info with \a update \memberof pw_introspect */
+/** Update and existing \ref pw_client_info with \a update. When \a update has
+ * PW_CLIENT_CHANGE_MASK_PROPS_DELTA set, the properties are patched in place
+ * instead of replaced. \memberof pw_introspect */
 struct pw_client_info *
 pw_client_info_update(struct pw_client_info *info,
 		      const struct pw_client_info *update);
@@ -148,6 +153,9 @@ struct pw_node_info {
 #define PW_NODE_CHANGE_MASK_OUTPUT_PARAMS	(1 << 4)
 #define PW_NODE_CHANGE_MASK_STATE		(1 << 5)
 #define PW_NODE_CHANGE_MASK_PROPS		(1 << 6)
+#define PW_NODE_CHANGE_MASK_PROPS_DELTA		(1 << 7)	/**< props only contains the changed
+								  *  keys, a NULL value removes the key */
+#define PW_NODE_CHANGE_MASK_ALL			((1 << 7) - 1)
 	uint64_t change_mask;			/**< bitfield of changed fields since last call */
 	const char *name;                       /**< name the node, suitable for display */
 	uint32_t max_input_ports;		/**< maximum number of inputs */
@@ -163,6 +171,9 @@ struct pw_node_info {
 	struct spa_dict *props;			/**< the properties of the node */
 };
 
+/** Update and existing \ref pw_node_info with \a update. When \a update has
+ * PW_NODE_CHANGE_MASK_PROPS_DELTA set, the properties are patched in place
+ * instead of replaced. \memberof pw_introspect */
 struct pw_node_info *
 pw_node_info_update(struct pw_node_info *info,
 		    const struct pw_node_info *update);
@@ -195,6 +206,9 @@ struct pw_link_info {
 #define PW_LINK_CHANGE_MASK_INPUT		(1 << 1)
 #define PW_LINK_CHANGE_MASK_FORMAT		(1 << 2)
 #define PW_LINK_CHANGE_MASK_PROPS		(1 << 3)
+#define PW_LINK_CHANGE_MASK_PROPS_DELTA		(1 << 4)	/**< props only contains the changed
+								  *  keys, a NULL value removes the key */
+#define PW_LINK_CHANGE_MASK_ALL			((1 << 4) - 1)
 	uint64_t change_mask;		/**< bitfield of changed fields since last call */
 	uint32_t output_node_id;	/**< server side output node id */
 	uint32_t output_port_id;	/**< output port id */
@@ -204,6 +218,9 @@ struct pw_link_info {
 	struct spa_dict *props;		/**< the properties of the link */
 };
 
+/** Update and existing \ref pw_link_info with \a update. When \a update has
+ * PW_LINK_CHANGE_MASK_PROPS_DELTA set, the properties are patched in place
+ * instead of replaced. \memberof pw_introspect */
 struct pw_link_info *
 pw_link_info_update(struct pw_link_info *info,
 		    const struct pw_link_info *update);
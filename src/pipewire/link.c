@@ -34,6 +34,11 @@
 #include "work-queue.h"
 
 #define MAX_BUFFERS     16
+#define MAX_DATAS       8
+#define MAX_DATA_TYPES  8
+
+#define DEFAULT_BUFFER_ALIGN	PW_BUFFER_AREA_ALIGN
+#define MAX_BUFFER_ALIGN	4096
 
 /** \cond */
 struct impl {
@@ -253,18 +258,27 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 					 uint32_t n_datas,
 					 size_t *data_sizes,
 					 ssize_t *data_strides,
+					 size_t align,
 					 struct pw_memblock *mem)
 {
 	struct spa_buffer **buffers, *bp;
 	uint32_t i;
-	size_t skel_size, data_size, meta_size;
+	size_t skel_size, data_size, meta_size, chunk_size, data_offset;
 	struct spa_chunk *cdp;
 	void *ddp;
 	uint32_t n_metas;
 	struct spa_meta *metas;
+	const void *users[2];
+	int res;
 
 	n_metas = data_size = meta_size = 0;
 
+	/* Each buffer starts with the metadata, then the chunks and then the
+	 * data planes. The metadata and the chunks are each on their own cache
+	 * lines so that the chunk updates of the producer don't bounce the
+	 * metadata of the consumer. Each buffer and data plane starts
+	 * at a multiple of align from the start of the memory. */
+
 	/* each buffer */
 	skel_size = sizeof(struct spa_buffer);
 
@@ -273,7 +287,7 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 	/* add shared metadata */
 	metas[n_metas].type = this->core->type.meta.Shared;
 	metas[n_metas].size = sizeof(struct spa_meta_shared);
-	meta_size += metas[n_metas].size;
+	meta_size += SPA_ROUND_UP_N(metas[n_metas].size, PW_BUFFER_META_ALIGN);
 	n_metas++;
 	skel_size += sizeof(struct spa_meta);
 
@@ -291,27 +305,44 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 
 			metas[n_metas].type = type;
 			metas[n_metas].size = size;
-			meta_size += metas[n_metas].size;
+			meta_size += SPA_ROUND_UP_N(metas[n_metas].size, PW_BUFFER_META_ALIGN);
 			n_metas++;
 			skel_size += sizeof(struct spa_meta);
 		}
 	}
-	data_size += meta_size;
+	meta_size = SPA_ROUND_UP_N(meta_size, PW_BUFFER_AREA_ALIGN);
+	chunk_size = SPA_ROUND_UP_N(sizeof(struct spa_chunk) * n_datas, PW_BUFFER_AREA_ALIGN);
+	data_offset = SPA_ROUND_UP_N(meta_size + chunk_size, align);
+	data_size = data_offset;
 
 	/* data */
 	for (i = 0; i < n_datas; i++) {
-		data_size += sizeof(struct spa_chunk);
-		data_size += data_sizes[i];
+		data_size += SPA_ROUND_UP_N(data_sizes[i], align);
 		skel_size += sizeof(struct spa_data);
 	}
 
+	pw_log_debug("link %p: buffer layout meta %zd chunk %zd data %zd size %zd align %zd",
+		     this, meta_size, chunk_size, data_offset, data_size, align);
+
 	buffers = calloc(n_buffers, skel_size + sizeof(struct spa_buffer *));
+	if (buffers == NULL)
+		return NULL;
 	/* pointer to buffer structures */
 	bp = SPA_MEMBER(buffers, n_buffers * sizeof(struct spa_buffer *), struct spa_buffer);
 
-	pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
-			  PW_MEMBLOCK_FLAG_MAP_READWRITE |
-			  PW_MEMBLOCK_FLAG_SEAL, n_buffers * data_size, mem);
+	/* the memory is shared with the owners of the nodes */
+	users[0] = this->output->node->global ? this->output->node->global->owner : NULL;
+	users[1] = this->input->node->global ? this->input->node->global->owner : NULL;
+
+	if ((res = pw_mempool_alloc(this->core->mempool,
+				    PW_MEMBLOCK_FLAG_WITH_FD |
+				    PW_MEMBLOCK_FLAG_MAP_READWRITE |
+				    PW_MEMBLOCK_FLAG_SEAL, n_buffers * data_size,
+				    users, 2, mem)) < 0) {
+		pw_log_error("link %p: can't allocate buffer memory: %s", this, spa_strerror(res));
+		free(buffers);
+		return NULL;
+	}
 
 	for (i = 0; i < n_buffers; i++) {
 		int j;
@@ -331,6 +362,8 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 			m->type = metas[j].type;
 			m->data = p;
 			m->size = metas[j].size;
+			/* memory from the pool is not cleared */
+			memset(m->data, 0, m->size);
 
 			if (m->type == this->core->type.meta.Shared) {
 				struct spa_meta_shared *msh = p;
@@ -340,14 +373,16 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 				msh->offset = data_size * i;
 				msh->size = data_size;
 			}
-			p += m->size;
+			p += SPA_ROUND_UP_N(m->size, PW_BUFFER_META_ALIGN);
 		}
 		/* pointer to data structure */
 		b->n_datas = n_datas;
 		b->datas = SPA_MEMBER(b->metas, n_metas * sizeof(struct spa_meta), struct spa_data);
 
-		cdp = p;
-		ddp = SPA_MEMBER(cdp, sizeof(struct spa_chunk) * n_datas, void);
+		p = SPA_MEMBER(mem->ptr, data_size * i, void);
+		cdp = SPA_MEMBER(p, meta_size, struct spa_chunk);
+		ddp = SPA_MEMBER(p, data_offset, void);
+		memset(cdp, 0, sizeof(struct spa_chunk) * n_datas);
 
 		for (j = 0; j < n_datas; j++) {
 			struct spa_data *d = &b->datas[j];
@@ -362,7 +397,7 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 				d->data = SPA_MEMBER(mem->ptr, d->mapoffset, void);
 				spa_ringbuffer_set_avail(&d->chunk->area, 0);
 				d->chunk->stride = data_strides[j];
-				ddp += data_sizes[j];
+				ddp += SPA_ROUND_UP_N(data_sizes[j], align);
 			} else {
 				d->type = SPA_ID_INVALID;
 				d->data = NULL;
@@ -372,6 +407,112 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 	return buffers;
 }
 
+/* buffers of a port are reused for a new link, the memory is now also
+ * shared with the owners of the nodes of this link */
+static void add_buffer_users(struct pw_link *this)
+{
+	struct spa_meta_shared *msh;
+	struct pw_mempool *pool = this->core->mempool;
+
+	if (this->n_buffers == 0 ||
+	    (msh = spa_buffer_find_meta(this->buffers[0], this->core->type.meta.Shared)) == NULL)
+		return;
+
+	if (this->output->node->global)
+		pw_mempool_add_user(pool, msh->fd, this->output->node->global->owner);
+	if (this->input->node->global)
+		pw_mempool_add_user(pool, msh->fd, this->input->node->global->owner);
+}
+
+/* the alignment of the data planes, the configured alignment or the
+ * alignment the ports asked for, whichever is larger, at most a page.
+ * Returns 0 when the ports ask for more than we can give. */
+static size_t get_buffer_align(struct pw_link *this, uint32_t port_align)
+{
+	const char *str;
+	size_t align = DEFAULT_BUFFER_ALIGN, res = PW_BUFFER_AREA_ALIGN;
+	int val;
+
+	str = this->properties ?
+		pw_properties_get(this->properties, PW_LINK_PROP_BUFFER_ALIGN) : NULL;
+	if (str == NULL)
+		str = pw_properties_get(this->core->properties, PW_LINK_PROP_BUFFER_ALIGN);
+	if (str != NULL) {
+		if ((val = pw_properties_parse_int(str)) > 0)
+			align = val;
+		else
+			pw_log_warn("link %p: invalid buffer align %s", this, str);
+	}
+
+	if (align > MAX_BUFFER_ALIGN) {
+		pw_log_warn("link %p: buffer align %zd too large, using %d", this,
+			    align, MAX_BUFFER_ALIGN);
+		align = MAX_BUFFER_ALIGN;
+	}
+	if (port_align > MAX_BUFFER_ALIGN)
+		return 0;
+
+	align = SPA_MAX(align, port_align);
+	/* a power of 2, at least a cache line */
+	while (res < align)
+		res <<= 1;
+
+	return res;
+}
+
+/* put the alignment that is used in the Buffers param so that the ports
+ * that allocate buffers use the same layout */
+static struct spa_pod *update_buffers_align(struct pw_link *this,
+					    struct spa_pod **params, uint32_t n_params,
+					    struct spa_pod *param, size_t align,
+					    struct spa_pod_builder *b)
+{
+	struct pw_type *t = &this->core->type;
+	struct spa_pod_prop *prop;
+	uint32_t i, size = 0, stride = 0, buffers = 0, blocks = 1;
+	uint32_t data_type = SPA_ID_INVALID;
+	struct spa_pod *res;
+
+	prop = spa_pod_find_prop(param, t->param_buffers.align);
+	if (prop && prop->body.value.type == SPA_POD_TYPE_INT) {
+		SPA_POD_VALUE(struct spa_pod_int, &prop->body.value) = align;
+		return param;
+	}
+
+	spa_pod_object_parse(param,
+		":", t->param_buffers.size, "i", &size,
+		":", t->param_buffers.stride, "i", &stride,
+		":", t->param_buffers.buffers, "i", &buffers,
+		":", t->param_buffers.blocks, "?i", &blocks,
+		":", t->param_buffers.dataType, "?I", &data_type, NULL);
+
+	if (data_type != SPA_ID_INVALID)
+		res = spa_pod_builder_object(b,
+			t->param.idBuffers, t->param_buffers.Buffers,
+			":", t->param_buffers.size,     "i", size,
+			":", t->param_buffers.stride,   "i", stride,
+			":", t->param_buffers.buffers,  "i", buffers,
+			":", t->param_buffers.align,    "i", align,
+			":", t->param_buffers.blocks,   "i", blocks,
+			":", t->param_buffers.dataType, "I", data_type);
+	else
+		res = spa_pod_builder_object(b,
+			t->param.idBuffers, t->param_buffers.Buffers,
+			":", t->param_buffers.size,     "i", size,
+			":", t->param_buffers.stride,   "i", stride,
+			":", t->param_buffers.buffers,  "i", buffers,
+			":", t->param_buffers.align,    "i", align,
+			":", t->param_buffers.blocks,   "i", blocks);
+	if (res == NULL)
+		return param;
+
+	for (i = 0; i < n_params; i++) {
+		if (params[i] == param)
+			params[i] = res;
+	}
+	return res;
+}
+
 static int
 param_filter(struct pw_link *this,
 	     struct pw_port *in_port,
@@ -411,6 +552,147 @@ param_filter(struct pw_link *this,
 	return num;
 }
 
+static void add_data_type(uint32_t *types, uint32_t *n_types, uint32_t type)
+{
+	uint32_t i;
+
+	for (i = 0; i < *n_types; i++) {
+		if (types[i] == type)
+			return;
+	}
+	if (*n_types < MAX_DATA_TYPES)
+		types[(*n_types)++] = type;
+}
+
+/* collect the data types of the Buffers params of a port in order of
+ * preference, returns 0 when the port does not care */
+static uint32_t port_data_types(struct pw_link *this, struct pw_port *port, uint32_t *types)
+{
+	struct pw_type *t = &this->core->type;
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = { 0 };
+	struct spa_pod *param;
+	struct spa_pod_prop *prop;
+	uint32_t idx, n_types = 0, *alt;
+
+	for (idx = 0;;) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		if (spa_node_port_enum_params(port->node->node, port->direction, port->port_id,
+					      t->param.idBuffers, &idx, NULL, &param, &b) <= 0)
+			break;
+
+		prop = spa_pod_find_prop(param, t->param_buffers.dataType);
+		if (prop == NULL || prop->body.value.type != SPA_POD_TYPE_ID)
+			continue;
+
+		add_data_type(types, &n_types,
+			      SPA_POD_VALUE(struct spa_pod_id, &prop->body.value));
+		if ((prop->body.flags & SPA_POD_PROP_RANGE_MASK) == SPA_POD_PROP_RANGE_ENUM) {
+			SPA_POD_PROP_ALTERNATIVE_FOREACH(&prop->body, prop->pod.size, alt)
+				add_data_type(types, &n_types, *alt);
+		}
+	}
+	return n_types;
+}
+
+/* Pick the first data type of the output that the input also accepts.
+ * The link can only allocate memfd memory, DmaBuf is skipped when no
+ * port allocates. Returns SPA_ID_INVALID when no port cares and -1 when
+ * there is no common type. */
+static int negotiate_data_type(struct pw_link *this, bool link_alloc, uint32_t *data_type)
+{
+	struct pw_type *t = &this->core->type;
+	uint32_t out_types[MAX_DATA_TYPES], in_types[MAX_DATA_TYPES];
+	uint32_t n_out, n_in, *types, n_types, *other, n_other, i, j;
+
+	n_out = port_data_types(this, this->output, out_types);
+	n_in = port_data_types(this, this->input, in_types);
+
+	*data_type = SPA_ID_INVALID;
+	if (n_out == 0 && n_in == 0)
+		return 0;
+
+	if (n_out > 0) {
+		types = out_types, n_types = n_out;
+		other = in_types, n_other = n_in;
+	} else {
+		types = in_types, n_types = n_in;
+		other = out_types, n_other = n_out;
+	}
+
+	for (i = 0; i < n_types; i++) {
+		if (link_alloc && types[i] == t->data.DmaBuf)
+			continue;
+		for (j = 0; j < n_other; j++) {
+			if (other[j] == types[i])
+				break;
+		}
+		if (n_other > 0 && j == n_other)
+			continue;
+
+		*data_type = types[i];
+		return 0;
+	}
+	return -1;
+}
+
+static void set_data_type(struct pw_link *this, struct spa_pod *param, uint32_t data_type)
+{
+	struct spa_pod_prop *prop;
+
+	prop = spa_pod_find_prop(param, this->core->type.param_buffers.dataType);
+	if (prop && prop->body.value.type == SPA_POD_TYPE_ID)
+		SPA_POD_VALUE(struct spa_pod_id, &prop->body.value) = data_type;
+}
+
+static int check_states(struct pw_link *this, void *user_data, int res);
+
+static bool input_has_other_links(struct pw_link *this)
+{
+	struct pw_link *l;
+
+	spa_list_for_each(l, &this->input->links, input_link) {
+		if (l != this)
+			return true;
+	}
+	return false;
+}
+
+/* Buffers that the input port allocated can be device memory that only
+ * one producer can render into, they can't be shared with another link.
+ * Clear them and let the other links use the link buffers of this link
+ * instead. Returns true when the input buffers were cleared. */
+static bool unshare_input_buffers(struct pw_link *this)
+{
+	struct pw_port *input = this->input;
+	struct pw_link *l;
+
+	if (this->buffers != NULL || !input->allocated || input->mix != NULL ||
+	    !input_has_other_links(this))
+		return false;
+
+	pw_log_debug("link %p: input buffers can't be shared, allocating link buffers",
+		     this);
+
+	spa_list_for_each(l, &input->links, input_link) {
+		struct impl *li = SPA_CONTAINER_OF(l, struct impl, this);
+
+		if (l == this || l->buffer_owner != input)
+			continue;
+
+		pw_port_use_buffers(l->output, NULL, 0);
+		l->buffers = NULL;
+		l->n_buffers = 0;
+		l->buffer_owner = NULL;
+
+		/* picks up the new input buffers */
+		pw_work_queue_add(li->work, l, -EBUSY, (pw_work_func_t) check_states, l);
+	}
+	pw_port_use_buffers(input, NULL, 0);
+
+	return true;
+}
+
 static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_state)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -420,6 +702,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 	char *error = NULL;
 	struct pw_port *input, *output;
 	struct pw_type *t = &this->core->type;
+	bool fallback = false;
 
 	if (in_state != PW_PORT_STATE_READY && out_state != PW_PORT_STATE_READY)
 		return 0;
@@ -429,6 +712,9 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 	input = this->input;
 	output = this->output;
 
+	if (output->n_buffers == 0 && unshare_input_buffers(this))
+		in_state = input->state;
+
 	pw_log_debug("link %p: doing alloc buffers %p %p", this, output->node, input->node);
 	/* find out what's possible */
 	if ((res = spa_node_port_get_info(output->node->node, output->direction, output->port_id,
@@ -445,6 +731,10 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 	in_flags = iinfo->flags;
 	out_flags = oinfo->flags;
 
+	/* the input would replace the buffers of its other links */
+	if (input_has_other_links(this))
+		in_flags &= ~SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS;
+
 	if (out_flags & SPA_PORT_INFO_FLAG_LIVE) {
 		pw_log_debug("setting link as live");
 		output->node->live = true;
@@ -489,13 +779,14 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		spa_debug_port_info(iinfo);
 	}
 
+      again:
 	if (this->buffers == NULL) {
 		struct spa_pod **params, *param;
 		uint8_t buffer[4096];
 		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 		int i, offset, n_params;
-		uint32_t max_buffers;
-		size_t minsize = 1024, stride = 0;
+		uint32_t max_buffers, blocks = 1, data_type = SPA_ID_INVALID, qalign = 0;
+		size_t minsize = 1024, stride = 0, align;
 
 		n_params = param_filter(this, input, output, t->param.idBuffers, &b);
 		n_params += param_filter(this, input, output, t->param.idMeta, &b);
@@ -510,6 +801,15 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			offset += SPA_ROUND_UP_N(SPA_POD_SIZE(params[i]), 8);
 		}
 
+		if (negotiate_data_type(this,
+				!(in_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS) &&
+				!(out_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS),
+				&data_type) < 0) {
+			asprintf(&error, "no common buffer data type");
+			res = -EINVAL;
+			goto error;
+		}
+
 		max_buffers = MAX_BUFFERS;
 		minsize = stride = 0;
 		param = find_param(params, n_params, t->param_buffers.Buffers);
@@ -520,21 +820,38 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			spa_pod_object_parse(param,
 				":", t->param_buffers.size, "i", &qminsize,
 				":", t->param_buffers.stride, "i", &qstride,
-				":", t->param_buffers.buffers, "i", &qmax_buffers, NULL);
+				":", t->param_buffers.buffers, "i", &qmax_buffers,
+				":", t->param_buffers.blocks, "?i", &blocks,
+				":", t->param_buffers.align, "?i", &qalign, NULL);
+
+			if (data_type != SPA_ID_INVALID)
+				set_data_type(this, param, data_type);
 
 			max_buffers =
 			    qmax_buffers == 0 ? max_buffers : SPA_MIN(qmax_buffers,
 								      max_buffers);
 			minsize = SPA_MAX(minsize, qminsize);
 			stride = SPA_MAX(stride, qstride);
+			blocks = SPA_CLAMP(blocks, 1, MAX_DATAS);
 
-			pw_log_debug("%d %d %d -> %zd %zd %d", qminsize, qstride, qmax_buffers,
-				     minsize, stride, max_buffers);
+			pw_log_debug("%d %d %d %d -> %zd %zd %d", qminsize, qstride, qmax_buffers,
+				     blocks, minsize, stride, max_buffers);
 		} else {
 			pw_log_warn("no buffers param");
 			minsize = 1024;
 		}
 
+		if ((align = get_buffer_align(this, qalign)) == 0) {
+			asprintf(&error, "buffer align %u not supported", qalign);
+			res = -ENOTSUP;
+			goto error;
+		}
+		if (param)
+			param = update_buffers_align(this, params, n_params, param, align,
+						     &b);
+
+		pw_log_debug("link %p: data type %d", this, data_type);
+
 		if ((in_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS) ||
 		    (out_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS))
 			minsize = 0;
@@ -547,6 +864,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			this->buffer_owner = output;
 			pw_log_debug("link %p: reusing %d output buffers %p", this, this->n_buffers,
 				     this->buffers);
+			add_buffer_users(this);
 		} else if (input->n_buffers && input->mix == NULL) {
 			out_flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
 			in_flags = 0;
@@ -555,12 +873,15 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			this->buffer_owner = input;
 			pw_log_debug("link %p: reusing %d input buffers %p", this, this->n_buffers,
 				     this->buffers);
+			add_buffer_users(this);
 		} else {
-			size_t data_sizes[1];
-			ssize_t data_strides[1];
+			size_t data_sizes[MAX_DATAS];
+			ssize_t data_strides[MAX_DATAS];
 
-			data_sizes[0] = minsize;
-			data_strides[0] = stride;
+			for (i = 0; i < blocks; i++) {
+				data_sizes[i] = minsize;
+				data_strides[i] = stride;
+			}
 
 			this->buffer_owner = this;
 			this->n_buffers = max_buffers;
@@ -568,9 +889,17 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 						      this->n_buffers,
 						      n_params,
 						      params,
-						      1,
+						      blocks,
 						      data_sizes, data_strides,
+						      align,
 						      &this->buffer_mem);
+			if (this->buffers == NULL) {
+				this->buffer_owner = NULL;
+				this->n_buffers = 0;
+				asprintf(&error, "can't allocate buffers");
+				res = -ENOMEM;
+				goto error;
+			}
 
 			pw_log_debug("link %p: allocating %d buffers %p %zd %zd", this,
 				     this->n_buffers, this->buffers, minsize, stride);
@@ -618,6 +947,22 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		pw_log_debug("link %p: using %d buffers %p on output port", this,
 			     this->n_buffers, this->buffers);
 		if ((res = pw_port_use_buffers(output, this->buffers, this->n_buffers)) < 0) {
+			if (this->buffer_owner == input && input->allocated && !fallback) {
+				/* the output can't use the memory of the input, a remote
+				 * client can't reach memory that is not shared. Let the
+				 * link allocate shared buffers instead */
+				pw_log_debug("link %p: output can't use input buffers: %d, "
+					     "allocating link buffers", this, res);
+				pw_port_use_buffers(output, NULL, 0);
+				pw_port_use_buffers(input, NULL, 0);
+				this->buffers = NULL;
+				this->n_buffers = 0;
+				this->buffer_owner = NULL;
+				in_flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+				out_flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+				fallback = true;
+				goto again;
+			}
 			asprintf(&error, "error use output buffers: %d", res);
 			goto error;
 		}
@@ -968,7 +1313,7 @@ link_bind_func(struct pw_global *global,
 
 	spa_list_append(&this->resource_list, &resource->link);
 
-	this->info.change_mask = ~0;
+	this->info.change_mask = PW_LINK_CHANGE_MASK_ALL;
 	pw_link_resource_info(resource, &this->info);
 	this->info.change_mask = 0;
 
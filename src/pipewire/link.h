@@ -75,6 +75,12 @@ struct pw_link_events {
   * set to "1" or "0" */
 #define PW_LINK_PROP_PASSIVE	"pipewire.link.passive"
 
+/** The alignment in bytes of the data planes of the buffers that the link
+  * allocates, rounded up to a power of 2, default and minimum 64, maximum
+  * 4096. When not set on the link, the core property with the same name is
+  * used. The alignment is added to the Buffers param. */
+#define PW_LINK_PROP_BUFFER_ALIGN	"pipewire.link.buffer-align"
+
 /** Make a new link between two ports \memberof pw_link
  * \return a newly allocated link */
 struct pw_link *
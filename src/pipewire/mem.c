@@ -26,11 +26,14 @@
 #include <stdio.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/syscall.h>
 
+#include <spa/utils/list.h>
+
 #include <pipewire/log.h>
 #include <pipewire/mem.h>
 
@@ -57,6 +60,10 @@ static inline int memfd_create(const char *name, unsigned int flags)
 #define MFD_ALLOW_SEALING 0x0002U
 #endif
 
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB       0x0004U
+#endif
+
 /* fcntl() seals-related flags */
 
 #ifndef F_LINUX_SPECIFIC_BASE
@@ -73,72 +80,163 @@ static inline int memfd_create(const char *name, unsigned int flags)
 #define F_SEAL_WRITE    0x0008	/* prevent writes */
 #endif
 
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010	/* prevent new writable mappings and writes */
+#endif
+
 
 #define USE_MEMFD
 
-/** Map a memblock
- * \param mem a memblock
- * \return 0 on success, < 0 on error
- * \memberof pw_memblock
- */
-int pw_memblock_map(struct pw_memblock *mem)
+/* mbind(2) and madvise(2) constants, not all libc versions have them */
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ  22
+#define MADV_POPULATE_WRITE 23
+#endif
+
+#define MAX_NUMA_NODES	1024
+
+static int memblock_bind(struct pw_memblock *mem, int numa_node)
+{
+	unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = { 0, };
+
+	if (numa_node < 0 || numa_node >= MAX_NUMA_NODES)
+		return -EINVAL;
+
+	mask[numa_node / (8 * sizeof(unsigned long))] |= 1UL << (numa_node % (8 * sizeof(unsigned long)));
+
+	/* prefer the node, a full node should not make the allocation fail */
+	if (syscall(SYS_mbind, mem->ptr, mem->size, MPOL_PREFERRED,
+		    mask, MAX_NUMA_NODES, 0) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static void memblock_populate(void *ptr, size_t size, bool write)
+{
+	volatile uint8_t *p = ptr;
+	size_t i, page_size;
+
+	if (madvise(ptr, size, write ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0)
+		return;
+
+	/* older kernels, touch all pages */
+	page_size = sysconf(_SC_PAGESIZE);
+	for (i = 0; i < size; i += page_size) {
+		if (write)
+			p[i] = p[i];
+		else
+			(void) p[i];
+	}
+}
+
+static int memblock_map(struct pw_memblock *mem, int numa_node)
 {
+	int prot = 0, flags = MAP_SHARED;
+	bool populate;
+
 	if (mem->ptr != NULL)
 		return 0;
 
-	if (mem->flags & PW_MEMBLOCK_FLAG_MAP_READWRITE) {
-		int prot = 0;
-
-		if (mem->flags & PW_MEMBLOCK_FLAG_MAP_READ)
-			prot |= PROT_READ;
-		if (mem->flags & PW_MEMBLOCK_FLAG_MAP_WRITE)
-			prot |= PROT_WRITE;
-
-		if (mem->flags & PW_MEMBLOCK_FLAG_MAP_TWICE) {
-			void *ptr;
-
-			mem->ptr =
-			    mmap(NULL, mem->size << 1, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1,
-				 0);
-			if (mem->ptr == MAP_FAILED)
-				return -errno;
-
-			ptr =
-			    mmap(mem->ptr, mem->size, prot, MAP_FIXED | MAP_SHARED, mem->fd,
-				 mem->offset);
-			if (ptr != mem->ptr) {
-				munmap(mem->ptr, mem->size << 1);
-				return -ENOMEM;
-			}
+	if (!(mem->flags & PW_MEMBLOCK_FLAG_MAP_READWRITE)) {
+		mem->ptr = NULL;
+		return 0;
+	}
 
-			ptr =
-			    mmap(mem->ptr + mem->size, mem->size, prot, MAP_FIXED | MAP_SHARED,
-				 mem->fd, mem->offset);
-			if (ptr != mem->ptr + mem->size) {
-				munmap(mem->ptr, mem->size << 1);
-				return -ENOMEM;
-			}
-		} else {
-			mem->ptr = mmap(NULL, mem->size, prot, MAP_SHARED, mem->fd, 0);
-			if (mem->ptr == MAP_FAILED)
-				return -ENOMEM;
+	if (mem->flags & PW_MEMBLOCK_FLAG_MAP_READ)
+		prot |= PROT_READ;
+	if (mem->flags & PW_MEMBLOCK_FLAG_MAP_WRITE)
+		prot |= PROT_WRITE;
+
+	/* when binding to a node, prefault after the policy is set */
+	populate = mem->flags & PW_MEMBLOCK_FLAG_POPULATE;
+	if (populate && numa_node < 0) {
+		flags |= MAP_POPULATE;
+		populate = false;
+	}
+
+	if (mem->flags & PW_MEMBLOCK_FLAG_MAP_TWICE) {
+		void *ptr, *base, *end;
+		size_t reserve = mem->size << 1, align = 0;
+
+		/* huge pages must be mapped at an aligned address */
+		if (mem->flags & PW_MEMBLOCK_FLAG_HUGEPAGES) {
+			struct stat st;
+
+			if (fstat(mem->fd, &st) == 0)
+				align = st.st_blksize;
+			reserve += align;
+		}
+
+		base = mmap(NULL, reserve, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+		if (base == MAP_FAILED)
+			return -errno;
+
+		mem->ptr = base;
+		if (align > 0) {
+			mem->ptr = (void *) SPA_ROUND_UP_N((uintptr_t) base, align);
+			if (mem->ptr != base)
+				munmap(base, SPA_PTRDIFF(mem->ptr, base));
+			end = SPA_MEMBER(base, reserve, void);
+			ptr = SPA_MEMBER(mem->ptr, mem->size << 1, void);
+			if (end > ptr)
+				munmap(ptr, SPA_PTRDIFF(end, ptr));
+		}
+
+		ptr = mmap(mem->ptr, mem->size, prot, MAP_FIXED | flags, mem->fd, mem->offset);
+		if (ptr != mem->ptr) {
+			munmap(mem->ptr, mem->size << 1);
+			mem->ptr = NULL;
+			return -ENOMEM;
+		}
+
+		ptr = mmap(mem->ptr + mem->size, mem->size, prot, MAP_FIXED | flags,
+			   mem->fd, mem->offset);
+		if (ptr != mem->ptr + mem->size) {
+			munmap(mem->ptr, mem->size << 1);
+			mem->ptr = NULL;
+			return -ENOMEM;
 		}
 	} else {
-		mem->ptr = NULL;
+		mem->ptr = mmap(NULL, mem->size, prot, flags, mem->fd, 0);
+		if (mem->ptr == MAP_FAILED) {
+			mem->ptr = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	if (numa_node >= 0) {
+		int res;
+		if ((res = memblock_bind(mem, numa_node)) < 0)
+			pw_log_debug("mem %p: can't bind to node %d: %s", mem, numa_node,
+				     strerror(-res));
 	}
+	if (populate)
+		memblock_populate(mem->ptr, mem->size, mem->flags & PW_MEMBLOCK_FLAG_MAP_WRITE);
+
 	return 0;
 }
 
-/** Create a new memblock
- * \param flags memblock flags
- * \param size size to allocate
- * \param[out] mem memblock structure to fill
+/** Map a memblock
+ * \param mem a memblock
  * \return 0 on success, < 0 on error
  * \memberof pw_memblock
  */
-int pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_memblock *mem)
+int pw_memblock_map(struct pw_memblock *mem)
+{
+	return memblock_map(mem, -1);
+}
+
+static int memblock_alloc(enum pw_memblock_flags flags, size_t size,
+			  int numa_node, struct pw_memblock *mem)
 {
 	bool use_fd;
+	int res;
 
 	if (mem == NULL || size == 0)
 		return -EINVAL;
@@ -147,18 +245,38 @@ int pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_membl
 	mem->flags = flags;
 	mem->size = size;
 	mem->ptr = NULL;
+	mem->pool = NULL;
 
 	use_fd = ! !(flags & (PW_MEMBLOCK_FLAG_MAP_TWICE | PW_MEMBLOCK_FLAG_WITH_FD));
 
 	if (use_fd) {
 #ifdef USE_MEMFD
-		mem->fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		mem->fd = -1;
+		if (flags & PW_MEMBLOCK_FLAG_HUGEPAGES) {
+			struct stat st;
+
+			mem->fd = memfd_create("pipewire-memfd",
+					       MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB);
+			if (mem->fd != -1 && fstat(mem->fd, &st) == 0) {
+				mem->size = SPA_ROUND_UP_N(size, (size_t) st.st_blksize);
+			} else {
+				pw_log_debug("mem %p: no huge pages: %s", mem, strerror(errno));
+				if (mem->fd != -1)
+					close(mem->fd);
+				mem->fd = -1;
+			}
+		}
+		if (mem->fd == -1) {
+			mem->flags &= ~PW_MEMBLOCK_FLAG_HUGEPAGES;
+			mem->fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		}
 		if (mem->fd == -1) {
 			pw_log_error("Failed to create memfd: %s\n", strerror(errno));
 			return -errno;
 		}
 #else
 		char filename[] = "/dev/shm/pipewire-tmpfile.XXXXXX";
+		mem->flags &= ~PW_MEMBLOCK_FLAG_HUGEPAGES;
 		mem->fd = mkostemp(filename, O_CLOEXEC);
 		if (mem->fd == -1) {
 			pw_log_error("Failed to create temporary file: %s\n", strerror(errno));
@@ -167,26 +285,56 @@ int pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_membl
 		unlink(filename);
 #endif
 
-		if (ftruncate(mem->fd, size) < 0) {
+		if (ftruncate(mem->fd, mem->size) < 0) {
+			res = -errno;
 			pw_log_warn("Failed to truncate temporary file: %s", strerror(errno));
 			close(mem->fd);
-			return -errno;
+			return res;
 		}
 #ifdef USE_MEMFD
 		if (flags & PW_MEMBLOCK_FLAG_SEAL) {
-			unsigned int seals = F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL;
+			unsigned int seals = F_SEAL_GROW | F_SEAL_SHRINK;
+			/* the write seal is added after mapping */
+			if (!(flags & PW_MEMBLOCK_FLAG_SEAL_WRITE))
+				seals |= F_SEAL_SEAL;
 			if (fcntl(mem->fd, F_ADD_SEALS, seals) == -1) {
 				pw_log_warn("Failed to add seals: %s", strerror(errno));
 			}
 		}
 #endif
-		if (pw_memblock_map(mem) != 0)
+		if (memblock_map(mem, numa_node) != 0) {
+			/* no huge pages reserved, try again with normal pages */
+			if (mem->flags & PW_MEMBLOCK_FLAG_HUGEPAGES) {
+				pw_log_debug("mem %p: can't map huge pages", mem);
+				close(mem->fd);
+				return memblock_alloc(flags & ~PW_MEMBLOCK_FLAG_HUGEPAGES,
+						      size, numa_node, mem);
+			}
 			goto mmap_failed;
+		}
+		if (flags & PW_MEMBLOCK_FLAG_SEAL_WRITE) {
+#ifdef USE_MEMFD
+			res = fcntl(mem->fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL);
+			/* F_SEAL_FUTURE_WRITE needs Linux 5.1, older kernels
+			 * reject the unknown seal */
+			res = res == -1 ? (errno == EINVAL ? -ENOTSUP : -errno) : 0;
+#else
+			res = -ENOTSUP;
+#endif
+			if (res < 0) {
+				pw_log_warn("Failed to add write seal: %s", strerror(-res));
+				mem->flags |= PW_MEMBLOCK_FLAG_WITH_FD;
+				pw_memblock_free(mem);
+				return res;
+			}
+		}
 	} else {
 		mem->ptr = malloc(size);
 		if (mem->ptr == NULL)
 			return -ENOMEM;
 		mem->fd = -1;
+		if (flags & PW_MEMBLOCK_FLAG_POPULATE)
+			memblock_populate(mem->ptr, size, true);
 	}
 	if (!(flags & PW_MEMBLOCK_FLAG_WITH_FD) && mem->fd != -1) {
 		close(mem->fd);
@@ -199,6 +347,39 @@ int pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_membl
 	return -ENOMEM;
 }
 
+/** Create a new memblock
+ * \param flags memblock flags
+ * \param size size to allocate
+ * \param[out] mem memblock structure to fill
+ * \return 0 on success, < 0 on error
+ * \memberof pw_memblock
+ */
+int pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_memblock *mem)
+{
+	return memblock_alloc(flags, size, -1, mem);
+}
+
+/** Create a new memblock on a NUMA node
+ * \param flags memblock flags
+ * \param size size to allocate
+ * \param numa_node the NUMA node to prefer for the memory, -1 for the
+ *                  default policy
+ * \param[out] mem memblock structure to fill
+ * \return 0 on success, < 0 on error
+ *
+ * The memory is bound with mbind(2) before it is prefaulted with
+ * \ref PW_MEMBLOCK_FLAG_POPULATE.
+ *
+ * \memberof pw_memblock
+ */
+int pw_memblock_alloc_numa(enum pw_memblock_flags flags, size_t size, int numa_node,
+			   struct pw_memblock *mem)
+{
+	return memblock_alloc(flags, size, numa_node, mem);
+}
+
+static void mempool_release(struct pw_mempool *pool, struct pw_memblock *mem);
+
 /** Free a memblock
  * \param mem a memblock
  * \memberof pw_memblock
@@ -208,9 +389,18 @@ void pw_memblock_free(struct pw_memblock *mem)
 	if (mem == NULL)
 		return;
 
+	if (mem->pool) {
+		mempool_release(mem->pool, mem);
+		mem->pool = NULL;
+		mem->ptr = NULL;
+		mem->fd = -1;
+		return;
+	}
+
 	if (mem->flags & PW_MEMBLOCK_FLAG_WITH_FD) {
 		if (mem->ptr)
-			munmap(mem->ptr, mem->size);
+			munmap(mem->ptr, mem->flags & PW_MEMBLOCK_FLAG_MAP_TWICE ?
+				mem->size << 1 : mem->size);
 		if (mem->fd != -1)
 			close(mem->fd);
 	} else {
@@ -219,3 +409,400 @@ void pw_memblock_free(struct pw_memblock *mem)
 	mem->ptr = NULL;
 	mem->fd = -1;
 }
+
+#define MEMPOOL_MIN_SIZE	4096
+#define MEMPOOL_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+#define MEMPOOL_MAX_USERS	4
+
+#define MEMPOOL_FLAGS	(PW_MEMBLOCK_FLAG_WITH_FD |		\
+			 PW_MEMBLOCK_FLAG_MAP_READWRITE |	\
+			 PW_MEMBLOCK_FLAG_SEAL)
+
+struct slab {
+	struct spa_list link;		/**< link in the pool used_list or free_list */
+	struct pw_memblock mem;		/**< the memfd of the slab, mapped in the pool */
+	size_t class_size;		/**< the size class */
+	int numa_node;			/**< the NUMA node of the memory or -1 */
+	bool hugepages;			/**< backed by huge pages */
+	bool discard;			/**< don't reuse when released */
+	uint32_t n_users;		/**< number of users */
+	const void *users[MEMPOOL_MAX_USERS];	/**< users that had access to the memory */
+};
+
+/** \cond */
+struct pw_mempool {
+	enum pw_mempool_flags flags;
+	uint32_t max_free;
+	int numa_node;
+	bool destroyed;			/**< destroyed, freed with the last used slab */
+	struct spa_list used_list;
+	struct spa_list free_list;
+	struct pw_mempool_stats stats;
+};
+/** \endcond */
+
+/** Make a new memory pool
+ * \param flags pool flags
+ * \param max_free max number of released slabs to keep for reuse
+ * \return a new \ref pw_mempool or NULL on error
+ *
+ * The pool hands out sealed and mapped memfd memblocks. The memory of
+ * a released memblock is kept and used again for an allocation of the
+ * same size class so that the memfd does not need to be created and
+ * mapped again.
+ *
+ * The pool is not thread safe, it should only be used from the main loop.
+ *
+ * \memberof pw_mempool
+ */
+struct pw_mempool *pw_mempool_new(enum pw_mempool_flags flags, uint32_t max_free)
+{
+	struct pw_mempool *pool;
+
+	if ((pool = calloc(1, sizeof(struct pw_mempool))) == NULL)
+		return NULL;
+
+	pool->flags = flags;
+	pool->max_free = max_free;
+	pool->numa_node = -1;
+	spa_list_init(&pool->used_list);
+	spa_list_init(&pool->free_list);
+
+	return pool;
+}
+
+static void slab_free(struct pw_mempool *pool, struct slab *slab)
+{
+	spa_list_remove(&slab->link);
+	if (slab->hugepages)
+		pool->stats.n_hugepages--;
+	pw_memblock_free(&slab->mem);
+	free(slab);
+}
+
+/** Destroy a memory pool
+ * \param pool a pool
+ *
+ * All free slabs are unmapped. Memblocks that are still in use stay valid
+ * and are freed with \ref pw_memblock_free(), the pool is freed with the
+ * last of them.
+ *
+ * \memberof pw_mempool
+ */
+void pw_mempool_destroy(struct pw_mempool *pool)
+{
+	struct slab *slab, *t;
+
+	pw_log_debug("mempool %p: destroy, %"PRIu64" hits %"PRIu64" misses", pool,
+		     pool->stats.n_hits, pool->stats.n_misses);
+
+	spa_list_for_each_safe(slab, t, &pool->free_list, link)
+		slab_free(pool, slab);
+
+	/* the memblocks in use still point to the pool */
+	if (!spa_list_is_empty(&pool->used_list)) {
+		pool->destroyed = true;
+		return;
+	}
+	free(pool);
+}
+
+static size_t size_class(struct pw_mempool *pool, size_t size, bool *hugepages)
+{
+	size_t res = MEMPOOL_MIN_SIZE;
+
+	while (res < size)
+		res <<= 1;
+
+	*hugepages = (pool->flags & PW_MEMPOOL_FLAG_HUGEPAGES) && res >= MEMPOOL_HUGEPAGE_SIZE;
+
+	return res;
+}
+
+static bool slab_has_user(struct slab *slab, const void *user)
+{
+	uint32_t i;
+
+	for (i = 0; i < slab->n_users; i++) {
+		if (slab->users[i] == user)
+			return true;
+	}
+	return false;
+}
+
+/* the memory of the slab can be given to the new users when all of the
+ * previous users will also have access to it */
+static bool slab_can_reuse(struct slab *slab, const void * const *users, uint32_t n_users)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < slab->n_users; i++) {
+		for (j = 0; j < n_users; j++) {
+			if (slab->users[i] == users[j])
+				break;
+		}
+		if (j == n_users)
+			return false;
+	}
+	return true;
+}
+
+/* all new users already had access to the memory of the slab */
+static bool slab_same_users(struct slab *slab, const void * const *users, uint32_t n_users)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_users; i++) {
+		if (users[i] != NULL && !slab_has_user(slab, users[i]))
+			return false;
+	}
+	return true;
+}
+
+static struct slab *slab_new(struct pw_mempool *pool, size_t size, bool hugepages)
+{
+	struct slab *slab;
+	enum pw_memblock_flags flags = MEMPOOL_FLAGS;
+	int res;
+
+	if ((slab = calloc(1, sizeof(struct slab))) == NULL)
+		return NULL;
+
+	if (hugepages)
+		flags |= PW_MEMBLOCK_FLAG_HUGEPAGES;
+
+	if ((res = memblock_alloc(flags, size, pool->numa_node, &slab->mem)) < 0) {
+		free(slab);
+		errno = -res;
+		return NULL;
+	}
+	if (hugepages && !(slab->mem.flags & PW_MEMBLOCK_FLAG_HUGEPAGES)) {
+		pw_log_warn("mempool %p: can't allocate huge pages, disabled", pool);
+		pool->flags &= ~PW_MEMPOOL_FLAG_HUGEPAGES;
+		hugepages = false;
+	}
+	slab->class_size = size;
+	slab->numa_node = pool->numa_node;
+	slab->hugepages = hugepages;
+	if (hugepages)
+		pool->stats.n_hugepages++;
+
+	return slab;
+}
+
+/** Set the NUMA node of new memory
+ * \param pool a pool
+ * \param numa_node the NUMA node to prefer for new slabs, -1 for the
+ *                  default policy
+ *
+ * Free slabs of other nodes are not reused anymore.
+ *
+ * \memberof pw_mempool
+ */
+void pw_mempool_set_numa_node(struct pw_mempool *pool, int numa_node)
+{
+	pool->numa_node = numa_node;
+}
+
+/** Allocate memory from the pool
+ * \param pool a pool
+ * \param flags memblock flags
+ * \param size size to allocate
+ * \param users the users that will have access to the memory, NULL
+ *              entries are ignored
+ * \param n_users number of \a users
+ * \param[out] mem memblock structure to fill
+ * \return 0 on success, < 0 on error
+ *
+ * The memory of a previous allocation is only used again when all the
+ * users of that allocation are also in \a users so that no data leaks
+ * to a user that kept the memory mapped. The memory is cleared when it
+ * is given to users that did not have access to it before.
+ *
+ * Memblocks with flags other than \ref PW_MEMBLOCK_FLAG_WITH_FD,
+ * \ref PW_MEMBLOCK_FLAG_MAP_READWRITE and \ref PW_MEMBLOCK_FLAG_SEAL are
+ * allocated with \ref pw_memblock_alloc() without using the pool.
+ *
+ * The size of the memblock can be larger than \a size. Free the memblock
+ * with \ref pw_memblock_free() to give it back to the pool.
+ *
+ * \memberof pw_mempool
+ */
+int pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_flags flags, size_t size,
+		     const void * const *users, uint32_t n_users,
+		     struct pw_memblock *mem)
+{
+	struct slab *slab;
+	size_t class_size;
+	bool hugepages;
+	uint32_t i;
+
+	if (pool == NULL || flags != MEMPOOL_FLAGS)
+		return pw_memblock_alloc(flags, size, mem);
+
+	if (mem == NULL || size == 0)
+		return -EINVAL;
+
+	class_size = size_class(pool, size, &hugepages);
+
+	spa_list_for_each(slab, &pool->free_list, link) {
+		if (slab->class_size == class_size &&
+		    slab->numa_node == pool->numa_node &&
+		    slab_can_reuse(slab, users, n_users))
+			goto found;
+	}
+	if ((slab = slab_new(pool, class_size, hugepages)) == NULL)
+		return -errno;
+
+	pool->stats.n_misses++;
+	pw_log_debug("mempool %p: new slab %p of %zd bytes for %zd", pool, slab,
+		     class_size, size);
+	goto done;
+
+      found:
+	spa_list_remove(&slab->link);
+	pool->stats.n_free--;
+	pool->stats.free_size -= slab->mem.size;
+	pool->stats.n_hits++;
+	pw_log_debug("mempool %p: reuse slab %p of %zd bytes for %zd", pool, slab,
+		     class_size, size);
+
+	/* don't leak the old data to the new users */
+	if (!slab_same_users(slab, users, n_users))
+		memset(slab->mem.ptr, 0, slab->mem.size);
+
+      done:
+	slab->n_users = 0;
+	slab->discard = false;
+	for (i = 0; i < n_users; i++) {
+		if (users[i] == NULL || slab_has_user(slab, users[i]))
+			continue;
+		if (slab->n_users == MEMPOOL_MAX_USERS) {
+			slab->discard = true;
+			break;
+		}
+		slab->users[slab->n_users++] = users[i];
+	}
+	spa_list_append(&pool->used_list, &slab->link);
+	pool->stats.n_used++;
+
+	if (pool->flags & PW_MEMPOOL_FLAG_POPULATE)
+		memblock_populate(slab->mem.ptr, size, true);
+
+	*mem = slab->mem;
+	mem->pool = pool;
+
+	return 0;
+}
+
+static void mempool_release(struct pw_mempool *pool, struct pw_memblock *mem)
+{
+	struct slab *slab;
+
+	spa_list_for_each(slab, &pool->used_list, link) {
+		if (slab->mem.ptr == mem->ptr)
+			goto found;
+	}
+	pw_log_warn("mempool %p: unknown memory %p", pool, mem->ptr);
+	return;
+
+      found:
+	pool->stats.n_used--;
+
+	if (pool->destroyed) {
+		slab_free(pool, slab);
+		if (spa_list_is_empty(&pool->used_list))
+			free(pool);
+		return;
+	}
+
+	if (slab->discard || pool->max_free == 0) {
+		pool->stats.n_discarded++;
+		slab_free(pool, slab);
+		return;
+	}
+
+	spa_list_remove(&slab->link);
+	spa_list_append(&pool->free_list, &slab->link);
+	pool->stats.n_free++;
+	pool->stats.free_size += slab->mem.size;
+
+	/* drop the least recently used slab */
+	if (pool->stats.n_free > pool->max_free) {
+		slab = spa_list_first(&pool->free_list, struct slab, link);
+		pool->stats.n_free--;
+		pool->stats.free_size -= slab->mem.size;
+		pool->stats.n_discarded++;
+		slab_free(pool, slab);
+	}
+}
+
+/** Add a user to memory from the pool
+ * \param pool a pool
+ * \param fd the fd of the memory
+ * \param user the new user
+ *
+ * Call this when memory from the pool is shared with \a user after it was
+ * allocated. Nothing is done when \a fd is not from the pool.
+ *
+ * \memberof pw_mempool
+ */
+void pw_mempool_add_user(struct pw_mempool *pool, int fd, const void *user)
+{
+	struct slab *slab;
+
+	if (pool == NULL || user == NULL || fd < 0)
+		return;
+
+	spa_list_for_each(slab, &pool->used_list, link) {
+		if (slab->mem.fd != fd)
+			continue;
+		if (slab_has_user(slab, user))
+			return;
+		if (slab->n_users == MEMPOOL_MAX_USERS)
+			slab->discard = true;
+		else
+			slab->users[slab->n_users++] = user;
+		return;
+	}
+}
+
+/** Remove a user from the pool
+ * \param pool a pool
+ * \param user the user to remove
+ *
+ * Call this when \a user goes away. Free slabs that \a user had access to
+ * are freed and the slabs that are still in use will not be reused.
+ *
+ * \memberof pw_mempool
+ */
+void pw_mempool_remove_user(struct pw_mempool *pool, const void *user)
+{
+	struct slab *slab, *t;
+
+	if (pool == NULL || user == NULL)
+		return;
+
+	spa_list_for_each(slab, &pool->used_list, link) {
+		if (slab_has_user(slab, user))
+			slab->discard = true;
+	}
+	spa_list_for_each_safe(slab, t, &pool->free_list, link) {
+		if (!slab_has_user(slab, user))
+			continue;
+		pool->stats.n_free--;
+		pool->stats.free_size -= slab->mem.size;
+		pool->stats.n_discarded++;
+		slab_free(pool, slab);
+	}
+}
+
+/** Get the statistics of a pool
+ * \param pool a pool
+ * \return the pool statistics
+ * \memberof pw_mempool
+ */
+const struct pw_mempool_stats *pw_mempool_get_stats(struct pw_mempool *pool)
+{
+	return &pool->stats;
+}
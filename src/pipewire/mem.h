@@ -26,6 +26,8 @@
 extern "C" {
 #endif
 
+struct pw_mempool;
+
 /** Flags passed to \ref pw_memblock_alloc() \memberof pw_memblock */
 enum pw_memblock_flags {
 	PW_MEMBLOCK_FLAG_NONE = 0,
@@ -34,6 +36,15 @@ enum pw_memblock_flags {
 	PW_MEMBLOCK_FLAG_MAP_READ = (1 << 2),
 	PW_MEMBLOCK_FLAG_MAP_WRITE = (1 << 3),
 	PW_MEMBLOCK_FLAG_MAP_TWICE = (1 << 4),
+	PW_MEMBLOCK_FLAG_HUGEPAGES = (1 << 5),	/**< use huge pages when possible, the size
+						  *  is rounded up to the huge page size. The
+						  *  flag is removed when not possible. */
+	PW_MEMBLOCK_FLAG_POPULATE = (1 << 6),	/**< prefault the memory */
+	PW_MEMBLOCK_FLAG_SEAL_WRITE = (1 << 7),	/**< after mapping, seal the memfd so that only
+						  *  the mapping of the memblock can write, other
+						  *  mappings of the fd are read-only. Allocation
+						  *  fails with -ENOTSUP when the kernel can't
+						  *  do this. */
 };
 
 #define PW_MEMBLOCK_FLAG_MAP_READWRITE (PW_MEMBLOCK_FLAG_MAP_READ | PW_MEMBLOCK_FLAG_MAP_WRITE)
@@ -46,17 +57,63 @@ struct pw_memblock {
 	off_t offset;			/**< offset of mappable memory */
 	void *ptr;			/**< ptr to mapped memory */
 	size_t size;			/**< size of mapped memory */
+	struct pw_mempool *pool;	/**< pool of the memory, NULL when not from a pool */
 };
 
 int
 pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_memblock *mem);
 
+int
+pw_memblock_alloc_numa(enum pw_memblock_flags flags, size_t size, int numa_node,
+		       struct pw_memblock *mem);
+
 int
 pw_memblock_map(struct pw_memblock *mem);
 
 void
 pw_memblock_free(struct pw_memblock *mem);
 
+/** Flags passed to \ref pw_mempool_new() \memberof pw_mempool */
+enum pw_mempool_flags {
+	PW_MEMPOOL_FLAG_NONE = 0,
+	PW_MEMPOOL_FLAG_HUGEPAGES = (1 << 0),	/**< use huge pages for large slabs */
+	PW_MEMPOOL_FLAG_POPULATE = (1 << 1),	/**< prefault the allocated memory */
+};
+
+/** statistics of a \ref pw_mempool */
+struct pw_mempool_stats {
+	uint64_t n_hits;		/**< allocations that reused a free slab */
+	uint64_t n_misses;		/**< allocations that made a new slab */
+	uint64_t n_discarded;		/**< released slabs that were freed */
+	uint32_t n_used;		/**< slabs in use */
+	uint32_t n_free;		/**< free slabs kept for reuse */
+	size_t free_size;		/**< total size of the free slabs */
+	uint32_t n_hugepages;		/**< slabs backed by huge pages */
+};
+
+struct pw_mempool *
+pw_mempool_new(enum pw_mempool_flags flags, uint32_t max_free);
+
+void
+pw_mempool_destroy(struct pw_mempool *pool);
+
+void
+pw_mempool_set_numa_node(struct pw_mempool *pool, int numa_node);
+
+int
+pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_flags flags, size_t size,
+		 const void * const *users, uint32_t n_users,
+		 struct pw_memblock *mem);
+
+void
+pw_mempool_add_user(struct pw_mempool *pool, int fd, const void *user);
+
+void
+pw_mempool_remove_user(struct pw_mempool *pool, const void *user);
+
+const struct pw_mempool_stats *
+pw_mempool_get_stats(struct pw_mempool *pool);
+
 #ifdef __cplusplus
 }
 #endif
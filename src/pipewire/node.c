@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 
 #include <spa/clock/clock.h>
 
@@ -38,6 +39,8 @@ struct impl {
 	struct pw_node this;
 
 	struct pw_work_queue *work;
+
+	struct spa_node profile_node;
 };
 
 struct resource_data {
@@ -316,7 +319,7 @@ node_bind_func(struct pw_global *global,
 
 	spa_list_append(&this->resource_list, &resource->link);
 
-	this->info.change_mask = ~0;
+	this->info.change_mask = PW_NODE_CHANGE_MASK_ALL;
 	pw_node_resource_info(resource, &this->info);
 	this->info.change_mask = 0;
 
@@ -447,18 +450,39 @@ const struct pw_properties *pw_node_get_properties(struct pw_node *node)
 void pw_node_update_properties(struct pw_node *node, const struct spa_dict *dict)
 {
 	struct pw_resource *resource;
+	struct pw_node_info info;
+	struct spa_dict changed = { 0, };
+	struct spa_dict_item *items;
 	uint32_t i;
 
-	for (i = 0; i < dict->n_items; i++)
-		pw_properties_set(node->properties, dict->items[i].key, dict->items[i].value);
+	/* resources only receive the keys that changed */
+	changed.items = items = alloca(dict->n_items * sizeof(struct spa_dict_item));
+	for (i = 0; i < dict->n_items; i++) {
+		const char *old = pw_properties_get(node->properties, dict->items[i].key);
+		const char *value = dict->items[i].value;
+
+		if (old == value || (old && value && strcmp(old, value) == 0))
+			continue;
+
+		items[changed.n_items++] = dict->items[i];
+		pw_properties_set(node->properties, dict->items[i].key, value);
+	}
+	if (changed.n_items == 0)
+		return;
 
 	node->info.props = &node->properties->dict;
 
 	node->info.change_mask = PW_NODE_CHANGE_MASK_PROPS;
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, info_changed, &node->info);
 
+	info = node->info;
+	info.change_mask |= PW_NODE_CHANGE_MASK_PROPS_DELTA;
+	info.props = &changed;
+
 	spa_list_for_each(resource, &node->resource_list, link)
-		pw_node_resource_info(resource, &node->info);
+		pw_node_resource_info(resource, &info);
+
+	pw_core_registry_snapshot_changed(node->core);
 
 	node->info.change_mask = 0;
 }
@@ -516,6 +540,94 @@ static void node_reuse_buffer(void *data, uint32_t port_id, uint32_t buffer_id)
 }
 
 
+static inline uint64_t get_monotonic_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static void profile_update(struct pw_node_profile *p, uint64_t start, uint64_t end,
+			   uint32_t queue_depth, int res)
+{
+	uint64_t duration = end - start, usec;
+	uint32_t bucket = 0;
+
+	for (usec = duration / SPA_NSEC_PER_USEC; usec > 1; usec >>= 1)
+		if (++bucket == PW_NODE_PROFILE_HISTOGRAM_SIZE - 1)
+			break;
+
+	__atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (p->n_cycles > 0)
+		p->period = start - p->cycle_start;
+	p->n_cycles++;
+	p->cycle_start = start;
+	p->cycle_end = end;
+	p->process_time = duration;
+	if (duration > p->process_time_max)
+		p->process_time_max = duration;
+	if (res < 0)
+		p->xrun_count++;
+	p->queue_depth = queue_depth;
+	p->histogram[bucket]++;
+
+	__atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELEASE);
+}
+
+static int profile_process(struct pw_node *this, bool input)
+{
+	struct pw_node_profile *p = this->rt.profile;
+	struct spa_graph_port *gp;
+	uint32_t queue_depth = 0;
+	uint64_t start;
+	int res;
+
+	if (p == NULL)
+		return input ? spa_node_process_input(this->node) :
+			       spa_node_process_output(this->node);
+
+	spa_list_for_each(gp, &this->rt.node.ports[SPA_DIRECTION_INPUT], link) {
+		if (gp->io && gp->io->status == SPA_STATUS_HAVE_BUFFER)
+			queue_depth++;
+	}
+
+	start = get_monotonic_time();
+	res = input ? spa_node_process_input(this->node) :
+		      spa_node_process_output(this->node);
+	profile_update(p, start, get_monotonic_time(), queue_depth, res);
+
+	return res;
+}
+
+static int profile_process_input(struct spa_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, profile_node);
+	return profile_process(&impl->this, true);
+}
+
+static int profile_process_output(struct spa_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, profile_node);
+	return profile_process(&impl->this, false);
+}
+
+static int profile_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, profile_node);
+	return spa_node_port_reuse_buffer(impl->this.node, port_id, buffer_id);
+}
+
+/* the graph node implementation, collects statistics when profiling */
+static const struct spa_node profile_node = {
+	SPA_VERSION_NODE,
+	NULL,
+	.process_input = profile_process_input,
+	.process_output = profile_process_output,
+	.port_reuse_buffer = profile_port_reuse_buffer,
+};
+
 static const struct spa_node_callbacks node_callbacks = {
 	SPA_VERSION_NODE_CALLBACKS,
 	.done = node_done,
@@ -529,9 +641,12 @@ static const struct spa_node_callbacks node_callbacks = {
 void pw_node_set_implementation(struct pw_node *node,
 				struct spa_node *spa_node)
 {
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+
 	node->node = spa_node;
 	spa_node_set_callbacks(node->node, &node_callbacks, node);
-	spa_graph_node_set_implementation(&node->rt.node, spa_node);
+	impl->profile_node = profile_node;
+	spa_graph_node_set_implementation(&node->rt.node, &impl->profile_node);
 
 	if (spa_node->info)
 		pw_node_update_properties(node, spa_node->info);
@@ -542,6 +657,22 @@ struct spa_node *pw_node_get_implementation(struct pw_node *node)
 	return node->node;
 }
 
+static int
+do_set_profile(struct spa_loop *loop,
+	       bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	struct pw_node *this = user_data;
+	this->rt.profile = *(struct pw_node_profile **) data;
+	return 0;
+}
+
+void pw_node_set_profile(struct pw_node *node, struct pw_node_profile *profile)
+{
+	pw_log_debug("node %p: set profile %p", node, profile);
+	pw_loop_invoke(node->data_loop, do_set_profile, SPA_ID_INVALID,
+		       sizeof(profile), &profile, true, node);
+}
+
 void pw_node_add_listener(struct pw_node *node,
 			   struct spa_hook *listener,
 			   const struct pw_node_events *events,
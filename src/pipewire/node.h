@@ -89,6 +89,48 @@ struct pw_node_events {
 	void (*reuse_buffer) (void *data, uint32_t port_id, uint32_t buffer_id);
 };
 
+/** Number of buckets in the process time histogram of \ref pw_node_profile */
+#define PW_NODE_PROFILE_HISTOGRAM_SIZE	16
+
+/** \class pw_node_profile
+ *
+ * Processing statistics of a node. The structure is updated from the
+ * data thread after each process cycle of the node and can be placed in
+ * shared memory. The \a seq field is odd while the statistics are being
+ * updated, use \ref pw_node_profile_read to get a consistent copy.
+ */
+struct pw_node_profile {
+	uint32_t seq;			/**< update sequence number */
+	uint32_t node_id;		/**< global id of the node or SPA_ID_INVALID */
+	uint64_t n_cycles;		/**< number of process cycles */
+	uint64_t cycle_start;		/**< start of the last cycle, CLOCK_MONOTONIC nsec */
+	uint64_t cycle_end;		/**< end of the last cycle, CLOCK_MONOTONIC nsec */
+	uint64_t period;		/**< time between the start of the last 2 cycles in nsec */
+	uint64_t process_time;		/**< duration of the last cycle in nsec */
+	uint64_t process_time_max;	/**< maximum duration of a cycle in nsec */
+	uint32_t xrun_count;		/**< number of cycles that returned an error */
+	uint32_t queue_depth;		/**< number of input ports with a pending buffer at the
+					  *  start of the last cycle */
+	uint32_t histogram[PW_NODE_PROFILE_HISTOGRAM_SIZE];	/**< number of cycles with a duration
+								  *  between 2^n and 2^(n+1) usec */
+};
+
+/** Make a consistent copy of \a profile in \a copy. Returns false when
+ * \a profile was being updated, the caller should retry later. */
+static inline bool
+pw_node_profile_read(const struct pw_node_profile *profile, struct pw_node_profile *copy)
+{
+	uint32_t seq1, seq2;
+
+	seq1 = __atomic_load_n(&profile->seq, __ATOMIC_ACQUIRE);
+	if (seq1 & 1)
+		return false;
+	*copy = *profile;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	seq2 = __atomic_load_n(&profile->seq, __ATOMIC_RELAXED);
+	return seq1 == seq2;
+}
+
 /** Automatically connect this node to a compatible node */
 #define PW_NODE_PROP_AUTOCONNECT	"pipewire.autoconnect"
 /** Try to connect the node to this node id */
@@ -132,6 +174,11 @@ void pw_node_set_implementation(struct pw_node *node, struct spa_node *spa_node)
 /** Get the node implementation */
 struct spa_node *pw_node_get_implementation(struct pw_node *node);
 
+/** Collect processing statistics of the node in \a profile, NULL disables
+ * profiling. The memory of \a profile should remain valid until profiling
+ * is disabled or the node is destroyed. */
+void pw_node_set_profile(struct pw_node *node, struct pw_node_profile *profile);
+
 /** Add an event listener */
 void pw_node_add_listener(struct pw_node *node,
 			  struct spa_hook *listener,
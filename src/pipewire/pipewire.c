@@ -74,7 +74,8 @@ open_support(const char *path,
 static void *
 load_interface(struct support_info *info,
 	       const char *factory_name,
-	       const char *type)
+	       const char *type,
+	       const struct spa_dict *props)
 {
         int res;
         struct spa_handle *handle;
@@ -89,7 +90,7 @@ load_interface(struct support_info *info,
 
         handle = calloc(1, factory->size);
         if ((res = spa_handle_factory_init(factory,
-                                           handle, NULL, info->support, info->n_support)) < 0) {
+                                           handle, props, info->support, info->n_support)) < 0) {
                 fprintf(stderr, "can't make factory instance: %d\n", res);
                 goto init_failed;
         }
@@ -127,13 +128,21 @@ static void configure_debug(const char *str)
 static void configure_support(struct support_info *info)
 {
 	void *iface;
+	struct spa_dict_item items[1];
+	struct spa_dict props;
+	uint32_t n_items = 0;
+	const char *str;
 
-	iface = load_interface(info, "mapper", SPA_TYPE__TypeMap);
+	iface = load_interface(info, "mapper", SPA_TYPE__TypeMap, NULL);
 	if (iface != NULL) {
 		info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, iface);
 	}
 
-	iface = load_interface(info, "logger", SPA_TYPE__Log);
+	if ((str = getenv("PIPEWIRE_LOG_BINARY_TRACE")) != NULL)
+		items[n_items++] = (struct spa_dict_item) { "log.binary-trace", str };
+	props = (struct spa_dict) SPA_DICT_INIT(n_items, items);
+
+	iface = load_interface(info, "logger", SPA_TYPE__Log, &props);
 	if (iface != NULL) {
 		info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__Log, iface);
 		pw_log_set(iface);
@@ -189,6 +198,10 @@ const struct spa_support *pw_get_support(uint32_t *n_support)
  *
  * The environment variable \a PIPEWIRE_DEBUG
  *
+ * When \a PIPEWIRE_LOG_BINARY_TRACE is set to 1, trace messages are
+ * captured as binary records in per-thread lock-free rings and
+ * formatted later outside of the calling thread.
+ *
  * \memberof pw_pipewire
  */
 void pw_init(int *argc, char **argv[])
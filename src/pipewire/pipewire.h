@@ -40,6 +40,7 @@ extern "C" {
 #include <pipewire/port.h>
 #include <pipewire/properties.h>
 #include <pipewire/proxy.h>
+#include <pipewire/registry-snapshot.h>
 #include <pipewire/remote.h>
 #include <pipewire/resource.h>
 #include <pipewire/stream.h>
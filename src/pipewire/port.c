@@ -53,6 +53,8 @@ static int schedule_tee_input(struct spa_node *data)
 
 	if (!spa_list_is_empty(&node->ports[SPA_DIRECTION_OUTPUT])) {
 		pw_log_trace("tee input %d %d", io->status, io->buffer_id);
+		if (io->status == SPA_STATUS_HAVE_BUFFER)
+			this->rt.n_passthrough++;
 		spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link)
 			*p->io = *io;
 		io->buffer_id = SPA_ID_INVALID;
@@ -102,15 +104,34 @@ static int schedule_mix_input(struct spa_node *data)
 	struct impl *impl = SPA_CONTAINER_OF(data, struct impl, mix_node);
         struct pw_port *this = &impl->this;
 	struct spa_graph_node *node = &this->rt.mix_node;
-	struct spa_graph_port *p;
+	struct spa_graph_port *p, *active = NULL;
 	struct spa_port_io *io = this->rt.mix_port.io;
+	uint32_t n_active = 0;
 
+	/* forward the buffer of the input that has one, without copying */
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
 		pw_log_trace("mix %p: input %p %p->%p %d %d", node,
 				p, p->io, io, p->io->status, p->io->buffer_id);
-		*io = *p->io;
-		p->io->buffer_id = SPA_ID_INVALID;
-		break;
+		if (active == NULL)
+			active = p;
+		if (p->io->status != SPA_STATUS_HAVE_BUFFER ||
+		    p->io->buffer_id == SPA_ID_INVALID)
+			continue;
+		if (n_active++ == 0)
+			active = p;
+	}
+	if (active) {
+		*io = *active->io;
+		active->io->buffer_id = SPA_ID_INVALID;
+	}
+
+	/* there is no mixer here, with more inputs the other buffers stay
+	 * queued for the next cycles as before */
+	if (n_active == 1)
+		this->rt.n_passthrough++;
+	else if (n_active > 1) {
+		pw_log_trace("mix %p: %d active inputs, one is forwarded", node, n_active);
+		this->rt.n_mixed++;
 	}
 	return io->status;
 }
@@ -321,7 +342,8 @@ void pw_port_destroy(struct pw_port *port)
 {
 	struct pw_node *node = port->node;
 
-	pw_log_debug("port %p: destroy", port);
+	pw_log_debug("port %p: destroy, %" PRIu64 " passthrough %" PRIu64 " mixed cycles", port,
+		     port->rt.n_passthrough, port->rt.n_mixed);
 
 	spa_hook_list_call(&port->listener_list, struct pw_port_events, destroy);
 
@@ -27,6 +27,7 @@ extern "C" {
 #include <sys/socket.h>
 
 
+#include "pipewire/array.h"
 #include "pipewire/mem.h"
 #include "pipewire/pipewire.h"
 #include "pipewire/introspect.h"
@@ -87,6 +88,8 @@ struct pw_client {
 
 	struct spa_list resource_list;	/**< The list of resources of this client */
 
+	struct pw_array permission_cache;	/**< cached permissions, indexed by global id */
+
 	bool busy;
 
 	struct spa_hook_list listener_list;
@@ -111,6 +114,17 @@ struct pw_global {
 	pw_bind_func_t bind;		/**< function to bind to the interface */
 
 	void *object;			/**< object associated with the interface */
+
+	uint64_t serial;		/**< creation order, increases along the global list */
+};
+
+/** a registry that is still sending the existing globals to its client */
+struct pw_registry_sync {
+	struct spa_list link;		/**< link in core registry_sync_list */
+	struct pw_resource *resource;	/**< the registry resource */
+	struct pw_global *next;		/**< next global to send, NULL when all are sent */
+	uint64_t start;			/**< time the registry was bound */
+	uint32_t n_batches;		/**< number of batches used */
 };
 
 struct pw_core {
@@ -131,6 +145,8 @@ struct pw_core {
 	struct spa_list remote_list;		/**< list of remote connections */
 	struct spa_list resource_list;		/**< list of core resources */
 	struct spa_list registry_resource_list;	/**< list of registry resources */
+	struct spa_list registry_sync_list;	/**< list of registries sending initial globals */
+	struct spa_source *registry_sync_source;	/**< idle source to continue syncs */
 	struct spa_list module_list;		/**< list of modules */
 	struct spa_list global_list;		/**< list of globals */
 	struct spa_list client_list;		/**< list of clients */
@@ -140,6 +156,24 @@ struct pw_core {
 
 	struct spa_hook_list listener_list;
 
+	uint64_t global_serial;		/**< serial of the next global */
+	struct pw_core_stats stats;	/**< registry and permission statistics */
+
+	struct {
+		struct pw_memblock mem;		/**< shared memory, fd is -1 when not allocated */
+		int fd;				/**< read-only fd of mem, sent to clients */
+		struct pw_array data;		/**< serialized globals */
+		struct spa_list subscriber_list;	/**< core resources that use the snapshot */
+		struct spa_source *source;	/**< idle source to publish changes */
+		uint64_t serial;		/**< serial of the last update */
+		uint32_t seq;			/**< sequence lock, the shared copy is
+						  *  only written to */
+		bool dirty;			/**< globals changed since the last update */
+		bool unsupported;		/**< the memory can't be sealed, no snapshot */
+	} snapshot;			/**< shared memory registry snapshot */
+
+	struct pw_mempool *mempool;	/**< pool for link buffer memory */
+
 	struct pw_loop *main_loop;	/**< main loop for control */
 	struct pw_loop *data_loop;	/**< data loop for data passing */
         struct pw_data_loop *data_loop_impl;
@@ -157,10 +191,25 @@ struct pw_data_loop {
 
 	struct spa_hook_list listener_list;
 
+	struct pw_properties *properties;	/**< properties, not owned */
+
         struct spa_source *event;
 
         bool running;
         pthread_t thread;
+
+	struct {
+		int prio;		/**< requested realtime priority, <= 0 disables */
+		long long time;		/**< RLIMIT_RTTIME in usec, < 0 leaves it unchanged */
+		bool mlock;		/**< lock all memory */
+
+		pthread_mutex_t lock;
+		pthread_cond_t cond;
+		bool started;		/**< scheduling was configured */
+		int policy;		/**< resulting scheduling policy */
+		int result_prio;	/**< resulting priority */
+		int numa_node;		/**< NUMA node of the thread or -1 */
+	} rt;
 };
 
 struct pw_main_loop {
@@ -172,6 +221,12 @@ struct pw_main_loop {
         bool running;
 };
 
+/** Layout of the buffers allocated by a link. The metadata of a buffer is
+ * followed by the chunks, each meta is aligned to PW_BUFFER_META_ALIGN and
+ * the chunks start at a multiple of PW_BUFFER_AREA_ALIGN. */
+#define PW_BUFFER_META_ALIGN	8
+#define PW_BUFFER_AREA_ALIGN	64
+
 struct pw_link {
 	struct pw_core *core;		/**< core object */
 	struct spa_list link;		/**< link in core link_list */
@@ -254,6 +309,7 @@ struct pw_node {
 	struct {
 		struct spa_graph *graph;
 		struct spa_graph_node node;
+		struct pw_node_profile *profile;	/**< processing statistics or NULL */
 	} rt;
 
         void *user_data;                /**< extra user data */
@@ -288,6 +344,8 @@ struct pw_port {
 		struct spa_graph_port port;	/**< this graph port, linked to mix_port */
 		struct spa_graph_port mix_port;	/**< port from the mixer */
 		struct spa_graph_node mix_node;	/**< mixer node */
+		uint64_t n_passthrough;		/**< cycles with one input buffer, forwarded */
+		uint64_t n_mixed;		/**< cycles with more than one input buffer */
 	} rt;					/**< data only accessed from the data thread */
 
         void *user_data;                /**< extra user data */
@@ -391,6 +449,10 @@ struct pw_factory {
 	void *user_data;
 };
 
+/** Schedule an update of the registry snapshot after globals or their
+ * properties changed */
+void pw_core_registry_snapshot_changed(struct pw_core *core);
+
 /** Find a good format between 2 ports */
 int pw_core_find_format(struct pw_core *core,
 			struct pw_port *output,
@@ -0,0 +1,199 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_REGISTRY_SNAPSHOT_H__
+#define __PIPEWIRE_REGISTRY_SNAPSHOT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/dict.h>
+
+/** \class pw_registry_snapshot
+ *
+ * \brief A read-only shared memory view of the server globals
+ *
+ * Clients that only need to look at the globals and their properties
+ * can map a snapshot of the registry instead of binding every global.
+ * The snapshot is requested with pw_core_proxy_get_registry_snapshot()
+ * and the server replies with the registry_snapshot event that carries
+ * a read-only memfd.
+ *
+ * The memory starts with a struct pw_registry_snapshot followed by
+ * \a n_globals entries. Each entry is a struct pw_registry_snapshot_global
+ * followed by the type name of the global and \a n_props key/value pairs,
+ * all stored as NUL terminated strings.
+ *
+ * The server updates the memory in place, protected with a sequence
+ * lock, and emits the registry_snapshot event again after each update.
+ * Readers copy the snapshot with pw_registry_snapshot_copy() and parse
+ * the copy.
+ */
+#define PW_REGISTRY_SNAPSHOT_MAGIC	0x50575253	/* "PWRS" */
+#define PW_REGISTRY_SNAPSHOT_VERSION	0
+
+/** The header of the snapshot \memberof pw_registry_snapshot */
+struct pw_registry_snapshot {
+	uint32_t magic;		/**< PW_REGISTRY_SNAPSHOT_MAGIC */
+	uint32_t version;	/**< PW_REGISTRY_SNAPSHOT_VERSION */
+	uint32_t seq;		/**< sequence lock, odd while the server is writing */
+	uint32_t n_globals;	/**< number of globals */
+	uint64_t serial;	/**< incremented for each update */
+	uint32_t size;		/**< size of the snapshot including this header */
+	uint32_t padding;
+};
+
+/** A global in the snapshot \memberof pw_registry_snapshot */
+struct pw_registry_snapshot_global {
+	uint32_t size;		/**< size of the entry and its strings, multiple of 8 */
+	uint32_t id;		/**< id of the global */
+	uint32_t parent_id;	/**< id of the parent global */
+	uint32_t version;	/**< version of the interface */
+	uint32_t n_props;	/**< number of properties */
+	uint32_t padding;
+};
+
+/** Make a consistent copy of a snapshot
+ * \param snap the mapped snapshot
+ * \param size the size of the mapping
+ * \param data destination
+ * \param maxsize size of \a data
+ * \return the number of bytes copied, -ENOSPC when \a maxsize is too small
+ *         or -EINVAL when \a snap is not a valid snapshot
+ * \memberof pw_registry_snapshot
+ */
+static inline int
+pw_registry_snapshot_copy(const struct pw_registry_snapshot *snap, size_t size,
+			  void *data, size_t maxsize)
+{
+	uint32_t seq, len;
+
+	if (size < sizeof(*snap) ||
+	    snap->magic != PW_REGISTRY_SNAPSHOT_MAGIC ||
+	    snap->version != PW_REGISTRY_SNAPSHOT_VERSION)
+		return -EINVAL;
+
+	do {
+		seq = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		len = snap->size;
+		if (len < sizeof(*snap) || len > size || len > maxsize) {
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&snap->seq, __ATOMIC_RELAXED) != seq)
+				continue;
+			return len > maxsize && len <= size ? -ENOSPC : -EINVAL;
+		}
+		memcpy(data, snap, len);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (seq & 1 || __atomic_load_n(&snap->seq, __ATOMIC_RELAXED) != seq);
+
+	return len;
+}
+
+/** Get the first global of a snapshot copy \memberof pw_registry_snapshot */
+static inline const struct pw_registry_snapshot_global *
+pw_registry_snapshot_first(const struct pw_registry_snapshot *snap)
+{
+	const struct pw_registry_snapshot_global *g;
+
+	if (snap->n_globals == 0 || snap->size < sizeof(*snap) + sizeof(*g))
+		return NULL;
+
+	g = SPA_MEMBER(snap, sizeof(*snap), const struct pw_registry_snapshot_global);
+	if (g->size < sizeof(*g) || g->size > snap->size - sizeof(*snap))
+		return NULL;
+
+	return g;
+}
+
+/** Get the global after \a g or NULL \memberof pw_registry_snapshot */
+static inline const struct pw_registry_snapshot_global *
+pw_registry_snapshot_next(const struct pw_registry_snapshot *snap,
+			  const struct pw_registry_snapshot_global *g)
+{
+	size_t offset = SPA_PTRDIFF(g, snap) + g->size;
+
+	if (offset + sizeof(*g) > snap->size)
+		return NULL;
+
+	g = SPA_MEMBER(snap, offset, const struct pw_registry_snapshot_global);
+	if (g->size < sizeof(*g) || g->size > snap->size - offset)
+		return NULL;
+
+	return g;
+}
+
+#define pw_registry_snapshot_for_each(g, snap)			\
+	for (g = pw_registry_snapshot_first(snap);		\
+	     g;							\
+	     g = pw_registry_snapshot_next(snap, g))
+
+/** Parse the strings of a global
+ * \param g a global
+ * \param[out] type the type name of the global
+ * \param items array to fill with properties
+ * \param max_items size of \a items
+ * \return the number of properties in \a items or -EINVAL when \a g
+ *         is corrupted
+ * \memberof pw_registry_snapshot
+ */
+static inline int
+pw_registry_snapshot_global_parse(const struct pw_registry_snapshot_global *g,
+				  const char **type,
+				  struct spa_dict_item *items, uint32_t max_items)
+{
+	const char *s = SPA_MEMBER(g, sizeof(*g), const char);
+	const char *end = SPA_MEMBER(g, g->size, const char);
+	uint32_t i;
+
+	if (memchr(s, '\0', end - s) == NULL)
+		return -EINVAL;
+
+	*type = s;
+	s += strlen(s) + 1;
+
+	for (i = 0; i < g->n_props && i < max_items; i++) {
+		const char *key = s, *value;
+
+		if (s >= end || memchr(s, '\0', end - s) == NULL)
+			return -EINVAL;
+		value = s + strlen(s) + 1;
+		if (value >= end || memchr(value, '\0', end - value) == NULL)
+			return -EINVAL;
+		s = value + strlen(value) + 1;
+
+		items[i].key = key;
+		items[i].value = value;
+	}
+	return i;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIPEWIRE_REGISTRY_SNAPSHOT_H__ */
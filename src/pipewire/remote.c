@@ -48,6 +48,7 @@ struct remote {
 
 struct mem_id {
 	uint32_t id;
+	uint32_t type;
 	int fd;
 	uint32_t flags;
 	void *ptr;
@@ -908,6 +909,7 @@ client_node_port_add_mem(void *object,
 			     mem_id, memfd, flags, offset, size);
 	}
 	m->id = mem_id;
+	m->type = type;
 	m->fd = memfd;
 	m->flags = flags;
 	m->ptr = NULL;
@@ -999,8 +1001,9 @@ client_node_port_use_buffers(void *object,
 			struct spa_meta *m = &b->metas[j];
 			memcpy(m, &buffers[i].buffer->metas[j], sizeof(struct spa_meta));
 			m->data = SPA_MEMBER(bid->buf_ptr, offset, void);
-			offset += m->size;
+			offset += SPA_ROUND_UP_N(m->size, PW_BUFFER_META_ALIGN);
 		}
+		offset = SPA_ROUND_UP_N(offset, PW_BUFFER_AREA_ALIGN);
 
 		for (j = 0; j < b->n_datas; j++) {
 			struct spa_data *d = &b->datas[j];
@@ -1014,8 +1017,16 @@ client_node_port_use_buffers(void *object,
 				struct mem_id *bmid = find_mem(port, SPA_PTR_TO_UINT32(d->data));
 				void *map;
 
-				d->type = proxy->remote->core->type.data.MemFd;
+				d->type = bmid->type;
 				d->fd = bmid->fd;
+
+				/* dmabufs are passed on as fds, nodes that need CPU access
+				 * map them themselves */
+				if (d->type == proxy->remote->core->type.data.DmaBuf) {
+					d->data = NULL;
+					pw_log_debug(" data %d %u -> dmabuf %d", j, bmid->id, bmid->fd);
+					continue;
+				}
 				map = mmap(NULL, d->maxsize + d->mapoffset, prot, MAP_SHARED, d->fd, 0);
 				if (map == MAP_FAILED) {
 					pw_log_error("data %d failed to mmap memory %m", j);
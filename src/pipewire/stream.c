@@ -21,9 +21,12 @@
 #include <sys/socket.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
 #include <errno.h>
 #include <time.h>
 
+#include <linux/dma-buf.h>
+
 #include "spa/lib/debug.h"
 
 #include "pipewire/pipewire.h"
@@ -44,6 +47,7 @@
 
 struct mem_id {
 	uint32_t id;
+	uint32_t type;
 	int fd;
 	uint32_t flags;
 	void *ptr;
@@ -515,6 +519,18 @@ static struct mem_id *find_mem(struct pw_stream *stream, uint32_t id)
 	return NULL;
 }
 
+static struct mem_id *find_mem_fd(struct pw_stream *stream, int fd)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct mem_id *mid;
+
+	pw_array_for_each(mid, &impl->mem_ids) {
+		if (mid->fd == fd)
+			return mid;
+	}
+	return NULL;
+}
+
 static struct buffer_id *find_buffer(struct pw_stream *stream, uint32_t id)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
@@ -812,6 +828,7 @@ client_node_port_add_mem(void *data,
 			     mem_id, memfd, flags, offset, size);
 	}
 	m->id = mem_id;
+	m->type = type;
 	m->fd = memfd;
 	m->flags = flags;
 	m->ptr = NULL;
@@ -896,8 +913,9 @@ client_node_port_use_buffers(void *data,
 			struct spa_meta *m = &b->metas[j];
 			memcpy(m, &buffers[i].buffer->metas[j], sizeof(struct spa_meta));
 			m->data = SPA_MEMBER(bid->buf_ptr, offset, void);
-			offset += m->size;
+			offset += SPA_ROUND_UP_N(m->size, PW_BUFFER_META_ALIGN);
 		}
+		offset = SPA_ROUND_UP_N(offset, PW_BUFFER_AREA_ALIGN);
 
 		for (j = 0; j < b->n_datas; j++) {
 			struct spa_data *d = &b->datas[j];
@@ -909,7 +927,8 @@ client_node_port_use_buffers(void *data,
 
 			if (d->type == stream->remote->core->type.data.Id) {
 				struct mem_id *bmid = find_mem(stream, SPA_PTR_TO_UINT32(d->data));
-				d->type = stream->remote->core->type.data.MemFd;
+				/* mapped on demand with pw_stream_map_data() */
+				d->type = bmid->type;
 				d->data = NULL;
 				d->fd = bmid->fd;
 				pw_log_debug(" data %d %u -> fd %d", j, bmid->id, bmid->fd);
@@ -1155,6 +1174,76 @@ struct spa_buffer *pw_stream_peek_buffer(struct pw_stream *stream, uint32_t id)
 	return NULL;
 }
 
+static int sync_dmabuf(struct pw_stream *stream, struct spa_data *d, uint64_t flags)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct dma_buf_sync sync;
+
+	if (d->type != stream->remote->core->type.data.DmaBuf || d->fd == -1)
+		return 0;
+
+	sync.flags = flags | (impl->direction == SPA_DIRECTION_OUTPUT ?
+			DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ);
+
+	while (ioctl(d->fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+		if (errno != EINTR && errno != EAGAIN) {
+			pw_log_warn("stream %p: dmabuf sync failed: %m", stream);
+			return -errno;
+		}
+	}
+	return 0;
+}
+
+void *pw_stream_map_data(struct pw_stream *stream, uint32_t id, uint32_t index)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer_id *bid;
+	struct mem_id *mid;
+	struct spa_data *d;
+	int prot;
+
+	if ((bid = find_buffer(stream, id)) == NULL || index >= bid->buf->n_datas)
+		return NULL;
+
+	d = &bid->buf->datas[index];
+	if (d->data != NULL || d->fd == -1)
+		goto done;
+
+	if ((mid = find_mem_fd(stream, d->fd)) == NULL)
+		return NULL;
+
+	if (mid->ptr == NULL) {
+		prot = PROT_READ | (impl->direction == SPA_DIRECTION_OUTPUT ? PROT_WRITE : 0);
+		mid->ptr = mmap(NULL, mid->size + mid->offset, prot, MAP_SHARED, mid->fd, 0);
+		if (mid->ptr == MAP_FAILED) {
+			mid->ptr = NULL;
+			pw_log_warn("stream %p: failed to mmap memory %d: %m", stream, mid->id);
+			return NULL;
+		}
+		pw_log_debug("stream %p: mapped memory %d %p", stream, mid->id, mid->ptr);
+	}
+	d->data = SPA_MEMBER(mid->ptr, d->mapoffset, void);
+
+      done:
+	if (d->data != NULL && sync_dmabuf(stream, d, DMA_BUF_SYNC_START) < 0)
+		return NULL;
+
+	return d->data;
+}
+
+void pw_stream_unmap_data(struct pw_stream *stream, uint32_t id, uint32_t index)
+{
+	struct buffer_id *bid;
+	struct spa_data *d;
+
+	if ((bid = find_buffer(stream, id)) == NULL || index >= bid->buf->n_datas)
+		return;
+
+	d = &bid->buf->datas[index];
+	if (d->data != NULL)
+		sync_dmabuf(stream, d, DMA_BUF_SYNC_END);
+}
+
 bool pw_stream_send_buffer(struct pw_stream *stream, uint32_t id)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
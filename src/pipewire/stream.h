@@ -314,6 +314,25 @@ bool pw_stream_recycle_buffer(struct pw_stream *stream, uint32_t id);
 struct spa_buffer *
 pw_stream_peek_buffer(struct pw_stream *stream, uint32_t id);
 
+/** Map data plane \a index of the buffer with \a id \memberof pw_stream
+ * \return a pointer to the data or NULL on error
+ *
+ * MemFd and DmaBuf data is not mapped when the buffers are added, the
+ * data pointer of those planes is NULL. This function maps the memory
+ * on first use and keeps it mapped until the buffers are cleared.
+ *
+ * For DmaBuf memory this also starts CPU access, call
+ * pw_stream_unmap_data() when done with the data. */
+void *
+pw_stream_map_data(struct pw_stream *stream, uint32_t id, uint32_t index);
+
+/** End CPU access to data plane \a index of the buffer with \a id \memberof pw_stream
+ *
+ * The memory stays mapped, this only ends the access started with
+ * pw_stream_map_data(). */
+void
+pw_stream_unmap_data(struct pw_stream *stream, uint32_t id, uint32_t index);
+
 /** Send a buffer with \a id to \a stream \memberof pw_stream
  * \return true when \a id was handled, false on error
  *
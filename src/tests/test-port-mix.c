@@ -0,0 +1,85 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/private.h>
+
+/* two producers linked to one input port without a mixer */
+static void test_two_producers(void)
+{
+	struct pw_port *port;
+	struct spa_port_io io[2] = { SPA_PORT_IO_INIT, SPA_PORT_IO_INIT };
+	struct spa_graph_port in[2];
+	struct spa_node *mix;
+	int i;
+
+	port = pw_port_new(PW_DIRECTION_INPUT, 0, NULL, 0);
+	assert(port != NULL);
+
+	for (i = 0; i < 2; i++) {
+		spa_graph_port_init(&in[i], SPA_DIRECTION_INPUT, i, 0, &io[i]);
+		spa_graph_port_add(&port->rt.mix_node, &in[i]);
+	}
+	mix = port->rt.mix_node.implementation;
+
+	/* one producer has a buffer, it is forwarded */
+	io[1].status = SPA_STATUS_HAVE_BUFFER;
+	io[1].buffer_id = 3;
+	assert(spa_node_process_input(mix) == SPA_STATUS_HAVE_BUFFER);
+	assert(port->io.buffer_id == 3);
+	assert(io[1].buffer_id == SPA_ID_INVALID);
+	assert(port->rt.n_passthrough == 1);
+	assert(port->rt.n_mixed == 0);
+
+	/* both producers have a buffer, one is forwarded and the other one
+	 * stays queued, nothing is dropped */
+	io[0].status = SPA_STATUS_HAVE_BUFFER;
+	io[0].buffer_id = 1;
+	io[1].status = SPA_STATUS_HAVE_BUFFER;
+	io[1].buffer_id = 5;
+	assert(spa_node_process_input(mix) == SPA_STATUS_HAVE_BUFFER);
+	assert(port->io.buffer_id == 1);
+	assert(io[0].buffer_id == SPA_ID_INVALID);
+	assert(io[1].status == SPA_STATUS_HAVE_BUFFER);
+	assert(io[1].buffer_id == 5);
+	assert(port->rt.n_passthrough == 1);
+	assert(port->rt.n_mixed == 1);
+
+	/* the queued buffer is forwarded in the next cycle */
+	assert(spa_node_process_input(mix) == SPA_STATUS_HAVE_BUFFER);
+	assert(port->io.buffer_id == 5);
+	assert(io[1].buffer_id == SPA_ID_INVALID);
+	assert(port->rt.n_passthrough == 2);
+	assert(port->rt.n_mixed == 1);
+
+	for (i = 0; i < 2; i++)
+		spa_graph_port_remove(&in[i]);
+	pw_port_destroy(port);
+}
+
+int main(int argc, char *argv[])
+{
+	test_two_producers();
+
+	printf("ok\n");
+	return 0;
+}
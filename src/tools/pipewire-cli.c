@@ -21,9 +21,11 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include <spa/lib/debug.h>
 
@@ -32,8 +34,12 @@
 #include <pipewire/interfaces.h>
 #include <pipewire/type.h>
 
+#include <extensions/profiler.h>
+
 static const char WHITESPACE[] = " \t";
 
+struct pw_protocol *pw_protocol_native_ext_profiler_init(struct pw_core *core);
+
 struct remote_data;
 
 struct data {
@@ -45,6 +51,8 @@ struct data {
 	struct remote_data *current;
 
 	struct pw_map vars;
+
+	struct pw_protocol *profiler_protocol;
 };
 
 struct global {
@@ -73,6 +81,15 @@ struct remote_data {
 	struct spa_hook registry_listener;
 
 	struct pw_map globals;
+
+	struct pw_proxy *profiler;
+	struct spa_hook profiler_listener;
+	struct spa_hook profiler_proxy_listener;
+	struct pw_profiler_area *profiler_area;
+	void *profiler_map;
+	size_t profiler_size;
+	struct spa_source *profiler_timer;
+	int profiler_updates;
 };
 
 struct proxy_data;
@@ -158,6 +175,7 @@ static bool do_destroy_node(struct data *data, const char *cmd, char *args, char
 static bool do_create_link(struct data *data, const char *cmd, char *args, char **error);
 static bool do_destroy_link(struct data *data, const char *cmd, char *args, char **error);
 static bool do_export_node(struct data *data, const char *cmd, char *args, char **error);
+static bool do_profile(struct data *data, const char *cmd, char *args, char **error);
 
 static struct command command_list[] = {
 	{ "help", "Show this help", do_help },
@@ -174,6 +192,7 @@ static struct command command_list[] = {
 	{ "create-link", "Create a link between nodes. <node-id> <port-id> <node-id> <port-id> [<properties>]", do_create_link },
 	{ "destroy-link", "Destroy a link. <link-var>", do_destroy_link },
 	{ "export-node", "Export a local node to the current remote. <node-id> [remote-var]", do_export_node },
+	{ "profile", "Show node processing statistics, every second. [<count>]", do_profile },
 };
 
 static bool do_help(struct data *data, const char *cmd, char *args, char **error)
@@ -318,6 +337,11 @@ static void on_remote_destroy(void *_data)
 
 	spa_list_remove(&rd->link);
 
+	if (rd->profiler_timer)
+		pw_loop_destroy_source(pw_main_loop_get_loop(data->loop), rd->profiler_timer);
+	if (rd->profiler_map)
+		munmap(rd->profiler_map, rd->profiler_size);
+
 	pw_map_remove(&data->vars, rd->id);
 	pw_map_for_each(&rd->globals, destroy_global, rd);
 
@@ -1006,6 +1030,164 @@ static bool do_export_node(struct data *data, const char *cmd, char *args, char
 	return false;
 }
 
+static void print_profile(struct remote_data *rd)
+{
+	struct pw_node_profile *nodes, p;
+	uint32_t i, j, retry;
+
+	nodes = PW_PROFILER_AREA_NODES(rd->profiler_area);
+
+	fprintf(stdout, "remote %d profile:\n", rd->id);
+	fprintf(stdout, "\t%-6s %-10s %-10s %-10s %-10s %-7s %-6s %-5s %s\n",
+			"node", "cycles", "period", "last", "max", "load", "xruns", "queue",
+			"histogram (usec:count)");
+
+	for (i = 0; i < rd->profiler_area->n_nodes; i++) {
+		if (nodes[i].node_id == SPA_ID_INVALID)
+			continue;
+
+		for (retry = 0; retry < 16; retry++) {
+			if (pw_node_profile_read(&nodes[i], &p))
+				break;
+		}
+		if (retry == 16 || p.node_id == SPA_ID_INVALID)
+			continue;
+
+		fprintf(stdout, "\t%-6u %-10" PRIu64 " %-10.1f %-10.1f %-10.1f %6.2f%% %-6u %-5u",
+			p.node_id, p.n_cycles,
+			p.period / 1000.0, p.process_time / 1000.0, p.process_time_max / 1000.0,
+			p.period ? p.process_time * 100.0 / p.period : 0.0,
+			p.xrun_count, p.queue_depth);
+
+		for (j = 0; j < PW_NODE_PROFILE_HISTOGRAM_SIZE; j++) {
+			if (p.histogram[j] == 0)
+				continue;
+			if (j == 0)
+				fprintf(stdout, " <2:%u", p.histogram[j]);
+			else
+				fprintf(stdout, " %u:%u", 1u << j, p.histogram[j]);
+		}
+		fprintf(stdout, "\n");
+	}
+}
+
+static void on_profile_timeout(void *_data, uint64_t expirations)
+{
+	struct remote_data *rd = _data;
+	struct pw_loop *l = pw_main_loop_get_loop(rd->data->loop);
+
+	print_profile(rd);
+
+	if (--rd->profiler_updates <= 0) {
+		pw_loop_destroy_source(l, rd->profiler_timer);
+		rd->profiler_timer = NULL;
+		show_prompt(rd);
+	}
+}
+
+static void start_profile(struct remote_data *rd)
+{
+	struct pw_loop *l = pw_main_loop_get_loop(rd->data->loop);
+	struct timespec value;
+
+	if (rd->profiler_area == NULL)
+		return;
+
+	print_profile(rd);
+
+	if (--rd->profiler_updates <= 0 || rd->profiler_timer)
+		return;
+
+	rd->profiler_timer = pw_loop_add_timer(l, on_profile_timeout, rd);
+	value.tv_sec = 1;
+	value.tv_nsec = 0;
+	pw_loop_update_timer(l, rd->profiler_timer, &value, &value, false);
+}
+
+static void profiler_event_area(void *_data, int memfd, uint32_t offset, uint32_t size)
+{
+	struct remote_data *rd = _data;
+	void *ptr;
+
+	ptr = mmap(NULL, offset + size, PROT_READ, MAP_SHARED, memfd, 0);
+	if (ptr == MAP_FAILED) {
+		fprintf(stderr, "remote %d: can't map profiler area: %m\n", rd->id);
+		return;
+	}
+	if (rd->profiler_map)
+		munmap(rd->profiler_map, rd->profiler_size);
+
+	rd->profiler_map = ptr;
+	rd->profiler_size = offset + size;
+	rd->profiler_area = SPA_MEMBER(ptr, offset, struct pw_profiler_area);
+
+	start_profile(rd);
+}
+
+static const struct pw_profiler_proxy_events profiler_events = {
+	PW_VERSION_PROFILER_PROXY_EVENTS,
+	.area = profiler_event_area,
+};
+
+static void profiler_proxy_destroy(void *_data)
+{
+	struct remote_data *rd = _data;
+	rd->profiler = NULL;
+}
+
+static const struct pw_proxy_events profiler_proxy_events = {
+	PW_VERSION_PROXY_EVENTS,
+	.destroy = profiler_proxy_destroy,
+};
+
+static bool do_profile(struct data *data, const char *cmd, char *args, char **error)
+{
+	struct remote_data *rd = data->current;
+	struct global *global = NULL;
+	uint32_t i, size, type;
+	char *a[1];
+	int n;
+
+	n = pw_split_ip(args, WHITESPACE, 1, a);
+	rd->profiler_updates = n == 1 ? atoi(a[0]) : 1;
+
+	if (rd->profiler) {
+		start_profile(rd);
+		return true;
+	}
+
+	/* register the marshal functions for the profiler interface */
+	if (data->profiler_protocol == NULL) {
+		data->profiler_protocol = pw_protocol_native_ext_profiler_init(data->core);
+		if (data->profiler_protocol == NULL) {
+			asprintf(error, "%s: can't register profiler protocol", cmd);
+			return false;
+		}
+	}
+
+	type = spa_type_map_get_id(data->t->map, PW_TYPE_INTERFACE__Profiler);
+	size = pw_map_get_size(&rd->globals);
+	for (i = 0; i < size; i++) {
+		global = pw_map_lookup(&rd->globals, i);
+		if (global && global->type == type)
+			break;
+		global = NULL;
+	}
+	if (global == NULL) {
+		asprintf(error, "%s: remote %d has no profiler", cmd, rd->id);
+		return false;
+	}
+
+	rd->profiler = pw_registry_proxy_bind(rd->registry_proxy, global->id, type,
+					      PW_VERSION_PROFILER, 0);
+	pw_profiler_proxy_add_listener((struct pw_profiler_proxy *) rd->profiler,
+				       &rd->profiler_listener, &profiler_events, rd);
+	pw_proxy_add_listener(rd->profiler, &rd->profiler_proxy_listener,
+			      &profiler_proxy_events, rd);
+
+	return true;
+}
+
 static bool parse(struct data *data, char *buf, size_t size, char **error)
 {
 	char *a[2];